@@ -0,0 +1,234 @@
+#include <benchmark/benchmark.h>
+
+#include "simulation.h"
+#include "stations.h"
+#include "timerservice.h"
+#include "trace.h"
+#include "truck.h"
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+
+// Note that the library is built with asserts unless CMAKE_BUILD_TYPE is
+// Release, and some of them walk a station's queues. Configure with
+// -DCMAKE_BUILD_TYPE=Release for numbers that are comparable across changes.
+
+///////////////////////////////////////////////////////////////////////////
+// TimerService schedule/dispatch. The handler keeps a fixed number of events
+// pending by rescheduling every event it receives within the mining horizon,
+// which is the steady state of a simulation.
+
+struct RescheduleHandler {
+  TimerService<RescheduleHandler> timerService_;
+  std::vector<Truck> trucks_;
+  Station station_{0, &timerService_};
+  std::vector<Minutes> delays_;
+  size_t nextDelay_ = 0;
+
+  RescheduleHandler(int numPending, EventQueueKind kind)
+      : timerService_{this, kind} {
+    std::mt19937 generator{1};
+    std::uniform_int_distribution<Minutes> delay(0, kMiningDurationMax);
+    delays_.resize(4096);
+    for (Minutes &d : delays_) {
+      d = delay(generator);
+    }
+    for (int i = 0; i < numPending; i++) {
+      trucks_.emplace_back(i);
+      timerService_.scheduleEvent(
+          MiningFinished{{delay(generator)}, TruckId(i)});
+    }
+  }
+
+  Truck *truck(TruckId id) { return &trucks_[id]; }
+  Station *station(StationId) { return &station_; }
+  void reschedule(timepoint_t now, Truck *truck) {
+    Minutes d = delays_[nextDelay_++ & (delays_.size() - 1)];
+    timerService_.scheduleEvent(MiningFinished{{now + d}, truck->id()});
+  }
+  void onMiningFinished(timepoint_t now, Truck *truck) {
+    reschedule(now, truck);
+  }
+  void onArrivedAtStation(timepoint_t now, Truck *truck, Station *) {
+    reschedule(now, truck);
+  }
+  void onUnloadingFinished(timepoint_t now, Truck *truck, Station *) {
+    reschedule(now, truck);
+  }
+};
+
+// Args: number of pending events, EventQueueKind.
+static void BM_TimerServiceDispatch(benchmark::State &state) {
+  RescheduleHandler handler(state.range(0),
+                            static_cast<EventQueueKind>(state.range(1)));
+  for (auto _ : state) {
+    handler.timerService_.dispatchNextEvent();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimerServiceDispatch)
+    ->ArgNames({"pending", "multimap"})
+    ->ArgsProduct({{1 << 10, 1 << 17},
+                   {int(EventQueueKind::Calendar),
+                    int(EventQueueKind::Multimap)}});
+
+///////////////////////////////////////////////////////////////////////////
+// Stations::selectUnloadingStation. Every selection dispatches a truck and so
+// adds to a station's queue, so the trucks and stations are recreated (outside
+// the timing) after every batch of selections to keep the queues short.
+
+// Args: number of stations, StationIndexKind.
+static void BM_SelectUnloadingStation(benchmark::State &state) {
+  constexpr int kBatch = 1024;
+  int numStations = state.range(0);
+  auto kind = static_cast<StationIndexKind>(state.range(1));
+  TimerServiceBase timerService;
+  std::unique_ptr<Stations> stations;
+  std::vector<Truck> trucks;
+  int next = kBatch;
+  for (auto _ : state) {
+    if (next == kBatch) {
+      state.PauseTiming();
+      stations = std::make_unique<Stations>(numStations, &timerService, kind);
+      trucks.clear();
+      for (int i = 0; i < kBatch; i++) {
+        trucks.emplace_back(i, Truck::Mining, nullptr);
+      }
+      next = 0;
+      state.ResumeTiming();
+    }
+    Station *st = stations->selectUnloadingStation(&trucks[next++]);
+    benchmark::DoNotOptimize(st);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SelectUnloadingStation)
+    ->ArgNames({"stations", "multiset"})
+    ->ArgsProduct({{1, 100, 10000},
+                   {int(StationIndexKind::Heap),
+                    int(StationIndexKind::Multiset)}});
+
+///////////////////////////////////////////////////////////////////////////
+// Station::freeTs across all stations, as done when looking for the least
+// loaded station without an index.
+
+static void BM_StationFreeTs(benchmark::State &state) {
+  TimerServiceBase timerService;
+  std::vector<Station> stations;
+  for (int i = 0; i < state.range(0); i++) {
+    stations.emplace_back(i, &timerService);
+    stations.back().lastUnloadEndTs_ = i % 7;
+  }
+  for (auto _ : state) {
+    for (const Station &st : stations) {
+      benchmark::DoNotOptimize(st.freeTs());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * stations.size());
+}
+BENCHMARK(BM_StationFreeTs)->Arg(1000);
+
+///////////////////////////////////////////////////////////////////////////
+
+static void BM_AbsorbTruck(benchmark::State &state) {
+  TrucksStats stats;
+  std::array<Minutes, 4> truckStats = {900, 150, 3500, 20};
+  for (auto _ : state) {
+    stats.absorbTruck(truckStats);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AbsorbTruck);
+
+///////////////////////////////////////////////////////////////////////////
+// The cost of setting up a run: constructing a new simulation versus resetting
+// an existing one.
+
+// Args: number of trucks, number of stations.
+static void BM_SimulationConstruct(benchmark::State &state) {
+  for (auto _ : state) {
+    Simulation sim{{.numTrucks = int(state.range(0)),
+                    .numStations = int(state.range(1))}};
+    benchmark::DoNotOptimize(sim.trucks().data());
+  }
+}
+BENCHMARK(BM_SimulationConstruct)
+    ->ArgNames({"trucks", "stations"})
+    ->Args({100000, 10000})
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_SimulationReset(benchmark::State &state) {
+  Simulation sim{{.numTrucks = int(state.range(0)),
+                  .numStations = int(state.range(1))}};
+  uint32_t seed = 0;
+  for (auto _ : state) {
+    sim.reset(seed++);
+    benchmark::DoNotOptimize(sim.trucks().data());
+  }
+}
+BENCHMARK(BM_SimulationReset)
+    ->ArgNames({"trucks", "stations"})
+    ->Args({100000, 10000})
+    ->Unit(benchmark::kMicrosecond);
+
+///////////////////////////////////////////////////////////////////////////
+// End to end: a whole 72 hour simulation. items_per_second is the number of
+// events dispatched per second.
+
+// Args: number of trucks, number of stations.
+static void BM_Simulation(benchmark::State &state) {
+  uint64_t numEvents = 0;
+  for (auto _ : state) {
+    Simulation sim{{.numTrucks = int(state.range(0)),
+                    .numStations = int(state.range(1))}};
+    sim.start();
+    numEvents += sim.numDispatchedEvents();
+  }
+  state.SetItemsProcessed(numEvents);
+}
+BENCHMARK(BM_Simulation)
+    ->ArgNames({"trucks", "stations"})
+    ->ArgsProduct({{1000, 10000, 100000, 1000000, 10000000},
+                   {1, 10, 100, 1000, 10000}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Iterations(1);
+
+///////////////////////////////////////////////////////////////////////////
+// The cost of tracing a whole simulation to a new file in the temp dir.
+// Truncating the file of the previous iteration would add the time it takes
+// to drop it from the page cache, so it is removed outside of the timing.
+
+// Args: number of trucks, number of stations, whether to trace.
+static void BM_SimulationTrace(benchmark::State &state) {
+  std::string path =
+      (std::filesystem::temp_directory_path() / "bench_simulation.trace")
+          .string();
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::filesystem::remove(path);
+    state.ResumeTiming();
+    Simulation sim{{.numTrucks = int(state.range(0)),
+                    .numStations = int(state.range(1))}};
+    std::optional<TraceWriter> trace;
+    if (state.range(2)) {
+      trace.emplace(path);
+      sim.setTrace(&*trace);
+    }
+    sim.start();
+    if (trace) {
+      trace->flush();
+    }
+  }
+  std::filesystem::remove(path);
+}
+BENCHMARK(BM_SimulationTrace)
+    ->ArgNames({"trucks", "stations", "trace"})
+    ->ArgsProduct({{100000}, {500}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,78 @@
+#include "branches.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+BranchRunner::BranchRunner(const SimulationConfig &config, timepoint_t forkTs,
+                           std::vector<Branch> branches, int numThreads)
+    : config_{config}, forkTs_{forkTs}, branches_{std::move(branches)},
+      numThreads_{std::clamp(numThreads, 1,
+                             std::max<int>(branches_.size(), 1))},
+      results_(branches_.size()) {}
+
+void BranchRunner::run() {
+  std::string snapshot;
+  {
+    Simulation prefix{config_};
+    prefix.begin();
+    prefix.resume(forkTs_);
+    std::ostringstream os;
+    prefix.saveCheckpoint(os);
+    snapshot = std::move(os).str();
+  }
+
+  std::atomic<size_t> nextBranch = 0;
+  // A perturbation may throw, e.g. for a station that does not exist. The
+  // exception of each branch is kept in its slot and the first one is
+  // rethrown once all threads are done.
+  std::vector<std::exception_ptr> errors(branches_.size());
+  auto worker = [this, &snapshot, &nextBranch, &errors]() {
+    Simulation sim{config_};
+    for (size_t i = nextBranch++; i < branches_.size(); i = nextBranch++) {
+      try {
+        std::istringstream is{snapshot};
+        sim.restoreCheckpoint(is);
+        if (branches_[i].perturb) {
+          branches_[i].perturb(sim);
+        }
+        sim.resume();
+        // Each branch writes to its own slot, so no locking is needed.
+        results_[i] = summarizeSimulation(sim);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads_; t++) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (const std::exception_ptr &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+void BranchRunner::printStats() const {
+  std::cout << std::fixed;
+  std::cout << "Branches forked at ts " << forkTs_ << ":" << std::endl;
+  std::cout << "Branch\tTrucks utilization\tTruck Waiting\tStation "
+               "utilization"
+            << std::endl;
+  for (size_t i = 0; i < branches_.size(); i++) {
+    const ReplicaResult &r = results_[i];
+    std::cout << branches_[i].name << "\t" << std::setprecision(4)
+              << r.truckUtilization << "\t" << std::setprecision(2)
+              << r.stateMeans[Truck::Waiting] << "\t" << std::setprecision(4)
+              << r.stationUtilization << std::endl;
+  }
+}
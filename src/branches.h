@@ -0,0 +1,48 @@
+#pragma once
+
+#include "replicas.h"
+#include "simulation.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// A what-if scenario: the simulation carries on from the fork after perturb
+// (if any) has been applied to it, e.g. closing a station.
+struct Branch {
+  std::string name;
+  std::function<void(Simulation &)> perturb;
+};
+
+// Runs several what-if branches of one simulation. The simulation first runs
+// up to the fork once; this shared prefix is then cloned into every branch,
+// which applies its perturbation and runs to the end. So N scenarios cost one
+// prefix and N suffixes rather than N full runs.
+//
+// A clone is made by restoring a checkpoint of the simulation at the fork
+// (see SimulationBase::saveCheckpoint), which is taken once and shared by all
+// branches. Restoring only touches the compact state of trucks, stations and
+// pending events, so it is cheap compared to simulating the prefix. Like
+// ReplicaRunner, the branches are spread across a pool of threads, each of
+// which reuses one Simulation for all of its branches. A branch's results do
+// not depend on the number of threads.
+class BranchRunner {
+  SimulationConfig config_;
+  timepoint_t forkTs_;
+  std::vector<Branch> branches_;
+  int numThreads_;
+  std::vector<ReplicaResult> results_;
+
+public:
+  // The branches fork off before the first event at or after forkTs.
+  BranchRunner(const SimulationConfig &config, timepoint_t forkTs,
+               std::vector<Branch> branches, int numThreads);
+
+  // Runs the prefix and then all branches, and returns once they have all
+  // finished. Rethrows the exception of the first branch that threw, if any.
+  void run();
+  const std::vector<Branch> &branches() const { return branches_; }
+  // Results of every branch, in the order of branches().
+  const std::vector<ReplicaResult> &results() const { return results_; }
+  // Prints one line of results per branch.
+  void printStats() const;
+};
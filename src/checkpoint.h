@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+// A checkpoint is a binary snapshot of the whole state of a simulation, from
+// which it can be resumed and produce exactly the same results as if it had
+// never been interrupted (see SimulationBase::saveCheckpoint). Every entity
+// writes its own state, field by field, in the native byte order. Pointers
+// between entities are written as ids. A checkpoint is meant to be restored
+// by the same build on the same kind of machine; the version is bumped
+// whenever the layout changes.
+
+// Writes plain values to a stream.
+class CheckpointWriter {
+  std::ostream &os_;
+
+public:
+  explicit CheckpointWriter(std::ostream &os) : os_{os} {}
+
+  template <class T> void write(const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    os_.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+  void writeString(const std::string &s) {
+    write<uint64_t>(s.size());
+    os_.write(s.data(), s.size());
+  }
+  template <class T> void writeVector(const std::vector<T> &v) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    write<uint64_t>(v.size());
+    os_.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+  }
+  // Throws std::runtime_error if any of the writes failed.
+  void finish() {
+    os_.flush();
+    if (!os_) {
+      throw std::runtime_error("Cannot write checkpoint");
+    }
+  }
+};
+
+// Reads back what a CheckpointWriter wrote. Throws std::runtime_error if the
+// stream ends early.
+class CheckpointReader {
+  static constexpr uint64_t kMaxStringSize = 1 << 20;
+  std::istream &is_;
+
+  void check() {
+    if (!is_) {
+      throw std::runtime_error("Truncated checkpoint");
+    }
+  }
+
+public:
+  explicit CheckpointReader(std::istream &is) : is_{is} {}
+
+  template <class T> T read() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    is_.read(reinterpret_cast<char *>(&value), sizeof(T));
+    check();
+    return value;
+  }
+  // Reads a vector of at most maxSize elements.
+  template <class T> std::vector<T> readVector(uint64_t maxSize) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint64_t size = read<uint64_t>();
+    if (size > maxSize) {
+      throw std::runtime_error("Corrupt checkpoint");
+    }
+    std::vector<T> v(size);
+    is_.read(reinterpret_cast<char *>(v.data()), size * sizeof(T));
+    check();
+    return v;
+  }
+  std::string readString() {
+    uint64_t size = read<uint64_t>();
+    // Guards against allocating whatever a corrupt size says.
+    if (size > kMaxStringSize) {
+      throw std::runtime_error("Corrupt checkpoint");
+    }
+    std::string s(size, '\0');
+    is_.read(s.data(), s.size());
+    check();
+    return s;
+  }
+};
@@ -0,0 +1,94 @@
+#include "eventqueue.h"
+#include <algorithm>
+#include <bit>
+
+CalendarEventQueue::CalendarEventQueue(Minutes horizon, TieBreak tieBreak)
+    : tieBreak_{tieBreak} {
+  assert(horizon >= 0);
+  // One bucket for every minute in [now, now + horizon]. Rounded up to a power
+  // of two so that a ts maps to its bucket with a mask.
+  size_t numBuckets = std::bit_ceil(static_cast<size_t>(horizon) + 1);
+  buckets_.resize(numBuckets);
+  mask_ = numBuckets - 1;
+}
+
+void CalendarEventQueue::push(const SimulationEvent &evt) {
+  timepoint_t ts = eventTs(evt);
+  assert(ts >= cursor_);
+  assert(tieBreak_ == TieBreak::Fifo || ts > cursor_ ||
+         bucket(ts).head_ == 0);
+  if (ts - cursor_ < static_cast<timepoint_t>(buckets_.size())) {
+    bucket(ts).events_.push_back(evt);
+    ringSize_++;
+  } else {
+    overflow_.insert({ts, evt});
+  }
+}
+
+void CalendarEventQueue::clear(timepoint_t now) {
+  for (Bucket &b : buckets_) {
+    b.events_.clear();
+    b.head_ = 0;
+  }
+  cursor_ = now;
+  ringSize_ = 0;
+  overflow_.clear();
+}
+
+// Moves the cursor to the next minute and recycles the bucket of the minute
+// that was just left. The minute that enters the ring may have events waiting
+// in overflow_. These were necessarily scheduled before anything that can be
+// pushed directly into the bucket from now on, so moving them now keeps the
+// FIFO order within that minute.
+void CalendarEventQueue::advanceCursor() {
+  Bucket &done = bucket(cursor_);
+  assert(done.head_ == done.events_.size());
+  done.events_.clear();
+  done.head_ = 0;
+
+  if (ringSize_ == 0 && !overflow_.empty()) {
+    // Nothing in the ring. Jump straight to the next overflow event rather
+    // than walking the empty minutes in between.
+    cursor_ = overflow_.begin()->first;
+  } else {
+    cursor_++;
+  }
+
+  timepoint_t end = cursor_ + static_cast<timepoint_t>(buckets_.size());
+  auto itr = overflow_.begin();
+  for (; itr != overflow_.end() && itr->first < end; ++itr) {
+    bucket(itr->first).events_.push_back(itr->second);
+    ringSize_++;
+  }
+  overflow_.erase(overflow_.begin(), itr);
+}
+
+bool CalendarEventQueue::popBefore(timepoint_t end, SimulationEvent &evt) {
+  Bucket *b = &bucket(cursor_);
+  while (b->head_ == b->events_.size()) {
+    // Only move the cursor towards an event before end, so that it never
+    // passes a minute that may still get events scheduled.
+    if (ringSize_ == 0 &&
+        (overflow_.empty() || overflow_.begin()->first >= end)) {
+      return false;
+    }
+    if (cursor_ + 1 >= end) {
+      return false;
+    }
+    advanceCursor();
+    b = &bucket(cursor_);
+  }
+  if (cursor_ >= end) {
+    return false;
+  }
+
+  if (tieBreak_ == TieBreak::ById && b->head_ == 0) {
+    std::sort(b->events_.begin(), b->events_.end(),
+              [](const PackedEvent &lhs, const PackedEvent &rhs) {
+                return lhs.truck() < rhs.truck();
+              });
+  }
+  ringSize_--;
+  evt = b->events_[b->head_++].unpack();
+  return true;
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include "events.h"
+#include <cassert>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+// The pending events of a TimerService are held in an event queue. Both
+// queues below dispatch events in ts order and events with the same ts in the
+// order in which they were scheduled (FIFO), so a simulation produces exactly
+// the same results irrespective of which queue it uses. The calendar queue can
+// alternatively dispatch events with the same ts in truck id order, see
+// TieBreak.
+
+enum class EventQueueKind { Calendar, Multimap };
+
+// A multimap of packed events keyed on their ts, whose tree nodes are recycled
+// through a pool owned by the map. Once the number of pending events has
+// peaked, inserting and erasing no longer allocate. The pool is held by
+// pointer in a base class so that it is created before and destroyed after
+// the map, and so that the map stays movable.
+struct EventPoolHolder {
+  std::unique_ptr<std::pmr::unsynchronized_pool_resource> pool_ =
+      std::make_unique<std::pmr::unsynchronized_pool_resource>();
+};
+
+class PooledEventMap
+    : private EventPoolHolder,
+      public std::pmr::multimap<timepoint_t, PackedEvent> {
+public:
+  PooledEventMap()
+      : std::pmr::multimap<timepoint_t, PackedEvent>{pool_.get()} {}
+  PooledEventMap(PooledEventMap &&) = default;
+  // Assigning would release the pool before the nodes allocated from it.
+  PooledEventMap &operator=(PooledEventMap &&) = delete;
+};
+
+// The original queue: a multimap keyed on the event ts. Every push costs
+// O(log N).
+class MultimapEventQueue {
+  PooledEventMap events_;
+
+public:
+  void push(const SimulationEvent &evt) {
+    // For equal keys, multimap::insert inserts at the upper bound of the
+    // equal range which gives us the FIFO behaviour.
+    events_.insert({eventTs(evt), evt});
+  }
+  bool empty() const { return events_.empty(); }
+  size_t size() const { return events_.size(); }
+  // Removes all events. The nodes go back to the pool. Events can be pushed
+  // at any ts afterwards, so the time is only taken for symmetry with
+  // CalendarEventQueue::clear.
+  void clear(timepoint_t = 0) { events_.clear(); }
+  // Calls f(evt) for every pending event, in the order they would be popped.
+  template <class F> void forEach(F &&f) const {
+    for (const auto &[ts, evt] : events_) {
+      f(evt.unpack());
+    }
+  }
+  // Removes the earliest event into evt if its ts is before end. Returns
+  // false, leaving the queue untouched, if there is no such event.
+  bool popBefore(timepoint_t end, SimulationEvent &evt) {
+    auto itr = events_.begin();
+    if (itr == events_.end() || itr->first >= end) {
+      return false;
+    }
+    evt = itr->second.unpack();
+    events_.erase(itr);
+    return true;
+  }
+  // Removes and returns the earliest event. Must not be called when empty.
+  SimulationEvent pop() {
+    SimulationEvent evt;
+    [[maybe_unused]] bool popped = popBefore(kEndOfTime, evt);
+    assert(popped);
+    return evt;
+  }
+};
+
+// A calendar queue. Simulated time is integral minutes and no event is ever
+// scheduled more than a bounded horizon ahead of now, so pending events are
+// kept in a ring of per-minute buckets. Scheduling appends to the bucket of
+// the event's minute and dispatching consumes the current bucket front to
+// back, both in O(1). Buckets are recycled as the ring turns and keep their
+// capacity, so once the ring has warmed up no further allocations happen.
+//
+// Events that are scheduled further ahead than the ring can hold are parked
+// in an ordered overflow map and moved into the ring as soon as their minute
+// falls within it. This keeps the queue correct for any ts while only paying
+// for the overflow when it is actually used.
+//
+// Both the buckets and the overflow hold PackedEvents, so that a bucket
+// fits a third more events per cache line than it would SimulationEvents.
+class CalendarEventQueue {
+  struct Bucket {
+    std::vector<PackedEvent> events_;
+    // Index of the next event to dispatch from events_.
+    size_t head_ = 0;
+  };
+
+  std::vector<Bucket> buckets_;
+  size_t mask_;
+  // The minute of the bucket currently being dispatched. No pending event
+  // has a ts before this, and the ring covers
+  // [cursor_, cursor_ + buckets_.size()).
+  timepoint_t cursor_ = 0;
+  // Number of pending events in the ring (i.e. excluding overflow_).
+  size_t ringSize_ = 0;
+  PooledEventMap overflow_;
+  TieBreak tieBreak_;
+
+  Bucket &bucket(timepoint_t ts) { return buckets_[ts & mask_]; }
+  void advanceCursor();
+
+public:
+  // horizon is the furthest ahead of the current event that events are
+  // expected to be scheduled. It only sizes the ring, see overflow_ above.
+  // With TieBreak::ById, the events of a minute are sorted by truck id when
+  // the first of them is dispatched. Events can then no longer be scheduled
+  // for the minute that is being dispatched.
+  explicit CalendarEventQueue(Minutes horizon = kMiningDurationMax,
+                              TieBreak tieBreak = TieBreak::Fifo);
+
+  void push(const SimulationEvent &evt);
+  // Removes all events and moves the cursor to now, keeping the capacity of
+  // the buckets. Events can then be pushed at any ts from now onwards.
+  void clear(timepoint_t now = 0);
+  // Calls f(evt) for every pending event, in the order they would be popped.
+  // Under TieBreak::ById, the events of a minute are only in that order once
+  // the first of them has been popped. Before that they are in the order in
+  // which they were pushed.
+  template <class F> void forEach(F &&f) const {
+    for (size_t i = 0; i < buckets_.size(); i++) {
+      const Bucket &b = buckets_[(cursor_ + i) & mask_];
+      for (size_t j = b.head_; j < b.events_.size(); j++) {
+        f(b.events_[j].unpack());
+      }
+    }
+    for (const auto &[ts, evt] : overflow_) {
+      f(evt.unpack());
+    }
+  }
+  bool empty() const { return ringSize_ == 0 && overflow_.empty(); }
+  size_t size() const { return ringSize_ + overflow_.size(); }
+  // Removes the earliest event into evt if its ts is before end. Returns
+  // false if there is no such event. Events can still be scheduled at any ts
+  // from end - 1 onwards afterwards.
+  bool popBefore(timepoint_t end, SimulationEvent &evt);
+  // Removes and returns the earliest event. Must not be called when empty.
+  SimulationEvent pop() {
+    SimulationEvent evt;
+    [[maybe_unused]] bool popped = popBefore(kEndOfTime, evt);
+    assert(popped);
+    return evt;
+  }
+};
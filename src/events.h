@@ -0,0 +1,166 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <inttypes.h>
+#include <limits>
+#include <variant>
+
+//////////////////////////////////////////////////////////////////////////////
+// Some helper types for simulated time
+using timepoint_t = int64_t;
+using Minutes = int;
+
+static constexpr Minutes kUnloadingDuration = Minutes{5};
+static constexpr Minutes kDrivingDuration = Minutes{30};
+static constexpr Minutes kMiningDurationMin = Minutes{60};
+static constexpr Minutes kMiningDurationMax = Minutes{60 * 5};
+static constexpr Minutes kSimDuration = Minutes{60 * 24 * 3};
+
+// The timing parameters of the model. They default to the constants above,
+// which are what the model was built around. The parallel engine's lookahead
+// relies on the driving and minimum mining durations being positive.
+struct Durations {
+  Minutes unloading = kUnloadingDuration;
+  Minutes driving = kDrivingDuration;
+  Minutes miningMin = kMiningDurationMin;
+  Minutes miningMax = kMiningDurationMax;
+  // How long a simulation runs for.
+  Minutes sim = kSimDuration;
+  bool operator==(const Durations &) const = default;
+  // Every duration must be positive, with miningMin <= miningMax.
+  bool valid() const {
+    return unloading > 0 && driving > 0 && miningMin > 0 &&
+           miningMin <= miningMax && sim > 0;
+  }
+  // The furthest ahead of now that an event is ever scheduled.
+  Minutes horizon() const {
+    return std::max({unloading, driving, miningMax});
+  }
+};
+
+// A ts after every event.
+static constexpr timepoint_t kEndOfTime =
+    std::numeric_limits<timepoint_t>::max();
+
+// Trucks and stations are held in contiguous arrays and are identified by
+// their index within those arrays.
+using TruckId = uint32_t;
+using StationId = uint32_t;
+// Stands in for the station where there is none, e.g. of a truck that is
+// mining.
+static constexpr StationId kNoStation = ~StationId{0};
+
+// How ties are broken between events that happen at the same ts, and between
+// stations that will become free at the same ts.
+enum class TieBreak {
+  // Events with the same ts are dispatched in the order they were scheduled,
+  // and stations are picked in the order of their last update. This is the
+  // original behaviour.
+  Fifo,
+  // Events with the same ts are dispatched in truck id order, and stations
+  // are picked in station id order. The outcome then no
+  // longer depends on the order in which simultaneous events on different
+  // stations were processed, which is what lets ParallelSimulation reproduce
+  // a sequential run exactly.
+  ById
+};
+
+////////////////////////////////////
+// These are the events of interest within the simulation. The timer service
+// is "event aware" in the sense that the handler for an event is
+// not stored within the event (via say a virtual member function dispatch)
+// but is instead known to the TimerService. See TimerService::dispatchNextEvent
+// for more details.
+
+// Base class for all events. It stores the ts at which the event happened/
+// will happen. Events refer to trucks and stations by id rather than by
+// pointer, which keeps every event at 16 bytes.
+struct Event {
+  timepoint_t ts_;
+  bool operator==(const Event &) const = default;
+};
+
+struct MiningFinished : Event {
+  TruckId truck_;
+  bool operator==(const MiningFinished &) const = default;
+};
+
+struct ArrivedAtStation : Event {
+  TruckId truck_;
+  StationId station_;
+  bool operator==(const ArrivedAtStation &) const = default;
+};
+
+struct UnloadingFinished : Event {
+  TruckId truck_;
+  StationId station_;
+  bool operator==(const UnloadingFinished &) const = default;
+};
+
+// A variant type to store all the three events.
+using SimulationEvent =
+    std::variant<MiningFinished, ArrivedAtStation, UnloadingFinished>;
+
+// The ts of any of the events held in a SimulationEvent.
+inline timepoint_t eventTs(const SimulationEvent &evt) {
+  return std::visit([](const Event &e) { return e.ts_; }, evt);
+}
+
+// The truck that any of the events held in a SimulationEvent is about.
+inline TruckId eventTruck(const SimulationEvent &evt) {
+  return std::visit([](const auto &e) { return e.truck_; }, evt);
+}
+
+// The compact form in which the event queues hold a SimulationEvent: the ts
+// and the index of the event type share one 64-bit word, followed by the
+// truck and the station. This takes 16 bytes against the 24 of the variant,
+// whose index is padded out to the 8-byte alignment of the ts, so that more
+// pending events fit in each cache line. The handlers never see it: unpack()
+// gives back the typed event, which only takes a few register moves.
+class PackedEvent {
+  static constexpr int kTypeBits = 2;
+  static_assert(std::variant_size_v<SimulationEvent> <= (1 << kTypeBits));
+
+  // ts_ << kTypeBits | the index of the event type in SimulationEvent. The
+  // ts keeps its sign, so that any ts within +/-2^61 can be packed.
+  int64_t tsAndType_;
+  TruckId truck_;
+  // kNoStation for a MiningFinished.
+  StationId station_;
+
+public:
+  PackedEvent() = default;
+  PackedEvent(const SimulationEvent &evt)
+      : tsAndType_{eventTs(evt) * (int64_t{1} << kTypeBits) |
+                   static_cast<int64_t>(evt.index())},
+        truck_{eventTruck(evt)},
+        station_{kNoStation} {
+    assert(ts() == eventTs(evt));
+    if (const auto *e = std::get_if<ArrivedAtStation>(&evt)) {
+      station_ = e->station_;
+    } else if (const auto *e = std::get_if<UnloadingFinished>(&evt)) {
+      station_ = e->station_;
+    }
+  }
+
+  timepoint_t ts() const { return tsAndType_ >> kTypeBits; }
+  size_t type() const { return tsAndType_ & ((1 << kTypeBits) - 1); }
+  TruckId truck() const { return truck_; }
+  StationId station() const { return station_; }
+
+  SimulationEvent unpack() const {
+    switch (type()) {
+    case 0:
+      return MiningFinished{{ts()}, truck_};
+    case 1:
+      return ArrivedAtStation{{ts()}, truck_, station_};
+    default:
+      return UnloadingFinished{{ts()}, truck_, station_};
+    }
+  }
+};
+static_assert(sizeof(PackedEvent) == 16);
+// PackedEvent::unpack() relies on this order.
+static_assert(SimulationEvent{MiningFinished{}}.index() == 0 &&
+              SimulationEvent{ArrivedAtStation{}}.index() == 1 &&
+              SimulationEvent{UnloadingFinished{}}.index() == 2);
@@ -0,0 +1,95 @@
+#include "fleet.h"
+#include "truck.h"
+#include <algorithm>
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+Fleet::Fleet(const std::vector<TruckClass> &classes) : classes_{classes} {
+  if (classes.empty()) {
+    throw std::invalid_argument("A fleet needs at least one truck class");
+  }
+  if (classes.size() > static_cast<size_t>(kMaxClasses)) {
+    throw std::invalid_argument("Too many truck classes");
+  }
+  int totalWeight = 0;
+  for (const TruckClass &c : classes) {
+    Durations durations{.unloading = c.unloading,
+                        .miningMin = c.miningMin,
+                        .miningMax = c.miningMax};
+    if (!(c.payload > 0) || c.weight < 1 || !durations.valid()) {
+      throw std::invalid_argument("Invalid truck class");
+    }
+    if (c.weight > std::numeric_limits<int>::max() - totalWeight) {
+      throw std::invalid_argument("Truck class weights are too large");
+    }
+    totalWeight += c.weight;
+    cumulativeWeights_.push_back(totalWeight);
+  }
+}
+
+Fleet Fleet::parseCsv(std::istream &is) {
+  std::vector<TruckClass> classes;
+  std::string line;
+  while (std::getline(is, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    TruckClass &c = classes.emplace_back();
+    const char *pos = line.data();
+    const char *end = line.data() + line.size();
+    // Each field must be a number, followed by a comma unless it is the last.
+    auto parseField = [&](auto &value, bool last) {
+      auto [ptr, ec] = std::from_chars(pos, end, value);
+      bool separated = last ? ptr == end : ptr != end && *ptr == ',';
+      if (ec != std::errc{} || !separated) {
+        throw std::invalid_argument("Malformed truck class: " + line);
+      }
+      pos = last ? ptr : ptr + 1;
+    };
+    parseField(c.payload, false);
+    parseField(c.weight, false);
+    parseField(c.unloading, false);
+    parseField(c.miningMin, false);
+    parseField(c.miningMax, true);
+  }
+  return Fleet{classes};
+}
+
+int Fleet::classOf(TruckId truck) const {
+  int position = truck % cumulativeWeights_.back();
+  return std::upper_bound(cumulativeWeights_.begin(), cumulativeWeights_.end(),
+                          position) -
+         cumulativeWeights_.begin();
+}
+
+Minutes Fleet::horizon() const {
+  Minutes horizon = 0;
+  for (const TruckClass &c : classes_) {
+    horizon = std::max({horizon, c.unloading, c.miningMax});
+  }
+  return horizon;
+}
+
+void Fleet::printStats(const std::vector<Truck> &trucks) const {
+  std::vector<TrucksStats> stats(classes_.size());
+  std::vector<uint64_t> numTrucks(classes_.size());
+  std::vector<uint64_t> loads(classes_.size());
+  for (const Truck &truck : trucks) {
+    stats[truck.truckClass()].absorbTruck(truck.retrieveStats());
+    numTrucks[truck.truckClass()]++;
+    // Every mining cycle after the first began with a load unloaded.
+    loads[truck.truckClass()] += std::max(truck.miningCycles(), 1u) - 1;
+  }
+  std::cout << std::fixed;
+  for (size_t c = 0; c < classes_.size(); c++) {
+    std::cout << std::setprecision(2) << "Truck class " << c << ": "
+              << numTrucks[c] << " trucks, utilization "
+              << (numTrucks[c] ? stats[c].utilization() : 0.0) << ", "
+              << loads[c] << " loads, payload delivered "
+              << loads[c] * classes_[c].payload << std::endl;
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "events.h"
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+class Truck;
+
+// One class of haul trucks, with its own payload, unload time and range of
+// mining durations.
+struct TruckClass {
+  // What a truck of the class hauls per load, e.g. in tonnes. It does not
+  // affect the simulation, and is only reported (see Fleet::printStats).
+  double payload = 1.0;
+  // The share of the fleet in this class, relative to the weights of the
+  // other classes.
+  int weight = 1;
+  Minutes unloading = kUnloadingDuration;
+  Minutes miningMin = kMiningDurationMin;
+  Minutes miningMax = kMiningDurationMax;
+  bool operator==(const TruckClass &) const = default;
+};
+
+// The classes of a mixed fleet of trucks. The classes are interleaved in
+// proportion to their weights: truck t is of the class whose share of
+// [0, totalWeight) holds t % totalWeight, so that e.g. weights 3 and 1 make
+// three in every four consecutive trucks of the first class. A simulation
+// without a fleet (empty()) has one class of trucks, with the unloading and
+// mining durations of its Durations.
+class Fleet {
+  std::vector<TruckClass> classes_;
+  // The sum of the weights of classes_[0..c], for every class c.
+  std::vector<int> cumulativeWeights_;
+
+public:
+  // The most classes a simulation can have, since a Truck keeps its class in
+  // 8 bits.
+  static constexpr int kMaxClasses = UINT8_MAX + 1;
+
+  Fleet() = default;
+  // Throws std::invalid_argument if there are no classes or more than
+  // kMaxClasses, or a class has a payload or weight that is not positive,
+  // or durations that are not valid (see Durations::valid()).
+  explicit Fleet(const std::vector<TruckClass> &classes);
+  // Reads one class per line as payload,weight,unloading,mining_min,
+  // mining_max. Throws std::invalid_argument if the text is malformed or as
+  // above.
+  static Fleet parseCsv(std::istream &is);
+
+  bool empty() const { return classes_.empty(); }
+  int numClasses() const { return classes_.size(); }
+  const TruckClass &at(int c) const { return classes_[c]; }
+  const std::vector<TruckClass> &classes() const { return classes_; }
+  // The class of a truck, see above. O(log numClasses()).
+  int classOf(TruckId truck) const;
+  // The furthest ahead of now that a truck of any class schedules an event,
+  // or 0 if empty.
+  Minutes horizon() const;
+  bool operator==(const Fleet &other) const {
+    return classes_ == other.classes_;
+  }
+
+  // Prints the number of trucks, the utilization and the loads and payload
+  // delivered of every class, out of the trucks of a simulation with this
+  // fleet.
+  void printStats(const std::vector<Truck> &trucks) const;
+};
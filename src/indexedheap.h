@@ -0,0 +1,147 @@
+#pragma once
+#include "instrument.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// A d-ary min-heap over a fixed set of items identified by a dense index in
+// [0, capacity). Along with the usual heap, it keeps the position of every
+// item within the heap so that the key of any item can be changed in
+// O(log_d N) given just its index.
+//
+// The keys are stored inline with the item indices in one contiguous array,
+// so a sift only touches a few adjacent cache lines per level. A fan-out of
+// 4 halves the depth of a binary heap while still letting all children of a
+// node be compared within one or two cache lines.
+template <class Key, unsigned D = 4> class IndexedDaryHeap {
+  static_assert(D >= 2);
+  static constexpr uint32_t kNotInHeap = std::numeric_limits<uint32_t>::max();
+
+  struct Node {
+    Key key_;
+    uint32_t item_;
+  };
+  std::vector<Node> heap_;
+  // pos_[item] is the position of the item in heap_, or kNotInHeap.
+  std::vector<uint32_t> pos_;
+
+  // Every key comparison goes through here, so that the instrumentation
+  // counts it like the multiset counts Station::operator<.
+  static bool less(const Key &lhs, const Key &rhs) {
+    instrument::countStationComparison();
+    return lhs < rhs;
+  }
+
+  void place(uint32_t pos, Node node) {
+    heap_[pos] = node;
+    pos_[node.item_] = pos;
+  }
+
+  void siftUp(uint32_t pos) {
+    Node node = heap_[pos];
+    while (pos > 0) {
+      uint32_t parent = (pos - 1) / D;
+      if (!less(node.key_, heap_[parent].key_)) {
+        break;
+      }
+      place(pos, heap_[parent]);
+      pos = parent;
+    }
+    place(pos, node);
+  }
+
+  void siftDown(uint32_t pos) {
+    Node node = heap_[pos];
+    uint32_t size = heap_.size();
+    while (true) {
+      uint32_t first = pos * D + 1;
+      if (first >= size) {
+        break;
+      }
+      uint32_t last = std::min(first + D, size);
+      uint32_t best = first;
+      for (uint32_t c = first + 1; c < last; c++) {
+        if (less(heap_[c].key_, heap_[best].key_)) {
+          best = c;
+        }
+      }
+      if (!less(heap_[best].key_, node.key_)) {
+        break;
+      }
+      place(pos, heap_[best]);
+      pos = best;
+    }
+    place(pos, node);
+  }
+
+public:
+  explicit IndexedDaryHeap(uint32_t capacity = 0) { reserve(capacity); }
+
+  // Makes room for items with indices in [0, capacity).
+  void reserve(uint32_t capacity) {
+    heap_.reserve(capacity);
+    if (pos_.size() < capacity) {
+      pos_.resize(capacity, kNotInHeap);
+    }
+  }
+
+  // Removes all items, keeping the capacity.
+  void clear() {
+    heap_.clear();
+    std::fill(pos_.begin(), pos_.end(), kNotInHeap);
+  }
+
+  bool empty() const { return heap_.empty(); }
+  size_t size() const { return heap_.size(); }
+  bool contains(uint32_t item) const { return pos_[item] != kNotInHeap; }
+
+  // The item with the smallest key and its key. Must not be called when empty.
+  uint32_t top() const { return heap_.front().item_; }
+  const Key &topKey() const { return heap_.front().key_; }
+  const Key &key(uint32_t item) const { return heap_[pos_[item]].key_; }
+
+  void push(uint32_t item, Key key) {
+    assert(item < pos_.size() && !contains(item));
+    heap_.push_back(Node{std::move(key), item});
+    pos_[item] = heap_.size() - 1;
+    siftUp(heap_.size() - 1);
+  }
+
+  // Removes an item that is in the heap. The last node takes its place and is
+  // moved up or down as needed.
+  void erase(uint32_t item) {
+    assert(contains(item));
+    uint32_t pos = pos_[item];
+    pos_[item] = kNotInHeap;
+    Node last = heap_.back();
+    heap_.pop_back();
+    if (pos == heap_.size()) {
+      return;
+    }
+    bool increased = less(heap_[pos].key_, last.key_);
+    place(pos, std::move(last));
+    if (increased) {
+      siftDown(pos);
+    } else {
+      siftUp(pos);
+    }
+  }
+
+  // Changes the key of an item that is in the heap, moving it up or down as
+  // needed.
+  void update(uint32_t item, Key key) {
+    assert(contains(item));
+    uint32_t pos = pos_[item];
+    bool increased = less(heap_[pos].key_, key);
+    heap_[pos].key_ = std::move(key);
+    if (increased) {
+      siftDown(pos);
+    } else {
+      siftUp(pos);
+    }
+  }
+};
@@ -0,0 +1,132 @@
+#include "instrument.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace instrument {
+
+void Counters::merge(const Counters &other) {
+  for (size_t t = 0; t < kNumEventTypes; t++) {
+    events[t] += other.events[t];
+    handlerCalls[t] += other.handlerCalls[t];
+    handlerTicks[t] += other.handlerTicks[t];
+    handlerLatency[t].merge(other.handlerLatency[t]);
+  }
+  stationComparisons += other.stationComparisons;
+  peakPendingEvents = std::max(peakPendingEvents, other.peakPendingEvents);
+}
+
+#if defined(MININGSIM_INSTRUMENT)
+
+namespace {
+
+// The counters of the running threads, and the sum of those that finished.
+struct Registry {
+  std::mutex mutex;
+  std::vector<detail::ThreadCounters *> running;
+  Counters finished;
+};
+
+// Never destroyed, since threads may still exit after main() returns.
+Registry &registry() {
+  static Registry *registry = new Registry;
+  return *registry;
+}
+
+} // namespace
+
+detail::ThreadCounters::ThreadCounters() {
+  Registry &r = registry();
+  std::lock_guard lock{r.mutex};
+  r.running.push_back(this);
+}
+
+detail::ThreadCounters::~ThreadCounters() {
+  Registry &r = registry();
+  std::lock_guard lock{r.mutex};
+  r.finished.merge(snapshot());
+  std::erase(r.running, this);
+}
+
+Counters detail::ThreadCounters::snapshot() {
+  Counters counters;
+  for (size_t t = 0; t < kNumEventTypes; t++) {
+    counters.events[t] = events[t].load(std::memory_order_relaxed);
+    counters.handlerCalls[t] = handlerCalls[t].load(std::memory_order_relaxed);
+    counters.handlerTicks[t] = handlerTicks[t].load(std::memory_order_relaxed);
+  }
+  counters.stationComparisons =
+      stationComparisons.load(std::memory_order_relaxed);
+  counters.peakPendingEvents =
+      peakPendingEvents.load(std::memory_order_relaxed);
+  std::lock_guard lock{mutex};
+  counters.handlerLatency = handlerLatency;
+  return counters;
+}
+
+void detail::ThreadCounters::clear() {
+  for (size_t t = 0; t < kNumEventTypes; t++) {
+    events[t].store(0, std::memory_order_relaxed);
+    handlerCalls[t].store(0, std::memory_order_relaxed);
+    handlerTicks[t].store(0, std::memory_order_relaxed);
+  }
+  stationComparisons.store(0, std::memory_order_relaxed);
+  peakPendingEvents.store(0, std::memory_order_relaxed);
+  std::lock_guard lock{mutex};
+  for (LogHistogram &latency : handlerLatency) {
+    latency.clear();
+  }
+}
+
+Counters collect() {
+  Registry &r = registry();
+  std::lock_guard lock{r.mutex};
+  Counters total = r.finished;
+  for (detail::ThreadCounters *counters : r.running) {
+    total.merge(counters->snapshot());
+  }
+  return total;
+}
+
+void reset() {
+  Registry &r = registry();
+  std::lock_guard lock{r.mutex};
+  r.finished = Counters{};
+  for (detail::ThreadCounters *counters : r.running) {
+    counters->clear();
+  }
+}
+
+#else
+
+Counters collect() { return Counters{}; }
+
+void reset() {}
+
+#endif
+
+void printReport(std::ostream &os) {
+  static constexpr const char *kNames[kNumEventTypes] = {
+      "MiningFinished", "ArrivedAtStation", "UnloadingFinished"};
+  Counters counters = collect();
+  os << std::fixed;
+  os << "Instrumentation:" << std::endl;
+  os << "Handler\tEvents\tCalls\tTicks/event\tTicks/call p50\tTicks/call p99"
+     << std::endl;
+  for (size_t t = 0; t < kNumEventTypes; t++) {
+    double ticksPerEvent =
+        counters.events[t]
+            ? static_cast<double>(counters.handlerTicks[t]) / counters.events[t]
+            : 0.0;
+    os << kNames[t] << "\t" << counters.events[t] << "\t"
+       << counters.handlerCalls[t] << "\t" << std::setprecision(1)
+       << ticksPerEvent << "\t" << counters.handlerLatency[t].quantile(0.5)
+       << "\t" << counters.handlerLatency[t].quantile(0.99) << std::endl;
+  }
+  os << "Station comparisons: " << counters.stationComparisons << std::endl;
+  os << "Peak pending events: " << counters.peakPendingEvents << std::endl;
+}
+
+} // namespace instrument
@@ -0,0 +1,168 @@
+#pragma once
+#include "events.h"
+#include "stats.h"
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <variant>
+#if defined(MININGSIM_INSTRUMENT)
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
+// Instrumentation of the hot path: how many events of each type happen, how
+// long their handlers take, how often the station index (the multiset or the
+// heaps) compares stations and how many events are pending at most. It is switched on at
+// compile time by defining MININGSIM_INSTRUMENT (cmake
+// -DMININGSIM_INSTRUMENT=ON). Otherwise all the hooks below are empty inline
+// functions and HandlerTimer is an empty class, so they compile to nothing
+// and the simulation runs exactly as fast as without them.
+//
+// Each thread counts into its own thread_local counters, and collect() adds
+// up the counters of all threads. The counts are relaxed atomics that only
+// their thread writes, which costs the hooks a plain load and store while
+// letting collect() and reset() read and zero them from other threads. Only
+// the latency histograms, which may reallocate, are guarded by a mutex per
+// thread. It is taken once per handler, after the handler has been timed.
+namespace instrument {
+
+#if defined(MININGSIM_INSTRUMENT)
+inline constexpr bool kEnabled = true;
+#else
+inline constexpr bool kEnabled = false;
+#endif
+
+// One slot per alternative of SimulationEvent, in the same order.
+inline constexpr size_t kNumEventTypes = std::variant_size_v<SimulationEvent>;
+// The slot of events of type E.
+template <class E>
+inline constexpr size_t eventType = SimulationEvent{E{}}.index();
+
+struct Counters {
+  // Events popped from the event queue, by type.
+  std::array<uint64_t, kNumEventTypes> events = {};
+  // Calls of the handlers of each type, the ticks spent in them and the
+  // ticks per call. A batch handler (see TimerService::dispatchNextBatch)
+  // counts as one call for all the events of its batch.
+  std::array<uint64_t, kNumEventTypes> handlerCalls = {};
+  std::array<uint64_t, kNumEventTypes> handlerTicks = {};
+  std::array<LogHistogram, kNumEventTypes> handlerLatency;
+  // Comparisons of stations by the station index: calls of
+  // Station::operator< in the multiset, or of keys in the heaps.
+  uint64_t stationComparisons = 0;
+  // The largest number of events that were pending in one event queue.
+  size_t peakPendingEvents = 0;
+
+  // Adds up the counts, and keeps the larger peak.
+  void merge(const Counters &other);
+};
+
+// The counters of all threads, including those that have finished. Threads
+// that are still running may be collected at any time, but their counts
+// only add up to whole events once they are done, e.g. after
+// ReplicaRunner::run() has joined its threads. All zero unless kEnabled.
+Counters collect();
+// Zeroes the counters of all threads. Counts that a running thread adds at
+// the same time may be kept.
+void reset();
+// Prints the counters of collect(), in the style of the other stats.
+void printReport(std::ostream &os);
+
+#if defined(MININGSIM_INSTRUMENT)
+
+namespace detail {
+// The counters of one thread, see Counters. Registers itself with
+// collect(), and folds its counts into those of the finished threads when
+// its thread exits.
+struct ThreadCounters {
+  using Count = std::atomic<uint64_t>;
+  std::array<Count, kNumEventTypes> events = {};
+  std::array<Count, kNumEventTypes> handlerCalls = {};
+  std::array<Count, kNumEventTypes> handlerTicks = {};
+  Count stationComparisons = 0;
+  Count peakPendingEvents = 0;
+  // Guards handlerLatency.
+  std::mutex mutex;
+  std::array<LogHistogram, kNumEventTypes> handlerLatency;
+
+  ThreadCounters();
+  ~ThreadCounters();
+  // Called by other threads to read or zero the counts.
+  Counters snapshot();
+  void clear();
+};
+inline thread_local ThreadCounters threadCounters;
+
+// Only the owning thread adds to a count, so it needs no atomic add.
+inline void add(ThreadCounters::Count &count, uint64_t n) {
+  count.store(count.load(std::memory_order_relaxed) + n,
+              std::memory_order_relaxed);
+}
+} // namespace detail
+
+// The counters of the calling thread.
+inline detail::ThreadCounters &local() { return detail::threadCounters; }
+
+// The time stamp counter where there is one, which costs a few cycles to
+// read, otherwise nanoseconds of the steady clock.
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+inline void countEvent(size_t type) { detail::add(local().events[type], 1); }
+inline void countStationComparison() {
+  detail::add(local().stationComparisons, 1);
+}
+inline void countPendingEvents(size_t numPending) {
+  detail::ThreadCounters::Count &peak = local().peakPendingEvents;
+  if (numPending > peak.load(std::memory_order_relaxed)) {
+    peak.store(numPending, std::memory_order_relaxed);
+  }
+}
+
+// Times the handler of an event of the given type from construction to
+// destruction.
+class HandlerTimer {
+  size_t type_;
+  uint64_t start_;
+
+public:
+  explicit HandlerTimer(size_t type) : type_{type}, start_{ticks()} {}
+  ~HandlerTimer() {
+    uint64_t elapsed = ticks() - start_;
+    detail::ThreadCounters &counters = local();
+    detail::add(counters.handlerCalls[type_], 1);
+    detail::add(counters.handlerTicks[type_], elapsed);
+    std::lock_guard lock{counters.mutex};
+    counters.handlerLatency[type_].add(elapsed);
+  }
+  HandlerTimer(const HandlerTimer &) = delete;
+  HandlerTimer &operator=(const HandlerTimer &) = delete;
+};
+
+#else
+
+inline void countEvent(size_t) {}
+inline void countStationComparison() {}
+inline void countPendingEvents(size_t) {}
+
+class HandlerTimer {
+public:
+  explicit HandlerTimer(size_t) {}
+  HandlerTimer(const HandlerTimer &) = delete;
+  HandlerTimer &operator=(const HandlerTimer &) = delete;
+};
+
+#endif
+
+} // namespace instrument
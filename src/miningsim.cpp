@@ -1,38 +1,436 @@
+#include "branches.h"
+#include "instrument.h"
+#include "parallelsimulation.h"
+#include "replicas.h"
+#include "sampler.h"
 #include "simulation.h"
+#include "steadystate.h"
+#include "sweep.h"
+#include "trace.h"
 #include <boost/program_options.hpp>
 #include <chrono>
+#include <fstream>
+#include <optional>
+#include <thread>
 
 namespace po = boost::program_options;
 
 int main(int argc, char **argv) {
-  int numTrucks = -1;
-  int numStations = -1;
+  std::string trucks;
+  std::string stations;
+  std::string unloading = std::to_string(kUnloadingDuration);
+  std::string driving = std::to_string(kDrivingDuration);
+  std::string miningMin = std::to_string(kMiningDurationMin);
+  std::string miningMax = std::to_string(kMiningDurationMax);
+  std::string simDuration = std::to_string(kSimDuration);
+  bool sweep = false;
+  std::string format = "csv";
+  std::string output;
+  std::string tracePath;
+  std::string checkpointPath;
+  timepoint_t checkpointAt = -1;
+  std::string restorePath;
+  timepoint_t forkAt = -1;
+  std::vector<StationId> closeStations;
+  std::string eventQueue = "calendar";
+  std::string stationIndex = "heap";
+  uint32_t seed = 0;
+  std::string rng = "mt19937";
+  std::string tieBreak = "fifo";
+  bool parallel = false;
+  bool batchDispatch = false;
+  bool stationStats = false;
+  std::string samplesPath;
+  std::string travelTimesPath;
+  std::string truckClassesPath;
+  Minutes sampleInterval = 10;
+  double steadyStateTolerance = 0.0;
+  Minutes batchLength = SteadyStateConfig{}.batchLength;
+  int numReplicas = 1;
+  bool antithetic = false;
+  int compareStations = 0;
+  int numThreads = std::max(1u, std::thread::hardware_concurrency());
   try {
     po::options_description desc{"Options"};
     desc.add_options()("help,h", "help screen")(
-        "trucks,n", po::value<int>(&numTrucks),
+        "trucks,n", po::value<std::string>(&trucks),
         "Number of trucks in simulation. Must be >= 1")(
-        "stations,m", po::value<int>(&numStations),
-        "Number of unload stations in simulation. Must be >= 1");
+        "stations,m", po::value<std::string>(&stations),
+        "Number of unload stations in simulation. Must be >= 1")(
+        "unloading", po::value<std::string>(&unloading),
+        "Minutes to unload a truck. Default 5")(
+        "driving", po::value<std::string>(&driving),
+        "Minutes to drive to a station. Default 30")(
+        "mining-min", po::value<std::string>(&miningMin),
+        "Shortest mining duration in minutes. Default 60")(
+        "mining-max", po::value<std::string>(&miningMax),
+        "Longest mining duration in minutes. Default 300")(
+        "sim-duration", po::value<std::string>(&simDuration),
+        "Minutes of simulated time to run for. Default 4320 (72 hours)")(
+        "travel-times", po::value<std::string>(&travelTimesPath),
+        "CSV file of the minutes to drive from each mining zone (one line "
+        "each) to each of the --stations stations, instead of --driving. "
+        "Truck t mines in zone t % number of zones. Each event costs "
+        "O(zones * log stations), or O(stations) with many zones")(
+        "truck-classes", po::value<std::string>(&truckClassesPath),
+        "CSV file of truck classes, one line each of payload,weight,"
+        "unloading,mining_min,mining_max, instead of --unloading and "
+        "--mining-min/max. The classes are interleaved by weight")(
+        "sweep", po::bool_switch(&sweep),
+        "Run one simulation per point of the grid spanned by the options "
+        "above, each of which then takes a range first:last[:step], on "
+        "--threads threads. Writes one row per point")(
+        "format", po::value<std::string>(&format),
+        "Output format of --sweep: csv (default) or json")(
+        "output,o", po::value<std::string>(&output),
+        "File to write the output of --sweep to. Default stdout")(
+        "trace", po::value<std::string>(&tracePath),
+        "Record every event of a single simulation to this file, see "
+        "tracetool")(
+        "checkpoint", po::value<std::string>(&checkpointPath),
+        "Pause a single simulation before --checkpoint-at and save its whole "
+        "state to this file, instead of running it to the end")(
+        "checkpoint-at", po::value<timepoint_t>(&checkpointAt),
+        "Simulated time of --checkpoint. Events at or after it are left for "
+        "the restored simulation")(
+        "restore", po::value<std::string>(&restorePath),
+        "Resume a single simulation from a file saved by --checkpoint. The "
+        "number of trucks and stations, the seed and the durations are those "
+        "of the checkpoint. The other options must match it")(
+        "fork-at", po::value<timepoint_t>(&forkAt),
+        "Run a single simulation up to this simulated time once, then fork "
+        "it into what-if branches that each run to the end on --threads "
+        "threads: a baseline and one per --close-station")(
+        "close-station",
+        po::value<std::vector<StationId>>(&closeStations)->composing(),
+        "With --fork-at, add a branch in which this station is closed at the "
+        "fork. Can be given several times")(
+        "event-queue", po::value<std::string>(&eventQueue),
+        "Event queue implementation: calendar (default) or multimap")(
+        "station-index", po::value<std::string>(&stationIndex),
+        "Station selection index: heap (default) or multiset")(
+        "seed", po::value<uint32_t>(&seed),
+        "Seed for the random mining durations. Default 0")(
+        "rng", po::value<std::string>(&rng),
+        "Random number generator: mt19937 (default, one sequential stream) "
+        "or philox (counter-based, keyed by seed, truck and cycle)")(
+        "tie-break", po::value<std::string>(&tieBreak),
+        "Order of simultaneous events and equally loaded stations: fifo "
+        "(default, order of scheduling) or id (truck/station id)")(
+        "samples", po::value<std::string>(&samplesPath),
+        "Write the number of trucks in each state, busy stations and pending "
+        "events of a single simulation to this CSV file every "
+        "--sample-interval minutes")(
+        "sample-interval", po::value<Minutes>(&sampleInterval),
+        "Minutes of simulated time between --samples. Default 10")(
+        "steady-state", po::value<double>(&steadyStateTolerance),
+        "Stop a single simulation, or every point of --sweep, once the 95% "
+        "confidence intervals of the truck and station utilizations are "
+        "within this fraction of their means, e.g. 0.01. Estimated by batch "
+        "means after cutting off the warm-up")(
+        "batch-length", po::value<Minutes>(&batchLength),
+        "Minutes of simulated time per batch of --steady-state. Default 60")(
+        "station-stats", po::bool_switch(&stationStats),
+        "Also print the utilization and the quantiles of the truck waits and "
+        "of the queue lengths of every station")(
+        "batch-dispatch", po::bool_switch(&batchDispatch),
+        "Dispatch all events of a minute at once, grouped by type. Needs "
+        "--tie-break=id")(
+        "parallel", po::bool_switch(&parallel),
+        "Run a single simulation across --threads threads. Implies "
+        "--rng=philox and --tie-break=id")(
+        "replicas", po::value<int>(&numReplicas),
+        "Number of independent replicas to run, with seeds seed, seed+1, ... "
+        "Stats are reported as means with confidence intervals across "
+        "replicas. Default 1")(
+        "antithetic", po::bool_switch(&antithetic),
+        "Run the --replicas in antithetic pairs that share a seed, with "
+        "every mining duration of the second reflected within its range "
+        "(implies --rng=philox). Needs an even number of replicas")(
+        "compare-stations", po::value<int>(&compareStations),
+        "Run the --replicas with both --stations and this many stations, "
+        "with common random numbers (implies --rng=philox), and report the "
+        "paired differences between the two")(
+        "threads", po::value<int>(&numThreads),
+        "Number of threads to run replicas or a parallel simulation on. "
+        "Defaults to the number of cores");
     po::variables_map vm;
     po::store(parse_command_line(argc, argv, desc), vm);
     po::notify(vm);
 
-    if (vm.count("help") || numTrucks < 1 || numStations < 1) {
+    SweepRanges ranges;
+    if (!vm.count("help") && vm.count("trucks") && vm.count("stations")) {
+      ranges.trucks = SweepRange::parse(trucks);
+      ranges.stations = SweepRange::parse(stations);
+      ranges.unloading = SweepRange::parse(unloading);
+      ranges.driving = SweepRange::parse(driving);
+      ranges.miningMin = SweepRange::parse(miningMin);
+      ranges.miningMax = SweepRange::parse(miningMax);
+      ranges.sim = SweepRange::parse(simDuration);
+    }
+    bool singlePoint =
+        ranges.trucks.isSingle() && ranges.stations.isSingle() &&
+        ranges.unloading.isSingle() && ranges.driving.isSingle() &&
+        ranges.miningMin.isSingle() && ranges.miningMax.isSingle() &&
+        ranges.sim.isSingle();
+    int numTrucks = vm.count("trucks") ? ranges.trucks.first : -1;
+    int numStations = vm.count("stations") ? ranges.stations.first : -1;
+
+    bool single = !sweep && !parallel && numReplicas == 1;
+    if (vm.count("help") ||
+        ((numTrucks < 1 || numStations < 1) && restorePath.empty()) ||
+        (!sweep && !singlePoint) || (format != "csv" && format != "json") ||
+        (eventQueue != "calendar" && eventQueue != "multimap") ||
+        (stationIndex != "heap" && stationIndex != "multiset") ||
+        (rng != "mt19937" && rng != "philox") ||
+        (tieBreak != "fifo" && tieBreak != "id") || numReplicas < 1 ||
+        numThreads < 1 || (parallel && numReplicas > 1) ||
+        (sweep && (parallel || numReplicas > 1)) ||
+        (!tracePath.empty() && !single) ||
+        ((!checkpointPath.empty() || !restorePath.empty()) && !single) ||
+        (checkpointPath.empty() != (checkpointAt < 0)) ||
+        (forkAt >= 0 && (!single || !tracePath.empty() ||
+                         !checkpointPath.empty() || !restorePath.empty())) ||
+        (forkAt < 0 && !closeStations.empty()) ||
+        (!samplesPath.empty() &&
+         (!single || !checkpointPath.empty() || forkAt >= 0)) ||
+        (antithetic && (numReplicas < 2 || numReplicas % 2 != 0)) ||
+        (vm.count("compare-stations") &&
+         (numReplicas < 2 || compareStations < 1 ||
+          !travelTimesPath.empty())) ||
+        sampleInterval < 1 || steadyStateTolerance < 0 || batchLength < 1 ||
+        (vm.count("steady-state") &&
+         ((!sweep && !single) || !checkpointPath.empty() || forkAt >= 0 ||
+          !samplesPath.empty()))) {
       std::cout << desc << std::endl;
       return 0;
     }
 
-    std::cout << "Starting simulation with numTrucks=" << numTrucks
-              << " ,numStations=" << numStations << std::endl;
+    // A restored simulation takes its counts from the checkpoint.
+    SimulationConfig config{
+        .numTrucks = std::max(numTrucks, 1),
+        .numStations = std::max(numStations, 1),
+        .seed = seed,
+        .rng = rng == "philox" ? RngKind::Philox : RngKind::Mt19937,
+        .eventQueue = eventQueue == "multimap" ? EventQueueKind::Multimap
+                                               : EventQueueKind::Calendar,
+        .stationIndex = stationIndex == "multiset" ? StationIndexKind::Multiset
+                                                   : StationIndexKind::Heap,
+        .tieBreak = tieBreak == "id" ? TieBreak::ById : TieBreak::Fifo,
+        .batchDispatch = batchDispatch,
+        .durations = {.unloading = ranges.unloading.first,
+                      .driving = ranges.driving.first,
+                      .miningMin = ranges.miningMin.first,
+                      .miningMax = ranges.miningMax.first,
+                      .sim = ranges.sim.first}};
+
+    std::optional<SteadyStateConfig> steadyState;
+    if (vm.count("steady-state")) {
+      steadyState = SteadyStateConfig{.tolerance = steadyStateTolerance,
+                                      .batchLength = batchLength};
+    }
+
+    if (!travelTimesPath.empty()) {
+      std::ifstream file{travelTimesPath};
+      if (!file) {
+        throw std::runtime_error("Cannot open " + travelTimesPath);
+      }
+      config.travelTimes = TravelTimes::parseCsv(file);
+      // Checked here since replicas construct their simulations on other
+      // threads. A sweep checks its points itself.
+      if (!sweep && config.numStations != config.travelTimes.numStations()) {
+        throw std::invalid_argument(
+            "The travel times are for " +
+            std::to_string(config.travelTimes.numStations()) + " stations");
+      }
+    }
+    if (!truckClassesPath.empty()) {
+      std::ifstream file{truckClassesPath};
+      if (!file) {
+        throw std::runtime_error("Cannot open " + truckClassesPath);
+      }
+      config.fleet = Fleet::parseCsv(file);
+    }
+
+    if (sweep) {
+      SweepRunner runner{config, ranges.grid(), numThreads, steadyState};
+      auto beg = std::chrono::system_clock::now();
+      runner.run();
+      auto end = std::chrono::system_clock::now();
+      // Progress goes to stderr so that stdout only holds the output.
+      std::cerr << "Finished " << runner.points().size()
+                << " sweep points. Real time: ["
+                << std::chrono::duration_cast<std::chrono::seconds>(end - beg)
+                       .count()
+                << " sec]" << std::endl;
+      std::ofstream file;
+      if (!output.empty()) {
+        file.open(output);
+        if (!file) {
+          throw std::runtime_error("Cannot open " + output);
+        }
+      }
+      std::ostream &os = output.empty() ? std::cout : file;
+      if (format == "json") {
+        runner.writeJson(os);
+      } else {
+        runner.writeCsv(os);
+      }
+      return 0;
+    }
+
+    if (restorePath.empty()) {
+      std::cout << "Starting simulation with numTrucks=" << numTrucks
+                << " ,numStations=" << numStations << std::endl;
+    }
+
+    ReplicaSampling sampling = antithetic ? ReplicaSampling::Antithetic
+                                          : ReplicaSampling::Independent;
+    if (antithetic) {
+      config.rng = RngKind::Philox;
+    }
+    if (vm.count("compare-stations")) {
+      config.rng = RngKind::Philox;
+      SimulationConfig alternative = config;
+      alternative.numStations = compareStations;
+      ComparisonRunner runner{config, alternative, numReplicas, numThreads,
+                              sampling};
+      auto beg = std::chrono::system_clock::now();
+      runner.run();
+      auto end = std::chrono::system_clock::now();
+      std::cout << "Finished " << numReplicas << " replicas of "
+                << numStations << " and " << compareStations
+                << " stations. Real time: ["
+                << std::chrono::duration_cast<std::chrono::seconds>(end - beg)
+                       .count()
+                << " sec]" << std::endl;
+      runner.printStats();
+      if constexpr (instrument::kEnabled) {
+        instrument::printReport(std::cout);
+      }
+      return 0;
+    }
+
+    if (numReplicas > 1) {
+      ReplicaRunner runner{config, numReplicas, numThreads, sampling};
+      auto beg = std::chrono::system_clock::now();
+      runner.run();
+      auto end = std::chrono::system_clock::now();
+      std::cout << "Finished " << numReplicas << " replicas. Real time: ["
+                << std::chrono::duration_cast<std::chrono::seconds>(end - beg)
+                       .count()
+                << " sec]" << std::endl;
+      runner.printStats();
+      if constexpr (instrument::kEnabled) {
+        instrument::printReport(std::cout);
+      }
+      return 0;
+    }
+
+    if (forkAt >= 0) {
+      std::vector<Branch> branches = {{"baseline", {}}};
+      for (StationId id : closeStations) {
+        branches.push_back({"close station " + std::to_string(id),
+                            [id](Simulation &sim) { sim.closeStation(id); }});
+      }
+      BranchRunner runner{config, forkAt, std::move(branches), numThreads};
+      auto beg = std::chrono::system_clock::now();
+      runner.run();
+      auto end = std::chrono::system_clock::now();
+      std::cout << "Finished " << runner.branches().size()
+                << " branches. Real time: ["
+                << std::chrono::duration_cast<std::chrono::seconds>(end - beg)
+                       .count()
+                << " sec]" << std::endl;
+      runner.printStats();
+      if constexpr (instrument::kEnabled) {
+        instrument::printReport(std::cout);
+      }
+      return 0;
+    }
+
+    if (parallel) {
+      config.rng = RngKind::Philox;
+      config.tieBreak = TieBreak::ById;
+      ParallelSimulation sim{config, numThreads};
+      auto beg = std::chrono::system_clock::now();
+      Minutes duration = sim.start();
+      auto end = std::chrono::system_clock::now();
+      std::cout << "Finished simulation. Simulated time: [" << duration
+                << " min]; Real time: ["
+                << std::chrono::duration_cast<std::chrono::seconds>(end - beg)
+                       .count()
+                << " sec]" << std::endl;
+      TrucksStats trucksStats;
+      for (const Truck &tr : sim.trucks()) {
+        trucksStats.absorbTruck(tr.retrieveStats());
+      }
+      trucksStats.printStats();
+      sim.stations().printStats();
+      if (stationStats) {
+        sim.stations().printStationStats(duration);
+      }
+      if constexpr (instrument::kEnabled) {
+        instrument::printReport(std::cout);
+      }
+      return 0;
+    }
 
     // Set up the simulation
-    Simulation sim{numTrucks, numStations};
+    Simulation sim{config};
+    if (!restorePath.empty()) {
+      std::ifstream file{restorePath, std::ios::binary};
+      if (!file) {
+        throw std::runtime_error("Cannot open " + restorePath);
+      }
+      sim.restoreCheckpoint(file);
+      std::cout << "Resuming simulation with numTrucks=" << sim.trucks().size()
+                << " ,numStations=" << sim.stations().size() << " from ts "
+                << sim.now() << std::endl;
+    } else {
+      sim.begin();
+    }
+    std::optional<TraceWriter> trace;
+    if (!tracePath.empty()) {
+      trace.emplace(tracePath);
+      sim.setTrace(&*trace);
+    }
+    std::ofstream samples;
+    if (!samplesPath.empty()) {
+      samples.open(samplesPath);
+      if (!samples) {
+        throw std::runtime_error("Cannot create " + samplesPath);
+      }
+    }
 
     // Run the simulation
+    std::optional<SteadyStateEstimate> estimate;
     auto beg = std::chrono::system_clock::now();
-    Minutes duration = sim.start();
+    Minutes duration;
+    if (!samplesPath.empty()) {
+      duration = Sampler{samples, sampleInterval}.run(sim);
+    } else if (steadyState) {
+      estimate = SteadyStateDetector{*steadyState}.run(sim);
+      duration = sim.now();
+    } else {
+      duration =
+          sim.resume(checkpointPath.empty() ? kEndOfTime : checkpointAt);
+    }
     auto end = std::chrono::system_clock::now();
+    if (trace) {
+      trace->flush();
+    }
+
+    if (!checkpointPath.empty()) {
+      std::ofstream file{checkpointPath, std::ios::binary};
+      if (!file) {
+        throw std::runtime_error("Cannot create " + checkpointPath);
+      }
+      sim.saveCheckpoint(file);
+      std::cout << "Saved checkpoint to " << checkpointPath
+                << ". Simulated time: [" << duration << " min]" << std::endl;
+      return 0;
+    }
 
     std::cout
         << "Finished simulation. Simulated time: [" << duration
@@ -47,7 +445,19 @@ int main(int argc, char **argv) {
     });
 
     trucksStats.printStats();
+    if (!config.fleet.empty()) {
+      config.fleet.printStats(sim.trucks());
+    }
     sim.stations().printStats();
+    if (stationStats) {
+      sim.stations().printStationStats(sim.now());
+    }
+    if (estimate) {
+      estimate->printStats();
+    }
+    if constexpr (instrument::kEnabled) {
+      instrument::printReport(std::cout);
+    }
   } catch (const std::exception &e) {
     std::cerr << e.what() << std::endl;
   }
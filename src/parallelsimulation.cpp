@@ -0,0 +1,260 @@
+#include "parallelsimulation.h"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+ParallelSimulation::ParallelSimulation(const SimulationConfig &config,
+                                       int numThreads)
+    : stations_{config.numStations, nullptr, StationIndexKind::Heap,
+                TieBreak::ById, config.durations},
+      counterRng_{config.seed, config.antithetic},
+      durations_{config.durations},
+      selectorTimerService_{EventQueueKind::Calendar, TieBreak::ById,
+                            config.durations.horizon()},
+      heap_(config.numStations) {
+  if (config.rng != RngKind::Philox || config.tieBreak != TieBreak::ById ||
+      config.eventQueue != EventQueueKind::Calendar) {
+    throw std::invalid_argument("A parallel simulation needs the philox rng, "
+                                "id tie breaking and the calendar queue");
+  }
+  if (!durations_.valid()) {
+    throw std::invalid_argument("Invalid durations");
+  }
+  // The lookahead of the selector relies on every drive taking
+  // durations.driving, and that of the workers on every truck mining for at
+  // least durations.miningMin.
+  if (!config.travelTimes.empty()) {
+    throw std::invalid_argument(
+        "A parallel simulation does not support travel times");
+  }
+  if (!config.fleet.empty()) {
+    throw std::invalid_argument(
+        "A parallel simulation does not support truck classes");
+  }
+  trucks_.reserve(config.numTrucks);
+  for (int i = 0; i < config.numTrucks; i++) {
+    trucks_.emplace_back(i, 0, 0, durations_.unloading);
+  }
+  // One thread is the selector. More workers than stations would be idle.
+  int numWorkers = std::clamp(numThreads - 1, 1, config.numStations);
+  for (int i = 0; i < numWorkers; i++) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (int i = 0; i < config.numStations; i++) {
+    Station *st = stations_.station(i);
+    st->timerService_ = &owner(i).timerService_;
+    heap_.push(i, HeapKey{st->lastUnloadEndTs_, st->id_});
+  }
+}
+
+Minutes ParallelSimulation::start() {
+  timepoint_t beginning = selectorTimerService_.now();
+  // Start by putting all trucks into Mining state
+  for (Truck &truck : trucks_) {
+    assert(truck.state() == Truck::Unloading);
+    Minutes miningDuration =
+        counterRng_.duration(RandomStream::MiningDuration, truck.id(),
+                             truck.miningCycles(), durations_.miningMin,
+                             durations_.miningMax);
+    truck.startMining(beginning, beginning + miningDuration);
+    selectorTimerService_.scheduleEvent(
+        MiningFinished{{beginning + miningDuration}, truck.id()});
+  }
+
+  // Nothing has been handled yet, see the lookahead in the header.
+  selectorClock_ = beginning + durations_.driving;
+  for (auto &worker : workers_) {
+    worker->clock_ = beginning + durations_.miningMin;
+  }
+
+  // Handle every event up to and including durations_.sim.
+  timepoint_t end = beginning + durations_.sim + 1;
+  std::vector<std::thread> threads;
+  for (auto &worker : workers_) {
+    threads.emplace_back([this, &worker, end]() { runWorker(*worker, end); });
+  }
+  runSelector(end);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  // Everything left in the channels happens after end.
+  drainMiningFinished();
+  for (auto &worker : workers_) {
+    drainArrivals(*worker);
+  }
+
+  // A sequential simulation stops after the first event past durations_.sim,
+  // which is the earliest of the first events of every thread.
+  SimulationEvent next;
+  Worker *nextOwner = nullptr;
+  bool found = selectorTimerService_.popNextEvent(kEndOfTime, next);
+  for (auto &worker : workers_) {
+    SimulationEvent evt;
+    if (worker->timerService_.popNextEvent(kEndOfTime, evt) &&
+        (!found || std::make_pair(eventTs(evt), eventTruck(evt)) <
+                       std::make_pair(eventTs(next), eventTruck(next)))) {
+      next = evt;
+      nextOwner = worker.get();
+      found = true;
+    }
+  }
+  assert(found);
+  if (MiningFinished *e = std::get_if<MiningFinished>(&next)) {
+    onMiningFinished(*e);
+    drainArrivals(owner(trucks_[e->truck_].unloadingStation()->id_));
+  } else if (ArrivedAtStation *e = std::get_if<ArrivedAtStation>(&next)) {
+    onArrivedAtStation(*nextOwner, *e);
+  } else {
+    onUnloadingFinished(*nextOwner, std::get<UnloadingFinished>(next));
+  }
+  return eventTs(next);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void ParallelSimulation::runSelector(timepoint_t end) {
+  timepoint_t handledUntil = selectorTimerService_.now();
+  while (handledUntil < end) {
+    timepoint_t safeUntil = end;
+    for (auto &worker : workers_) {
+      safeUntil =
+          std::min(safeUntil, worker->clock_.load(std::memory_order_acquire));
+    }
+    // Everything sent before the clocks that were just read is in the
+    // channels by now.
+    drainMiningFinished();
+    SimulationEvent evt;
+    while (selectorTimerService_.popNextEvent(safeUntil, evt)) {
+      onMiningFinished(std::get<MiningFinished>(evt));
+    }
+    if (safeUntil > handledUntil) {
+      handledUntil = safeUntil;
+      selectorClock_.store(handledUntil + durations_.driving,
+                           std::memory_order_release);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  // Workers may still be sending events for after end. Keep accepting them
+  // so that none of them is blocked on a full channel.
+  while (workersDone_.load(std::memory_order_acquire) <
+         static_cast<int>(workers_.size())) {
+    drainMiningFinished();
+    std::this_thread::yield();
+  }
+}
+
+void ParallelSimulation::drainMiningFinished() {
+  for (auto &worker : workers_) {
+    MiningFinished evt;
+    while (worker->miningFinished_.tryPop(evt)) {
+      selectorTimerService_.scheduleEvent(evt);
+    }
+  }
+}
+
+// Same as Stations::selectUnloadingStation, except that the station's free ts
+// is projected here, since the station itself belongs to its owner.
+void ParallelSimulation::onMiningFinished(const MiningFinished &evt) {
+  Truck &truck = trucks_[evt.truck_];
+  assert(truck.state() == Truck::Mining);
+  StationId id = heap_.top();
+  timepoint_t arrivalTs = evt.ts_ + durations_.driving;
+  timepoint_t lastUnloadEndTs =
+      std::max(heap_.topKey().first, arrivalTs) + durations_.unloading;
+  heap_.update(id, HeapKey{lastUnloadEndTs, id});
+  truck.proceedToUnloadingStation(evt.ts_, stations_.station(id),
+                                  durations_.driving);
+
+  Worker &worker = owner(id);
+  ArrivedAtStation arrival{{arrivalTs}, truck.id(), id};
+  while (!worker.arrivals_.tryPush(arrival)) {
+    // The worker may itself be blocked on sending to us.
+    drainMiningFinished();
+    std::this_thread::yield();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+void ParallelSimulation::runWorker(Worker &worker, timepoint_t end) {
+  timepoint_t handledUntil = worker.timerService_.now();
+  while (handledUntil < end) {
+    timepoint_t safeUntil =
+        std::min(end, selectorClock_.load(std::memory_order_acquire));
+    drainArrivals(worker);
+    SimulationEvent evt;
+    while (worker.timerService_.popNextEvent(safeUntil, evt)) {
+      if (ArrivedAtStation *e = std::get_if<ArrivedAtStation>(&evt)) {
+        onArrivedAtStation(worker, *e);
+      } else {
+        onUnloadingFinished(worker, std::get<UnloadingFinished>(evt));
+      }
+    }
+    if (safeUntil > handledUntil) {
+      handledUntil = safeUntil;
+      worker.clock_.store(handledUntil + durations_.miningMin,
+                          std::memory_order_release);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  workersDone_.fetch_add(1, std::memory_order_release);
+}
+
+// The selector has already dispatched the truck to the station, so the
+// station's queue of arriving trucks is updated as soon as the event comes in.
+// The arrival itself is only handled at its ts.
+void ParallelSimulation::drainArrivals(Worker &worker) {
+  ArrivedAtStation evt;
+  while (worker.arrivals_.tryPop(evt)) {
+    stations_.station(evt.station_)->addArrivingTruck(&trucks_[evt.truck_]);
+    worker.timerService_.scheduleEvent(evt);
+  }
+}
+
+// Same as Simulation::onArrivedAtStation.
+void ParallelSimulation::onArrivedAtStation(Worker &worker,
+                                            const ArrivedAtStation &evt) {
+  Truck *truck = &trucks_[evt.truck_];
+  Station *station = stations_.station(evt.station_);
+  assert(truck->state() == Truck::Driving);
+
+  // Only the owner of a station touches its StationStats.
+  stations_.recordArrival(*station, evt.ts_);
+  if (station->onTruckArrived(truck) == Truck::Unloading) {
+    truck->unloadAtStation(evt.ts_);
+    worker.timerService_.scheduleEvent(UnloadingFinished{
+        {evt.ts_ + durations_.unloading}, truck->id(), station->id_});
+  } else {
+    truck->waitAtStation(evt.ts_);
+  }
+}
+
+// Same as Simulation::onUnloadingFinished, except that the MiningFinished
+// event is sent to the selector.
+void ParallelSimulation::onUnloadingFinished(Worker &worker,
+                                             const UnloadingFinished &evt) {
+  Truck *truck = &trucks_[evt.truck_];
+  Station *station = stations_.station(evt.station_);
+  assert(station->unloadingTruck_ == truck);
+
+  Minutes miningDuration = counterRng_.duration(
+      RandomStream::MiningDuration, truck->id(), truck->miningCycles(),
+      durations_.miningMin, durations_.miningMax);
+  truck->startMining(evt.ts_, evt.ts_ + miningDuration);
+  while (!worker.miningFinished_.tryPush(
+      MiningFinished{{evt.ts_ + miningDuration}, truck->id()})) {
+    // The selector may itself be blocked on sending to us.
+    drainArrivals(worker);
+    std::this_thread::yield();
+  }
+
+  stations_.recordUnloadingFinished(*station, evt.ts_);
+  station->onUnloadingFinished(evt.ts_);
+  if (station->unloadingTruck_) {
+    worker.timerService_.scheduleEvent(
+        UnloadingFinished{{evt.ts_ + durations_.unloading},
+                          station->unloadingTruck_->id(), station->id_});
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "indexedheap.h"
+#include "simulation.h"
+#include "spscchannel.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////////
+// ParallelSimulation runs one simulation across several threads, producing
+// exactly the same results as a sequential Simulation with the same config.
+//
+// The stations are partitioned across worker threads (station s is owned by
+// worker s % numWorkers). Each worker has its own TimerServiceBase and handles
+// the ArrivedAtStation and UnloadingFinished events of its stations. The thread
+// calling start() is the selector: it has its own TimerServiceBase holding the
+// MiningFinished events and picks the station for every truck that finished
+// mining. The selector and the workers only talk through SPSC channels: the
+// selector sends the ArrivedAtStation event of every truck it dispatches to
+// the owner of the station, and workers send the MiningFinished event of every
+// truck that finished unloading to the selector. A truck is only ever
+// accessed by the thread that handles its current event.
+//
+// Synchronization is conservative and exploits the lookahead of the model:
+//   - A truck arrives durations.driving after it finished mining. So once the
+//     selector has handled all MiningFinished events before X, it will not
+//     send any ArrivedAtStation event before X + durations.driving.
+//   - A truck finishes mining at least durations.miningMin after it finished
+//     unloading. So once a worker has handled all of its events before Y, it
+//     will not send any MiningFinished event before Y + durations.miningMin.
+// Every thread publishes this promise as its clock after sending the events
+// that it covers, and a thread only handles the events that are before the
+// clocks of everyone sending to it. Hence the threads advance in windows of at
+// least min(driving, miningMin) (30 minutes by default) of simulated time
+// without ever waiting on each other within a window.
+//
+// Selecting the least loaded station needs every station's projected free
+// time, which only changes when a truck is dispatched to it, so the selector
+// keeps its own copy of it rather than reading the stations.
+//
+// Events with the same ts on different stations can then be handled in any
+// order, except that the choice of station for trucks finishing mining at the
+// same ts must not depend on the order in which they are handled. This
+// requires TieBreak::ById, under which both the events and the station
+// selection are ordered by ids rather than by the order in which things
+// happened to be scheduled. Similarly the mining durations must not depend on
+// the order in which trucks are handled, which requires RngKind::Philox.
+class ParallelSimulation {
+  static constexpr size_t kChannelCapacity = 1 << 14;
+
+  struct Worker {
+    TimerServiceBase timerService_{EventQueueKind::Calendar, TieBreak::ById};
+    // From the selector: trucks dispatched to a station of this worker.
+    SpscChannel<ArrivedAtStation> arrivals_{kChannelCapacity};
+    // To the selector: trucks that have finished unloading.
+    SpscChannel<MiningFinished> miningFinished_{kChannelCapacity};
+    // No MiningFinished event before this will be sent anymore.
+    alignas(64) std::atomic<timepoint_t> clock_;
+  };
+
+  std::vector<Truck> trucks_;
+  Stations stations_;
+  CounterRng counterRng_;
+  Durations durations_;
+  TimerServiceBase selectorTimerService_;
+  // Stations keyed by (projected free ts, station id), like Stations does
+  // with TieBreak::ById.
+  using HeapKey = std::pair<timepoint_t, uint64_t>;
+  IndexedDaryHeap<HeapKey> heap_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  // No ArrivedAtStation event before this will be sent anymore.
+  alignas(64) std::atomic<timepoint_t> selectorClock_;
+  std::atomic<int> workersDone_ = 0;
+
+  Worker &owner(StationId id) { return *workers_[id % workers_.size()]; }
+
+  // Selector side
+  void runSelector(timepoint_t end);
+  void drainMiningFinished();
+  void onMiningFinished(const MiningFinished &evt);
+
+  // Worker side
+  void runWorker(Worker &worker, timepoint_t end);
+  void drainArrivals(Worker &worker);
+  void onArrivedAtStation(Worker &worker, const ArrivedAtStation &evt);
+  void onUnloadingFinished(Worker &worker, const UnloadingFinished &evt);
+
+public:
+  // Runs a selector thread and clamp(numThreads - 1, 1, numStations)
+  // workers, i.e. numThreads threads in total unless that leaves no worker
+  // (numThreads < 2, which runs 2) or more workers than stations. Throws
+  // std::invalid_argument unless config uses RngKind::Philox,
+  // TieBreak::ById and the calendar event queue.
+  ParallelSimulation(const SimulationConfig &config, int numThreads);
+
+  // Same as Simulation::start().
+  Minutes start();
+  const Stations &stations() const { return stations_; }
+  const std::vector<Truck> &trucks() const { return trucks_; }
+};
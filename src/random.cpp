@@ -0,0 +1,12 @@
+#include "random.h"
+
+// Helper function to generate random mining durations. The generator is
+// owned by the simulation and seeded from its config, which keeps each
+// simulation deterministic and independent of any other simulation.
+Minutes randomDuration(std::mt19937 &generator, Minutes min, Minutes max) {
+  // Create a uniform integer distribution between min and max (inclusive)
+  std::uniform_int_distribution<Minutes> distribution(min, max);
+
+  // Generate and return the random number
+  return distribution(generator);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "events.h"
+#include <array>
+#include <cstdint>
+#include <random>
+
+////////////////////////////////////////////////////////////////////////////
+// Random numbers for the simulation. Two kinds of generators are supported:
+//
+// - A sequential std::mt19937 owned by the simulation. Every draw advances
+//   the one stream, so the value a truck gets depends on the order in which
+//   all trucks drew before it.
+//
+// - A counter-based generator (Philox4x32-10, see Salmon et al., "Parallel
+//   Random Numbers: As Easy as 1, 2, 3", SC11). Each value is a pure function
+//   of a key and a counter, so e.g. the k-th mining duration of truck i can be
+//   computed by anyone, at any time and in any order, and always comes out the
+//   same. This is what allows sharded or parallel execution to stay bit
+//   reproducible against a single threaded run.
+
+enum class RngKind { Mt19937, Philox };
+
+// Draws a random duration in [min, max] from the given generator.
+Minutes randomDuration(std::mt19937 &generator, Minutes min, Minutes max);
+
+// The Philox4x32-10 bijection: maps a 128 bit counter to 128 random bits
+// under a 64 bit key.
+class Philox4x32 {
+public:
+  using Counter = std::array<uint32_t, 4>;
+  using Key = std::array<uint32_t, 2>;
+
+  static Counter generate(Counter ctr, Key key) {
+    for (int round = 0; round < 10; round++) {
+      if (round > 0) {
+        key[0] += kWeyl0;
+        key[1] += kWeyl1;
+      }
+      uint64_t p0 = uint64_t{kMul0} * ctr[0];
+      uint64_t p1 = uint64_t{kMul1} * ctr[2];
+      ctr = {uint32_t(p1 >> 32) ^ ctr[1] ^ key[0], uint32_t(p1),
+             uint32_t(p0 >> 32) ^ ctr[3] ^ key[1], uint32_t(p0)};
+    }
+    return ctr;
+  }
+
+private:
+  static constexpr uint32_t kMul0 = 0xD2511F53;
+  static constexpr uint32_t kMul1 = 0xCD9E8D57;
+  static constexpr uint32_t kWeyl0 = 0x9E3779B9;
+  static constexpr uint32_t kWeyl1 = 0xBB67AE85;
+};
+
+// Separate streams of the counter-based generator, one for every kind of
+// random quantity in the simulation, so that adding a new kind of draw never
+// changes the values drawn for the existing ones.
+enum class RandomStream : uint32_t { MiningDuration = 0 };
+
+// Counter-based random durations, keyed by (seed, stream) and indexed by
+// (entity id, cycle number). An antithetic generator draws min + max - d
+// wherever the plain one with the same seed draws d. Both are uniform, and a
+// short duration in one is a long one in the other, which makes the results
+// of the two negatively correlated (see ReplicaSampling::Antithetic).
+class CounterRng {
+  uint32_t seed_;
+  bool antithetic_;
+
+public:
+  explicit CounterRng(uint32_t seed, bool antithetic = false)
+      : seed_{seed}, antithetic_{antithetic} {}
+
+  // The duration in [min, max] for the given entity and cycle. Uses Lemire's
+  // multiply-and-shift with rejection so the result is exactly uniform.
+  Minutes duration(RandomStream stream, uint32_t id, uint32_t cycle,
+                   Minutes min, Minutes max) const {
+    Minutes d = uniformDuration(stream, id, cycle, min, max);
+    return antithetic_ ? min + max - d : d;
+  }
+
+private:
+  Minutes uniformDuration(RandomStream stream, uint32_t id, uint32_t cycle,
+                          Minutes min, Minutes max) const {
+    uint32_t range = static_cast<uint32_t>(max - min) + 1;
+    uint32_t threshold = -range % range;
+    Philox4x32::Counter ctr{id, cycle, 0, 0};
+    Philox4x32::Key key{seed_, static_cast<uint32_t>(stream)};
+    while (true) {
+      for (uint32_t word : Philox4x32::generate(ctr, key)) {
+        uint64_t m = uint64_t{word} * range;
+        if (uint32_t(m) >= threshold) {
+          return min + static_cast<Minutes>(m >> 32);
+        }
+      }
+      // All 4 words rejected, which is astronomically unlikely. Move on to
+      // the next block of this (id, cycle).
+      ctr[3]++;
+    }
+  }
+};
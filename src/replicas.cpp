@@ -0,0 +1,230 @@
+#include "replicas.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+ReplicaResult summarizeSimulation(const std::vector<Truck> &trucks,
+                                  const Stations &stations) {
+  TrucksStats trucksStats;
+  for (const Truck &truck : trucks) {
+    trucksStats.absorbTruck(truck.retrieveStats());
+  }
+
+  ReplicaResult result;
+  result.truckUtilization = trucksStats.utilization();
+  for (auto st :
+       {Truck::Mining, Truck::Driving, Truck::Waiting, Truck::Unloading}) {
+    result.stateMeans[st] = trucksStats.stateStats(st).mean();
+  }
+  result.stationUtilization = stations.utilization();
+  result.waits = stations.waits();
+  return result;
+}
+
+ReplicaResult summarizeSimulation(const Simulation &sim) {
+  return summarizeSimulation(sim.trucks(), sim.stations());
+}
+
+namespace {
+
+// The mean of every metric of two results, with the waits of both.
+ReplicaResult meanOf(const ReplicaResult &lhs, const ReplicaResult &rhs) {
+  ReplicaResult mean;
+  mean.truckUtilization = (lhs.truckUtilization + rhs.truckUtilization) / 2;
+  for (size_t st = 0; st < mean.stateMeans.size(); st++) {
+    mean.stateMeans[st] = (lhs.stateMeans[st] + rhs.stateMeans[st]) / 2;
+  }
+  mean.stationUtilization =
+      (lhs.stationUtilization + rhs.stationUtilization) / 2;
+  mean.waits = lhs.waits;
+  mean.waits.merge(rhs.waits);
+  return mean;
+}
+
+EnsembleStats namedEnsembleStats() {
+  EnsembleStats stats;
+  stats.truckUtilization.name("Trucks utilization ");
+  stats.stateMeans[Truck::Mining].name("Truck Mining       ");
+  stats.stateMeans[Truck::Driving].name("Truck Driving      ");
+  stats.stateMeans[Truck::Waiting].name("Truck Waiting      ");
+  stats.stateMeans[Truck::Unloading].name("Truck Unloading    ");
+  stats.stationUtilization.name("Station utilization");
+  return stats;
+}
+
+void addObservation(EnsembleStats &stats, const ReplicaResult &result) {
+  stats.truckUtilization.addObservation(result.truckUtilization);
+  for (size_t st = 0; st < result.stateMeans.size(); st++) {
+    stats.stateMeans[st].addObservation(result.stateMeans[st]);
+  }
+  stats.stationUtilization.addObservation(result.stationUtilization);
+  stats.waits.merge(result.waits);
+}
+
+// Prints the mean of every metric but the waits along with the half width of
+// its confidence interval at the given level.
+void printMeans(const EnsembleStats &stats, double level) {
+  auto print = [level](const RunningStats &st, int precision) {
+    std::cout << std::setprecision(precision) << st.name() << "\t"
+              << st.mean() << "\t+/- " << st.confidenceHalfWidth(level)
+              << std::endl;
+  };
+  std::cout << std::fixed;
+  print(stats.truckUtilization, 4);
+  for (const RunningStats &st : stats.stateMeans) {
+    print(st, 2);
+  }
+  print(stats.stationUtilization, 4);
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////
+
+ReplicaRunner::ReplicaRunner(const SimulationConfig &config, int numReplicas,
+                             int numThreads, ReplicaSampling sampling)
+    : config_{config}, numReplicas_{numReplicas},
+      numThreads_{std::clamp(numThreads, 1, numReplicas)},
+      sampling_{sampling}, results_(numReplicas) {
+  if (sampling == ReplicaSampling::Antithetic && numReplicas % 2 != 0) {
+    throw std::invalid_argument(
+        "Antithetic replicas need an even number of replicas");
+  }
+  if (sampling == ReplicaSampling::Antithetic &&
+      config.rng != RngKind::Philox) {
+    throw std::invalid_argument("Antithetic replicas need the philox rng");
+  }
+}
+
+void ReplicaRunner::run() {
+  std::atomic<int> nextReplica = 0;
+  // A replica may throw, e.g. for an invalid config or when it runs out of
+  // memory. The exception of each replica is kept in its slot and the first
+  // one is rethrown once all threads are done.
+  std::vector<std::exception_ptr> errors(numReplicas_);
+  auto worker = [this, &nextReplica, &errors]() {
+    // Every thread reuses one simulation for all of its replicas. It is
+    // constructed for the first one, so that a throw is kept like the others.
+    std::optional<Simulation> sim;
+    for (int i = nextReplica++; i < numReplicas_; i = nextReplica++) {
+      try {
+        if (!sim) {
+          sim.emplace(config_);
+        }
+        if (sampling_ == ReplicaSampling::Antithetic) {
+          sim->reset(config_.seed + i / 2, i % 2 != 0);
+        } else {
+          sim->reset(config_.seed + i);
+        }
+        sim->start();
+        // Each replica writes to its own slot, so no locking is needed.
+        results_[i] = summarizeSimulation(*sim);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads_; t++) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (const std::exception_ptr &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+std::vector<ReplicaResult> ReplicaRunner::observations() const {
+  if (sampling_ == ReplicaSampling::Independent) {
+    return results_;
+  }
+  std::vector<ReplicaResult> pairs;
+  for (size_t i = 0; i + 1 < results_.size(); i += 2) {
+    pairs.push_back(meanOf(results_[i], results_[i + 1]));
+  }
+  return pairs;
+}
+
+EnsembleStats ReplicaRunner::aggregate() const {
+  EnsembleStats stats = namedEnsembleStats();
+  for (const ReplicaResult &result : observations()) {
+    addObservation(stats, result);
+  }
+  return stats;
+}
+
+void ReplicaRunner::printStats(double level) const {
+  EnsembleStats stats = aggregate();
+  std::cout << std::fixed;
+  std::cout << "Stats across " << numReplicas_ << " replicas";
+  if (sampling_ == ReplicaSampling::Antithetic) {
+    std::cout << " in " << numReplicas_ / 2 << " antithetic pairs";
+  }
+  std::cout << " (mean +/- " << std::setprecision(0) << level * 100
+            << "% CI):" << std::endl;
+  printMeans(stats, level);
+  std::cout << "Truck wait p50/p95/p99 across replicas:\t"
+            << stats.waits.quantile(0.5) << "\t" << stats.waits.quantile(0.95)
+            << "\t" << stats.waits.quantile(0.99) << std::endl;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+ComparisonRunner::ComparisonRunner(const SimulationConfig &baseline,
+                                   const SimulationConfig &alternative,
+                                   int numReplicas, int numThreads,
+                                   ReplicaSampling sampling)
+    : baseline_{baseline, numReplicas, numThreads, sampling},
+      alternative_{alternative, numReplicas, numThreads, sampling} {
+  if (baseline.rng != RngKind::Philox || alternative.rng != RngKind::Philox) {
+    throw std::invalid_argument(
+        "Common random numbers need the philox rng in both scenarios");
+  }
+  if (baseline.seed != alternative.seed) {
+    throw std::invalid_argument("Both scenarios need the same seed");
+  }
+}
+
+void ComparisonRunner::run() {
+  baseline_.run();
+  alternative_.run();
+}
+
+EnsembleStats ComparisonRunner::differences() const {
+  EnsembleStats stats = namedEnsembleStats();
+  std::vector<ReplicaResult> baseline = baseline_.observations();
+  std::vector<ReplicaResult> alternative = alternative_.observations();
+  for (size_t i = 0; i < baseline.size(); i++) {
+    const ReplicaResult &b = baseline[i];
+    const ReplicaResult &a = alternative[i];
+    stats.truckUtilization.addObservation(a.truckUtilization -
+                                          b.truckUtilization);
+    for (size_t st = 0; st < b.stateMeans.size(); st++) {
+      stats.stateMeans[st].addObservation(a.stateMeans[st] -
+                                          b.stateMeans[st]);
+    }
+    stats.stationUtilization.addObservation(a.stationUtilization -
+                                            b.stationUtilization);
+  }
+  return stats;
+}
+
+void ComparisonRunner::printStats(double level) const {
+  std::cout << "Baseline. ";
+  baseline_.printStats(level);
+  std::cout << "Alternative. ";
+  alternative_.printStats(level);
+  std::cout << "Paired differences, alternative - baseline (mean +/- "
+            << std::setprecision(0) << level * 100 << "% CI):" << std::endl;
+  printMeans(differences(), level);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "simulation.h"
+#include "stats.h"
+#include <array>
+#include <vector>
+
+// The results of one simulation that are aggregated across replicas.
+struct ReplicaResult {
+  double truckUtilization = 0.0;
+  // Avg time spent by a truck in each of the 4 states.
+  std::array<double, 4> stateMeans = {};
+  double stationUtilization = 0.0;
+  // The wait of every truck unloaded at any station, see Stations::waits().
+  LogHistogram waits;
+  bool operator==(const ReplicaResult &) const = default;
+};
+
+// Gathers the results of a finished simulation.
+ReplicaResult summarizeSimulation(const std::vector<Truck> &trucks,
+                                  const Stations &stations);
+ReplicaResult summarizeSimulation(const Simulation &sim);
+
+// The results of all replicas, aggregated per metric.
+struct EnsembleStats {
+  RunningStats truckUtilization;
+  std::array<RunningStats, 4> stateMeans;
+  RunningStats stationUtilization;
+  // The waits of all replicas pooled together.
+  LogHistogram waits;
+};
+
+// How the replicas of a ReplicaRunner are seeded.
+enum class ReplicaSampling {
+  // Replica i uses config.seed + i, which makes the replicas independent of
+  // each other.
+  Independent,
+  // Replicas come in antithetic pairs: replicas 2j and 2j + 1 both use
+  // config.seed + j, and the second is antithetic (see
+  // SimulationConfig::antithetic). The results of a pair are negatively
+  // correlated, so their mean varies less than that of two independent
+  // replicas. Each pair is one observation of the ensemble. Needs an even
+  // number of replicas and RngKind::Philox.
+  Antithetic
+};
+
+// Runs replicas of a simulation for Monte Carlo estimates. The replicas
+// share one config but each gets its own seed, see ReplicaSampling. They are
+// spread across a pool of threads, each thread taking the next replica that
+// has not been started yet. Since a replica's results only depend on its
+// seed, they do not depend on the number of threads.
+class ReplicaRunner {
+  SimulationConfig config_;
+  int numReplicas_;
+  int numThreads_;
+  ReplicaSampling sampling_;
+  std::vector<ReplicaResult> results_;
+
+public:
+  // Throws std::invalid_argument if the sampling is antithetic and the
+  // number of replicas is odd or config does not use RngKind::Philox.
+  ReplicaRunner(const SimulationConfig &config, int numReplicas,
+                int numThreads,
+                ReplicaSampling sampling = ReplicaSampling::Independent);
+
+  // Runs all replicas and returns once they have all finished. Rethrows the
+  // exception of the first replica that threw, if any.
+  void run();
+  // Results of every replica, indexed by replica number.
+  const std::vector<ReplicaResult> &results() const { return results_; }
+  // The independent observations of the ensemble: the results of every
+  // replica, or with antithetic sampling the mean of every pair (with the
+  // waits of both).
+  std::vector<ReplicaResult> observations() const;
+  EnsembleStats aggregate() const;
+  // Prints the mean of every metric across replicas along with the half width
+  // of its confidence interval at the given level.
+  void printStats(double level = 0.95) const;
+};
+
+// Compares two scenarios of a simulation, e.g. with 500 and 520 stations, by
+// running the same replicas (seeds and sampling) of both. Both must use
+// RngKind::Philox, so that the k-th mining duration of truck i is the same in
+// both scenarios of a replica (common random numbers). The results of the two
+// scenarios of a replica are then positively correlated, and the confidence
+// interval of their paired differences is much narrower than that of the
+// difference between two independent ensembles. It takes far fewer replicas
+// to tell whether the alternative is better.
+class ComparisonRunner {
+  ReplicaRunner baseline_;
+  ReplicaRunner alternative_;
+
+public:
+  // Throws std::invalid_argument if either config does not use
+  // RngKind::Philox, if their seeds differ or as ReplicaRunner.
+  ComparisonRunner(const SimulationConfig &baseline,
+                   const SimulationConfig &alternative, int numReplicas,
+                   int numThreads,
+                   ReplicaSampling sampling = ReplicaSampling::Independent);
+
+  // Runs all replicas of the baseline, then all of the alternative.
+  void run();
+  const ReplicaRunner &baseline() const { return baseline_; }
+  const ReplicaRunner &alternative() const { return alternative_; }
+  // Every metric of the alternative minus that of the baseline, one
+  // observation per pair of observations of the two. The waits are left
+  // empty, since the difference of two histograms is not one.
+  EnsembleStats differences() const;
+  // Prints the stats of both scenarios, followed by the mean of every paired
+  // difference along with the half width of its confidence interval.
+  void printStats(double level = 0.95) const;
+};
@@ -0,0 +1,55 @@
+#include "sampler.h"
+#include <iostream>
+#include <stdexcept>
+
+Sample takeSample(const Simulation &sim) {
+  const Stations &stations = sim.stations();
+  Sample sample;
+  sample.ts = sim.now();
+  sample.trucks[Truck::Driving] = stations.numDrivingTrucks();
+  sample.trucks[Truck::Waiting] = stations.numWaitingTrucks();
+  // Every busy station is unloading exactly one truck.
+  sample.trucks[Truck::Unloading] = stations.numBusyStations();
+  sample.trucks[Truck::Mining] =
+      sim.trucks().size() - sample.trucks[Truck::Driving] -
+      sample.trucks[Truck::Waiting] - sample.trucks[Truck::Unloading];
+  sample.busyStations = stations.numBusyStations();
+  sample.pendingEvents = sim.numPendingEvents();
+  sample.dispatchedEvents = sim.numDispatchedEvents();
+  return sample;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+Sampler::Sampler(std::ostream &os, Minutes interval)
+    : os_{os}, interval_{interval} {
+  if (interval <= 0) {
+    throw std::invalid_argument("The sample interval must be positive");
+  }
+}
+
+void Sampler::write(const Sample &sample) {
+  os_ << sample.ts << "," << sample.trucks[Truck::Mining] << ","
+      << sample.trucks[Truck::Driving] << "," << sample.trucks[Truck::Waiting]
+      << "," << sample.trucks[Truck::Unloading] << "," << sample.busyStations
+      << "," << sample.pendingEvents << "," << sample.dispatchedEvents << "\n";
+}
+
+Minutes Sampler::run(Simulation &sim) {
+  os_ << "ts,mining,driving,waiting,unloading,busy_stations,pending_events,"
+         "dispatched_events\n";
+  write(takeSample(sim));
+  timepoint_t next = (sim.now() / interval_ + 1) * interval_;
+  while (true) {
+    Minutes end = sim.resume(next);
+    // A simulation without events cannot get any further either.
+    if (sim.finished() || sim.numPendingEvents() == 0) {
+      return end;
+    }
+    Sample sample = takeSample(sim);
+    // Taken before any of the events at next.
+    sample.ts = next;
+    write(sample);
+    next += interval_;
+  }
+}
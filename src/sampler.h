@@ -0,0 +1,43 @@
+#pragma once
+
+#include "simulation.h"
+#include <array>
+#include <iosfwd>
+
+// The aggregate state of a simulation at one point in simulated time.
+struct Sample {
+  timepoint_t ts = 0;
+  // Number of trucks in each of the 4 states.
+  std::array<uint64_t, 4> trucks = {};
+  uint64_t busyStations = 0;
+  size_t pendingEvents = 0;
+  uint64_t dispatchedEvents = 0;
+  bool operator==(const Sample &) const = default;
+};
+
+// The state of sim after all events before its current time. Only reads
+// counters that are kept up to date as the simulation runs, so it costs
+// O(1) however many trucks and stations there are.
+Sample takeSample(const Simulation &sim);
+
+// Runs a simulation while recording a time series of Samples, one every
+// interval minutes of simulated time, as CSV with one row per sample. The
+// simulation is paused at every sample time (see SimulationBase::resume)
+// rather than checked after every event, so sampling adds nothing to the
+// cost of dispatching events. The simulation produces exactly the same
+// results as if it was not sampled.
+class Sampler {
+  std::ostream &os_;
+  Minutes interval_;
+
+  void write(const Sample &sample);
+
+public:
+  // Throws std::invalid_argument if interval is not positive.
+  Sampler(std::ostream &os, Minutes interval);
+
+  // Writes the header and a sample of the current state, then resumes sim
+  // until it finishes, writing a sample at every multiple of interval.
+  // Returns what SimulationBase::resume() returns.
+  Minutes run(Simulation &sim);
+};
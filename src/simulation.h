@@ -1,7 +1,13 @@
 #pragma once
 
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <span>
 
+#include "checkpoint.h"
+#include "fleet.h"
 #include "stations.h"
 #include "timerservice.h"
 #include "truck.h"
@@ -18,59 +24,430 @@
 // event logic to coordinate across both entities exists in the Simulation
 // class.
 //
-// The Simulation class uses only one thread. As a future concern - Scalability
-// can be achieved via horizontal scaling by just running multiple simulations
-// separately, each of which will model one area and the trucks/stations in that
-// area. If it is desired to let trucks visit any unloading station i.e. get
-// assigned to a station in an area that is being run in another thread, then
-// this can be modelled by message passing between threads/processes and still
-// keep each Simulation single threaded.
+// The Simulation class uses only one thread. A Simulation holds no global
+// state (including its random number generator), so independent simulations
+// can run concurrently, see replicas.h. A single simulation can also be spread
+// across threads by message passing between them, see parallelsimulation.h.
 //
 // SimulationBase is the base class. It allows the event handlers to be
 // customized in tests and thus be able to write unit tests for TimerService
 // etc.
-class SimulationBase {
+
+// The parameters of one simulation.
+struct SimulationConfig {
+  int numTrucks = 1;
+  int numStations = 1;
+  // Seeds the random mining durations. Simulations with the same config
+  // produce identical results.
+  uint32_t seed = 0;
+  // With RngKind::Philox the k-th mining duration of a truck only depends on
+  // the seed, the truck and k, see random.h.
+  RngKind rng = RngKind::Mt19937;
+  // Draw every mining duration d of the range [min, max] as min + max - d
+  // instead, see CounterRng. With RngKind::Philox, the antithetic simulation
+  // is paired draw for draw with the one of the same seed. With
+  // RngKind::Mt19937 the draws are taken from one stream in event order, so
+  // they are only paired until the event orders of the two diverge.
+  bool antithetic = false;
+  EventQueueKind eventQueue = EventQueueKind::Calendar;
+  StationIndexKind stationIndex = StationIndexKind::Heap;
+  // TieBreak::ById needs the calendar event queue and the heap station index.
+  TieBreak tieBreak = TieBreak::Fifo;
+  // Dispatch all events of a minute at once, grouped by type (see
+  // TimerService::dispatchNextBatch). Needs TieBreak::ById.
+  bool batchDispatch = false;
+  // Must be valid(), see Durations.
+  Durations durations;
+  // Drive times that depend on the truck's zone and the station, instead of
+  // durations.driving. Must be for numStations stations. Needs the heap
+  // station index, and is not supported by ParallelSimulation.
+  TravelTimes travelTimes;
+  // Classes of trucks with their own unloading and mining durations, instead
+  // of all trucks taking durations.unloading and durations.miningMin/Max.
+  // Not supported by ParallelSimulation.
+  Fleet fleet;
+};
+
+// SimulationBase is a class template over the concrete simulation (the
+// curiously recurring template pattern). It calls the event handlers of
+// Derived directly, so they are resolved at compile time and can be inlined
+// into the dispatch loop. Tests customize the handlers by deriving their own
+// simulation from SimulationBase, which lets them unit test the TimerService
+// etc.
+template <class Derived> class SimulationBase {
   friend class StationsTest_StationEta_Test;
 
 protected:
   int numTrucks_;
   int numStations_;
-  TimerService timerService_;
+  uint32_t seed_;
+  bool antithetic_;
+  Durations durations_;
+  Fleet fleet_;
+  // The classes that the trucks refer to: those of fleet_, or without a
+  // fleet the one class with the unloading and mining durations of
+  // durations_. Indexed by Truck::truckClass(), so that both cases take the
+  // same path.
+  std::vector<TruckClass> truckClasses_;
+  TimerService<Derived> timerService_;
+  bool batchDispatch_;
   Stations stations_;
-  std::list<Truck> trucks_;
+  // All trucks, indexed by TruckId. The vector is sized once at construction
+  // so Truck pointers stay valid for the lifetime of the simulation.
+  std::vector<Truck> trucks_;
+  RngKind rngKind_;
+  std::mt19937 generator_;
+  CounterRng counterRng_;
+  // Only kept to check that a checkpoint is restored into a simulation of the
+  // same kind.
+  EventQueueKind eventQueueKind_;
+  StationIndexKind stationIndexKind_;
+  TieBreak tieBreak_;
+  // When the current run began, and whether it has gone past durations_.sim,
+  // see begin() and resume().
+  timepoint_t beginning_ = 0;
+  bool finished_ = false;
+
+  Derived &derived() { return static_cast<Derived &>(*this); }
+
+  // Constructs numTrucks_ trucks, each of its class of the fleet and in its
+  // zone of the travel times.
+  void createTrucks() {
+    if (fleet_.empty()) {
+      truckClasses_.assign({TruckClass{.unloading = durations_.unloading,
+                                       .miningMin = durations_.miningMin,
+                                       .miningMax = durations_.miningMax}});
+    } else {
+      truckClasses_ = fleet_.classes();
+    }
+    const TravelTimes &travel = stations_.travelTimes();
+    trucks_.reserve(numTrucks_);
+    for (int i = 0; i < numTrucks_; i++) {
+      int truckClass = fleet_.empty() ? 0 : fleet_.classOf(i);
+      trucks_.emplace_back(i, travel.empty() ? 0 : travel.zoneOf(i),
+                           truckClass, truckClasses_[truckClass].unloading);
+    }
+  }
+
+  // The duration of the mining cycle that the truck is about to start.
+  Minutes randomMiningDuration(const Truck &truck) {
+    const TruckClass &c = truckClasses_[truck.truckClass()];
+    if (rngKind_ == RngKind::Philox) {
+      return counterRng_.duration(RandomStream::MiningDuration, truck.id(),
+                                  truck.miningCycles(), c.miningMin,
+                                  c.miningMax);
+    }
+    Minutes d = randomDuration(generator_, c.miningMin, c.miningMax);
+    return antithetic_ ? c.miningMin + c.miningMax - d : d;
+  }
 
 public:
-  SimulationBase(int numTrucks, int numStations);
+  SimulationBase(const SimulationConfig &config);
 
-  // Start the simulation. This will run for 72 hours (in simulated time)
-  // and return the timepoint at which the simulation stopped. This timepoint
-  // is the first event that happened at a time > 72 hours.
+  // Start the simulation. This will run for durations.sim (72 hours by
+  // default) in simulated time and return the timepoint at which the
+  // simulation stopped. This timepoint is the first event that happened after
+  // that. Same as begin() followed by resume().
   Minutes start();
+  // Puts all trucks into Mining at the current time, without dispatching any
+  // events yet.
+  void begin();
+  // Dispatches events until the simulation has run for durations.sim, like
+  // start(), or until the next event would happen at or after pauseTs.
+  // Returns the current time. A paused simulation can be checkpointed and
+  // resumed again later, or in another process.
+  Minutes resume(timepoint_t pauseTs = kEndOfTime);
+  // Whether the simulation has gone past durations.sim.
+  bool finished() const { return finished_; }
+
+  // Writes the whole state of the simulation to a checkpoint: its config,
+  // the pending events, the trucks, the stations and the random number
+  // generator. A simulation that restores it continues exactly as this one
+  // would, so a run that is paused, checkpointed, restored and resumed
+  // produces the same results as an uninterrupted one. Throws
+  // std::runtime_error if os cannot be written.
+  void saveCheckpoint(std::ostream &os) const;
+  // Replaces the state of this simulation by that of a checkpoint, taking on
+  // its number of trucks and stations, seed (and whether it is antithetic)
+  // and durations. The rng, event queue, station index and tie breaking must
+  // match this simulation's. Throws std::runtime_error if the checkpoint is
+  // truncated, corrupt or of an incompatible simulation, in which case this
+  // simulation must be reset before it is used again.
+  void restoreCheckpoint(std::istream &is);
+
+  // Prepares for another run from the beginning as if newly constructed with
+  // the given seed. The trucks, stations, and the memory of the event queue
+  // and the station index are reused rather than reallocated. The first form
+  // keeps whether the simulation is antithetic.
+  void reset(uint32_t seed);
+  void reset(uint32_t seed, bool antithetic);
+  // Same as reset() with the current seed, but also changes the number of
+  // trucks and stations, and optionally the durations. Storage is only
+  // reallocated if it needs to grow. Throws std::invalid_argument if the
+  // durations are not valid.
+  void reconfigure(int numTrucks, int numStations);
+  void reconfigure(int numTrucks, int numStations, const Durations &durations);
+
+  // Takes a station out of service from now on, see Stations::close.
+  void closeStation(StationId id) { stations_.close(id); }
+
   const Stations& stations() const { return stations_; }
-  const std::list<Truck>& trucks() const { return trucks_; }
-
-  // Event handlers for various events. This handlers are called
-  // from the TimerService.
-  virtual void onUnloadingFinished(timepoint_t now, Truck *truck,
-                                   Station *station) = 0;
-  virtual void onMiningFinished(timepoint_t now, Truck *truck) = 0;
-  virtual void onArrivedAtStation(timepoint_t now, Truck *truck,
-                                  Station *station) = 0;
+  const std::vector<Truck>& trucks() const { return trucks_; }
+  Truck *truck(TruckId id) { return &trucks_[id]; }
+  Station *station(StationId id) { return stations_.station(id); }
+  timepoint_t now() const { return timerService_.now(); }
+  uint64_t numDispatchedEvents() const {
+    return timerService_.numDispatchedEvents();
+  }
+  size_t numPendingEvents() const { return timerService_.numPendingEvents(); }
+  // Records every event to trace as it happens, see TimerServiceBase.
+  void setTrace(TraceWriter *trace) { timerService_.setTrace(trace); }
+
+  // Derived provides the event handlers for the various events, which are
+  // called from the TimerService:
+  //   void onUnloadingFinished(timepoint_t now, Truck *truck, Station *station);
+  //   void onMiningFinished(timepoint_t now, Truck *truck);
+  //   void onArrivedAtStation(timepoint_t now, Truck *truck, Station *station);
+
+  // Batch handlers, called from TimerService::dispatchNextBatch with all
+  // events of one type that happen at now. They call the handlers above for
+  // each event in a tight loop.
+  void onUnloadingFinishedBatch(timepoint_t now,
+                                std::span<const UnloadingFinished> evts) {
+    for (const UnloadingFinished &e : evts) {
+      derived().onUnloadingFinished(now, truck(e.truck_), station(e.station_));
+    }
+  }
+  void onMiningFinishedBatch(timepoint_t now,
+                             std::span<const MiningFinished> evts) {
+    for (const MiningFinished &e : evts) {
+      derived().onMiningFinished(now, truck(e.truck_));
+    }
+  }
+  void onArrivedAtStationBatch(timepoint_t now,
+                               std::span<const ArrivedAtStation> evts) {
+    for (const ArrivedAtStation &e : evts) {
+      derived().onArrivedAtStation(now, truck(e.truck_), station(e.station_));
+    }
+  }
+};
+
+template <class Derived>
+SimulationBase<Derived>::SimulationBase(const SimulationConfig &config)
+    : numTrucks_{config.numTrucks}, numStations_{config.numStations},
+      seed_{config.seed}, antithetic_{config.antithetic},
+      durations_{config.durations}, fleet_{config.fleet},
+      // Only the address of the Derived object is taken here. Its handlers are
+      // not called until start().
+      timerService_{static_cast<Derived *>(this), config.eventQueue,
+                    config.tieBreak,
+                    std::max({config.durations.horizon(),
+                              config.travelTimes.longest(),
+                              config.fleet.horizon()})},
+      batchDispatch_{config.batchDispatch},
+      stations_{config.numStations, &timerService_, config.stationIndex,
+                config.tieBreak, config.durations, config.travelTimes},
+      rngKind_{config.rng}, generator_{config.seed},
+      counterRng_{config.seed, config.antithetic},
+      eventQueueKind_{config.eventQueue},
+      stationIndexKind_{config.stationIndex}, tieBreak_{config.tieBreak} {
+  if (batchDispatch_ && config.tieBreak != TieBreak::ById) {
+    throw std::invalid_argument("Batch dispatch needs id tie breaking");
+  }
+  if (!durations_.valid()) {
+    throw std::invalid_argument("Invalid durations");
+  }
+  createTrucks();
+}
+
+template <class Derived> void SimulationBase<Derived>::reset(uint32_t seed) {
+  reset(seed, antithetic_);
+}
+
+template <class Derived>
+void SimulationBase<Derived>::reset(uint32_t seed, bool antithetic) {
+  seed_ = seed;
+  antithetic_ = antithetic;
+  timerService_.reset();
+  stations_.reset(numStations_, durations_);
+  // Clearing keeps the capacity, and constructing the trucks in place is
+  // cheaper than assigning over the old ones.
+  trucks_.clear();
+  createTrucks();
+  generator_.seed(seed);
+  counterRng_ = CounterRng{seed, antithetic};
+  beginning_ = 0;
+  finished_ = false;
+}
+
+template <class Derived>
+void SimulationBase<Derived>::reconfigure(int numTrucks, int numStations) {
+  reconfigure(numTrucks, numStations, durations_);
+}
+
+// A calendar queue sized for the old durations stays correct for longer ones,
+// as it parks events beyond its horizon in its overflow map.
+template <class Derived>
+void SimulationBase<Derived>::reconfigure(int numTrucks, int numStations,
+                                          const Durations &durations) {
+  if (!durations.valid()) {
+    throw std::invalid_argument("Invalid durations");
+  }
+  numTrucks_ = numTrucks;
+  numStations_ = numStations;
+  durations_ = durations;
+  reset(seed_);
+}
+
+template <class Derived> Minutes SimulationBase<Derived>::start() {
+  begin();
+  return resume();
+}
+
+template <class Derived> void SimulationBase<Derived>::begin() {
+  beginning_ = timerService_.now();
+  finished_ = false;
+  // Start by putting all trucks into Mining state
+  for (Truck &truck : trucks_) {
+    assert(truck.state() == Truck::Unloading);
+    Minutes miningDuration = randomMiningDuration(truck);
+    truck.startMining(beginning_, beginning_ + miningDuration);
+    timerService_.scheduleEvent(
+        MiningFinished{{beginning_ + miningDuration}, truck.id()});
+  }
+}
+
+template <class Derived>
+Minutes SimulationBase<Derived>::resume(timepoint_t pauseTs) {
+  if (finished_) {
+    return timerService_.now();
+  }
+  // Keep dispatching events. The timeService will call event handlers
+  // which will internally enqueue further events. See TimerService for
+  // more details
+  if (batchDispatch_) {
+    // Everything up to and including durations_.sim goes in batches, which
+    // leaves the one event past it to the loop below.
+    while (timerService_.dispatchNextBatch(
+        std::min(pauseTs, beginning_ + durations_.sim + 1))) {
+    }
+  }
+  while (timerService_.dispatchNextEvent(pauseTs)) {
+    // Each time an event happens, the timerService's time is updated
+    // to the ts of that event.
+    if (timerService_.now() - beginning_ > durations_.sim) {
+      finished_ = true;
+      break;
+    }
+  }
+
+  return timerService_.now();
+}
+
+// The layout of a checkpoint. Bump kVersion whenever it changes.
+struct CheckpointHeader {
+  static constexpr char kMagic[8] = {'M', 'S', 'C', 'H', 'E', 'C', 'K', 0};
+  static constexpr uint32_t kVersion = 6;
 };
 
+template <class Derived>
+void SimulationBase<Derived>::saveCheckpoint(std::ostream &os) const {
+  CheckpointWriter out{os};
+  out.write(CheckpointHeader::kMagic);
+  out.write(CheckpointHeader::kVersion);
+  out.write(numTrucks_);
+  out.write(numStations_);
+  out.write(seed_);
+  out.write(antithetic_);
+  out.write(durations_);
+  out.write(rngKind_);
+  out.write(eventQueueKind_);
+  out.write(stationIndexKind_);
+  out.write(tieBreak_);
+  out.write(batchDispatch_);
+  const TravelTimes &travel = stations_.travelTimes();
+  out.write(travel.numZones());
+  out.writeVector(travel.minutes());
+  out.writeVector(fleet_.classes());
+  out.write(beginning_);
+  out.write(finished_);
+
+  timerService_.checkpoint(out);
+  for (const Truck &truck : trucks_) {
+    truck.checkpoint(out);
+  }
+  stations_.checkpoint(out);
+  // The text form is the only portable way to save the state of a standard
+  // engine. counterRng_ has no state besides the seed.
+  std::ostringstream generator;
+  generator << generator_;
+  out.writeString(generator.str());
+  out.finish();
+}
+
+template <class Derived>
+void SimulationBase<Derived>::restoreCheckpoint(std::istream &is) {
+  CheckpointReader in{is};
+  auto magic = in.read<std::array<char, 8>>();
+  if (!std::equal(magic.begin(), magic.end(),
+                  std::begin(CheckpointHeader::kMagic)) ||
+      in.read<uint32_t>() != CheckpointHeader::kVersion) {
+    throw std::runtime_error("Not a checkpoint or an incompatible one");
+  }
+  int numTrucks = in.read<int>();
+  int numStations = in.read<int>();
+  uint32_t seed = in.read<uint32_t>();
+  bool antithetic = in.read<bool>();
+  Durations durations = in.read<Durations>();
+  if (numTrucks < 0 || numStations <= 0 || !durations.valid()) {
+    throw std::runtime_error("Corrupt checkpoint");
+  }
+  if (in.read<RngKind>() != rngKind_ ||
+      in.read<EventQueueKind>() != eventQueueKind_ ||
+      in.read<StationIndexKind>() != stationIndexKind_ ||
+      in.read<TieBreak>() != tieBreak_ ||
+      in.read<bool>() != batchDispatch_) {
+    throw std::runtime_error("Checkpoint of an incompatible simulation");
+  }
+  // Travel times and truck classes are part of the site rather than of the
+  // state, so they must be the same as this simulation's.
+  const TravelTimes &travel = stations_.travelTimes();
+  if (in.read<int>() != travel.numZones() ||
+      in.readVector<Minutes>(travel.minutes().size()) != travel.minutes() ||
+      in.readVector<TruckClass>(fleet_.classes().size()) !=
+          fleet_.classes()) {
+    throw std::runtime_error("Checkpoint of an incompatible simulation");
+  }
+  // Starts over from a fresh state with the right number of trucks and
+  // stations, which the rest of the checkpoint is read into.
+  seed_ = seed;
+  antithetic_ = antithetic;
+  reconfigure(numTrucks, numStations, durations);
+  beginning_ = in.read<timepoint_t>();
+  finished_ = in.read<bool>();
+
+  timerService_.restore(in, trucks_.size(), stations_.size());
+  for (Truck &truck : trucks_) {
+    truck.restore(in, stations_);
+  }
+  stations_.restore(in, trucks_);
+  std::istringstream generator{in.readString()};
+  generator >> generator_;
+  if (!generator) {
+    throw std::runtime_error("Corrupt checkpoint");
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // The concrete Simulation class.
-class Simulation : public SimulationBase {
+class Simulation : public SimulationBase<Simulation> {
   friend class StationsTest_StationEta_Test;
 
 public:
-  Simulation(int numTrucks, int numStations)
-      : SimulationBase{numTrucks, numStations} {}
-  void onUnloadingFinished(timepoint_t now, Truck *truck,
-                           Station *station) override;
-  void onMiningFinished(timepoint_t now, Truck *truck) override;
-  void onArrivedAtStation(timepoint_t now, Truck *truck,
-                          Station *station) override;
+  Simulation(const SimulationConfig &config) : SimulationBase{config} {}
+  void onUnloadingFinished(timepoint_t now, Truck *truck, Station *station);
+  void onMiningFinished(timepoint_t now, Truck *truck);
+  void onArrivedAtStation(timepoint_t now, Truck *truck, Station *station);
 
   // Helper method to do something for each truck
   template <class Func> void forEachTruck(Func &&func) {
@@ -78,4 +455,9 @@ public:
       func(&truck);
     }
   }
-};
\ No newline at end of file
+};
+
+// The dispatch loop of Simulation is instantiated in simulation.cpp, next to
+// the handlers that it inlines.
+extern template class SimulationBase<Simulation>;
+extern template class TimerService<Simulation>;
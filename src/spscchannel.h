@@ -0,0 +1,52 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <vector>
+
+// A bounded, lock-free channel from exactly one producer thread to exactly one
+// consumer thread. Values are held in a ring whose size is a power of two. The
+// head and tail indices only ever increase and are each written by one side
+// only, so pushing and popping need no atomic read-modify-write. They are kept
+// on separate cache lines so that the two sides do not contend on the same
+// line for every message.
+//
+// A push happens-before the pop that returns the pushed value, so anything the
+// producer wrote before pushing is visible to the consumer after popping.
+template <class T> class SpscChannel {
+  std::vector<T> slots_;
+  size_t mask_;
+  // Index of the next value to pop. Only written by the consumer.
+  alignas(64) std::atomic<size_t> head_{0};
+  // Index of the next value to push. Only written by the producer.
+  alignas(64) std::atomic<size_t> tail_{0};
+
+public:
+  // capacity is rounded up to a power of two.
+  explicit SpscChannel(size_t capacity)
+      : slots_(std::bit_ceil(std::max<size_t>(capacity, 1))),
+        mask_{slots_.size() - 1} {}
+
+  // Returns false, without blocking, if the channel is full.
+  bool tryPush(const T &value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+    slots_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false, without blocking, if the channel is empty.
+  bool tryPop(T &value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+};
@@ -1,106 +1,646 @@
 #include "stations.h"
+#include "checkpoint.h"
 #include "simulation.h"
 #include "timerservice.h"
+#include <bit>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <string>
 
 // Calculates the ts at which this station will become free.
-timepoint_t Station::freeTs() const {
+timepoint_t Station::recomputeFreeTs() const {
   timepoint_t ts = timerService_->now();
   if (unloadingTruck_) {
     ts = unloadingTruck_->stateExitTs();
   }
-  if (!waitingTrucks_.empty()) {
-    ts += waitingTrucks_.size() * kUnloadingDuration;
+  Minutes waitingUnloading = 0;
+  for (Truck *t : waitingTrucks_) {
+    waitingUnloading += t->unloadingDuration();
   }
+  assert(waitingUnloading == waitingUnloading_);
+  ts += waitingUnloading;
   for (Truck *t : arrivingTrucks_) {
     assert(t->state() == Truck::Driving);
     if (t->stateExitTs() <= ts) {
       // Truck will wait in waitingTrucks_, eta is additive on top of waiting
       // time
-      ts += kUnloadingDuration;
+      ts += t->unloadingDuration();
     } else {
       // Truck will proceed to unloading immediately on arrival
-      ts = t->stateExitTs() + kUnloadingDuration;
+      ts = t->stateExitTs() + t->unloadingDuration();
     }
   }
 
   return ts;
 }
 
+// The only event that changes when a station becomes free is a truck being
+// dispatched to it. That truck will start unloading once it has arrived and
+// every truck ahead of it has been unloaded, whichever is later. The other
+// events only move trucks between the arriving/waiting/unloading stages
+// without changing when the last of them is done:
+//   - A truck arriving at an idle station starts unloading right away, exactly
+//     as was projected for it.
+//   - A truck arriving at a busy station is queued behind trucks that were
+//     already projected to finish no earlier than its arrival.
+//   - When unloading finishes, the next waiting truck starts unloading at the
+//     ts it was projected to, or the station becomes idle at
+//     lastUnloadEndTs_ == now.
+// Once the station is idle lastUnloadEndTs_ lies in the past and freeTs()
+// is simply now.
+//
+// With TravelTimes a truck from a nearby zone can overtake trucks from
+// further away that were dispatched before it. The station unloads trucks in
+// the order in which they arrive, so the truck is queued ahead of those it
+// overtakes, and the projection is redone by walking the arriving trucks.
+void Station::addArrivingTruck(Truck *truck) {
+  assert(truck->state() == Truck::Driving);
+  if (arrivingTrucks_.empty() ||
+      arrivingTrucks_.back()->stateExitTs() <= truck->stateExitTs()) {
+    lastUnloadEndTs_ =
+        std::max(freeTs(), truck->stateExitTs()) + truck->unloadingDuration();
+    arrivingTrucks_.push_back(truck);
+  } else {
+    arrivingTrucks_.insertByExitTs(truck);
+    lastUnloadEndTs_ = recomputeFreeTs();
+  }
+  assert(freeTs() == recomputeFreeTs());
+}
+
+void Station::reset(const Durations &durations) {
+  assert(!sHook_.is_linked());
+  drivingDuration_ = durations.driving;
+  waitingUnloading_ = 0;
+  unloadingTruck_ = nullptr;
+  waitingTrucks_.clear();
+  arrivingTrucks_.clear();
+  idleDuration_ = 0;
+  busyDuration_ = 0;
+  phaseStartTs_ = 0;
+  lastUnloadEndTs_ = 0;
+  closed_ = false;
+}
+
+namespace {
+
+constexpr TruckId kNoTruck = ~TruckId{0};
+
+void checkpointQueue(CheckpointWriter &out, const TruckQueue &queue) {
+  out.write<uint64_t>(queue.size());
+  for (Truck *truck : queue) {
+    out.write(truck->id());
+  }
+}
+
+Truck *readTruck(CheckpointReader &in, std::vector<Truck> &trucks) {
+  TruckId id = in.read<TruckId>();
+  if (id == kNoTruck) {
+    return nullptr;
+  }
+  if (id >= trucks.size()) {
+    throw std::runtime_error("Corrupt checkpoint");
+  }
+  return &trucks[id];
+}
+
+void restoreQueue(CheckpointReader &in, TruckQueue &queue,
+                  std::vector<Truck> &trucks) {
+  queue.clear();
+  uint64_t size = in.read<uint64_t>();
+  if (size > trucks.size()) {
+    throw std::runtime_error("Corrupt checkpoint");
+  }
+  for (uint64_t i = 0; i < size; i++) {
+    Truck *truck = readTruck(in, trucks);
+    if (!truck) {
+      throw std::runtime_error("Corrupt checkpoint");
+    }
+    queue.push_back(truck);
+  }
+}
+
+} // namespace
+
+void Station::checkpoint(CheckpointWriter &out) const {
+  out.write(drivingDuration_);
+  out.write(unloadingTruck_ ? unloadingTruck_->id() : kNoTruck);
+  checkpointQueue(out, waitingTrucks_);
+  checkpointQueue(out, arrivingTrucks_);
+  out.write(idleDuration_);
+  out.write(busyDuration_);
+  out.write(phaseStartTs_);
+  out.write(lastUnloadEndTs_);
+  out.write(closed_);
+}
+
+void Station::restore(CheckpointReader &in, std::vector<Truck> &trucks) {
+  assert(!sHook_.is_linked());
+  drivingDuration_ = in.read<Minutes>();
+  unloadingTruck_ = readTruck(in, trucks);
+  restoreQueue(in, waitingTrucks_, trucks);
+  waitingUnloading_ = 0;
+  for (Truck *truck : waitingTrucks_) {
+    waitingUnloading_ += truck->unloadingDuration();
+  }
+  restoreQueue(in, arrivingTrucks_, trucks);
+  idleDuration_ = in.read<Minutes>();
+  busyDuration_ = in.read<Minutes>();
+  phaseStartTs_ = in.read<timepoint_t>();
+  lastUnloadEndTs_ = in.read<timepoint_t>();
+  closed_ = in.read<bool>();
+}
+
+Truck::State Station::onTruckArrived(Truck *truck) {
+  assert(!arrivingTrucks_.empty());
+  assert(arrivingTrucks_.front()->stateExitTs() == truck->stateExitTs());
+  // Trucks that arrive at the same ts may be dispatched in another order than
+  // the one they were queued in, e.g. by truck id.
+  arrivingTrucks_.remove(truck);
+  if (!unloadingTruck_) {
+    unloadingTruck_ = truck;
+    // Station was previously idle and is now busy
+    idleDuration_ += (timerService_->now() - phaseStartTs_);
+    phaseStartTs_ = timerService_->now();
+    return Truck::Unloading;
+  }
+  waitingTrucks_.push_back(truck);
+  waitingUnloading_ += truck->unloadingDuration();
+  return Truck::Waiting;
+}
+
+void Station::onUnloadingFinished(timepoint_t now) {
+  unloadingTruck_ = nullptr;
+  // If we have waitingTrucks, start unloading the earliest one
+  if (!waitingTrucks_.empty()) {
+    Truck *truck = waitingTrucks_.front();
+    waitingTrucks_.pop_front();
+    waitingUnloading_ -= truck->unloadingDuration();
+    truck->unloadAtStation(now);
+    unloadingTruck_ = truck;
+  }
+  assert(freeTs() == recomputeFreeTs());
+
+  // Station was previously busy and is now idle
+  busyDuration_ += (now - phaseStartTs_);
+  phaseStartTs_ = now;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
-Stations::Stations(int numStations, TimerService *timerSvc) {
-  for (int i = 0; i < numStations; i++) {
-    stationHolder_.push_back(Station{i, timerSvc});
+Stations::Stations(int numStations, TimerServiceBase *timerSvc,
+                   StationIndexKind indexKind, TieBreak tieBreak,
+                   const Durations &durations, const TravelTimes &travel)
+    : timerService_{timerSvc}, travel_{travel}, indexKind_{indexKind},
+      tieBreak_{tieBreak} {
+  if (indexKind == StationIndexKind::Multiset && tieBreak != TieBreak::Fifo) {
+    throw std::invalid_argument(
+        "The multiset station index only supports FIFO tie breaking");
+  }
+  if (indexKind == StationIndexKind::Multiset && !travel.empty()) {
+    throw std::invalid_argument(
+        "Travel times need the heap station index");
+  }
+  buildDriveClasses();
+  reset(numStations, durations);
+}
+
+void Stations::clearIndex() {
+  stations_.clear();
+  heap_.clear();
+  for (DriveClass &dc : driveClasses_) {
+    dc.heap_.clear();
+  }
+}
+
+// Sorting the stations by drive time puts every class into one run. Drive
+// times are whole minutes, so a zone has at most as many classes as the
+// longest drive takes minutes, however many stations there are.
+//
+// Every attach updates a heap in each zone, i.e. costs O(numZones *
+// log numStations), while scanning the stations costs O(numStations) per
+// selection only. So the classes are only built if that is not more than a
+// scan, and selectByScan is used otherwise.
+void Stations::buildDriveClasses() {
+  driveClasses_.clear();
+  zoneClasses_.assign(1, 0);
+  driveSlots_.clear();
+  if (travel_.empty()) {
+    return;
+  }
+  int numZones = travel_.numZones();
+  int numStations = travel_.numStations();
+  if (static_cast<uint64_t>(numZones) *
+          std::bit_width(static_cast<unsigned>(numStations)) >
+      static_cast<uint64_t>(numStations)) {
+    return;
+  }
+  driveSlots_.resize(static_cast<size_t>(numStations) * numZones);
+  std::vector<StationId> order(numStations);
+  for (int z = 0; z < numZones; z++) {
+    for (int i = 0; i < numStations; i++) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [this, z](StationId lhs, StationId rhs) {
+                       return travel_.at(z, lhs) < travel_.at(z, rhs);
+                     });
+    for (StationId id : order) {
+      Minutes driving = travel_.at(z, id);
+      if (driveClasses_.size() == zoneClasses_.back() ||
+          driveClasses_.back().driving_ != driving) {
+        driveClasses_.emplace_back().driving_ = driving;
+      }
+      DriveClass &dc = driveClasses_.back();
+      driveSlots_[static_cast<size_t>(id) * numZones + z] = {
+          static_cast<uint32_t>(driveClasses_.size() - 1),
+          static_cast<uint32_t>(dc.stations_.size())};
+      dc.stations_.push_back(id);
+    }
+    zoneClasses_.push_back(driveClasses_.size());
+  }
+  for (DriveClass &dc : driveClasses_) {
+    dc.heap_.reserve(dc.stations_.size());
+  }
+}
+
+void Stations::reset(int numStations, const Durations &durations) {
+  if (!travel_.empty() && numStations != travel_.numStations()) {
+    throw std::invalid_argument(
+        "The travel times are for " + std::to_string(travel_.numStations()) +
+        " stations");
+  }
+  clearIndex();
+  heap_.reserve(numStations);
+  updateSeq_ = 0;
+
+  if (stationHolder_.size() > static_cast<size_t>(numStations)) {
+    stationHolder_.erase(stationHolder_.begin() + numStations,
+                         stationHolder_.end());
   }
   for (Station &st : stationHolder_) {
+    st.reset(durations);
+  }
+  stationHolder_.reserve(numStations);
+  for (int i = stationHolder_.size(); i < numStations; i++) {
+    stationHolder_.emplace_back(i, timerService_, durations);
+  }
+  stats_.resize(numStations);
+  for (StationStats &stats : stats_) {
+    stats.waits_.clear();
+    stats.queueLengths_.clear();
+    stats.queueChangeTs_ = 0;
+  }
+  for (Station &st : stationHolder_) {
+    attach(st);
+  }
+  numDrivingTrucks_ = 0;
+  numWaitingTrucks_ = 0;
+  numBusyStations_ = 0;
+}
+
+void Stations::close(StationId id) {
+  if (id >= stationHolder_.size()) {
+    throw std::invalid_argument("No such station: " + std::to_string(id));
+  }
+  Station &st = stationHolder_[id];
+  if (st.closed_) {
+    return;
+  }
+  size_t numOpen = std::count_if(
+      stationHolder_.begin(), stationHolder_.end(),
+      [](const Station &other) { return !other.closed_; });
+  if (numOpen == 1) {
+    throw std::invalid_argument("Cannot close the last open station");
+  }
+  detach(st);
+  if (indexKind_ == StationIndexKind::Heap) {
+    heap_.erase(id);
+  }
+  if (!driveClasses_.empty()) {
+    int numZones = travel_.numZones();
+    for (int z = 0; z < numZones; z++) {
+      DriveSlot slot = driveSlots_[static_cast<size_t>(id) * numZones + z];
+      driveClasses_[slot.class_].heap_.erase(slot.item_);
+    }
+  }
+  st.closed_ = true;
+}
+
+// Stations with the same load are ordered by their sequence numbers in the
+// heap, and by the order in which they were inserted in the multiset. So the
+// former are written as is and the latter are reinserted in their order.
+// Closed stations are in neither.
+void Stations::checkpoint(CheckpointWriter &out) const {
+  for (const Station &st : stationHolder_) {
+    st.checkpoint(out);
+  }
+  out.write(updateSeq_);
+  if (indexKind_ == StationIndexKind::Multiset) {
+    out.write<uint64_t>(stations_.size());
+    for (const Station &st : stations_) {
+      out.write(st.id_);
+    }
+  } else {
+    for (const Station &st : stationHolder_) {
+      out.write(st.closed_ ? 0 : heap_.key(st.id_).second);
+    }
+  }
+  for (const StationStats &stats : stats_) {
+    out.writeVector(stats.waits_.counts());
+    out.writeVector(stats.queueLengths_.counts());
+    out.write(stats.queueChangeTs_);
+  }
+}
+
+void Stations::restore(CheckpointReader &in, std::vector<Truck> &trucks) {
+  clearIndex();
+  for (Station &st : stationHolder_) {
+    st.restore(in, trucks);
+  }
+  updateSeq_ = in.read<uint64_t>();
+  if (indexKind_ == StationIndexKind::Multiset) {
+    uint64_t numOpen = in.read<uint64_t>();
+    if (numOpen > stationHolder_.size()) {
+      throw std::runtime_error("Corrupt checkpoint");
+    }
+    for (uint64_t i = 0; i < numOpen; i++) {
+      StationId id = in.read<StationId>();
+      if (id >= stationHolder_.size() || stationHolder_[id].closed_ ||
+          stationHolder_[id].sHook_.is_linked()) {
+        throw std::runtime_error("Corrupt checkpoint");
+      }
+      stations_.insert(stationHolder_[id]);
+    }
+  } else {
+    for (Station &st : stationHolder_) {
+      uint64_t seq = in.read<uint64_t>();
+      if (!st.closed_) {
+        heap_.push(st.id_, HeapKey{st.lastUnloadEndTs_, seq});
+        if (!driveClasses_.empty()) {
+          updateDriveClasses(st.id_, HeapKey{st.lastUnloadEndTs_, seq});
+        }
+      }
+    }
+  }
+  numDrivingTrucks_ = 0;
+  numWaitingTrucks_ = 0;
+  numBusyStations_ = 0;
+  for (const Station &st : stationHolder_) {
+    numDrivingTrucks_ += st.arrivingTrucks_.size();
+    numWaitingTrucks_ += st.waitingTrucks_.size();
+    numBusyStations_ += st.unloadingTruck_ ? 1 : 0;
+  }
+  // Bounded by the bucket of the largest 64 bit value.
+  size_t maxBuckets =
+      LogHistogram::bucketOf(std::numeric_limits<uint64_t>::max()) + 1;
+  for (StationStats &stats : stats_) {
+    stats.waits_ = LogHistogram{in.readVector<uint64_t>(maxBuckets)};
+    stats.queueLengths_ = LogHistogram{in.readVector<uint64_t>(maxBuckets)};
+    stats.queueChangeTs_ = in.read<timepoint_t>();
+  }
+}
+
+void Stations::detach(Station &st) {
+  if (indexKind_ == StationIndexKind::Multiset) {
+    st.sHook_.unlink();
+  }
+}
+
+void Stations::attach(Station &st) {
+  if (st.closed_) {
+    return;
+  }
+  if (indexKind_ == StationIndexKind::Multiset) {
     stations_.insert(st);
+    return;
+  }
+  HeapKey key{st.lastUnloadEndTs_,
+              tieBreak_ == TieBreak::ById ? st.id_ : updateSeq_++};
+  if (heap_.contains(st.id_)) {
+    // Neither the load nor the sequence number ever decrease, so this always
+    // moves the station down the heap.
+    heap_.update(st.id_, key);
+  } else {
+    heap_.push(st.id_, key);
+  }
+  if (!driveClasses_.empty()) {
+    updateDriveClasses(st.id_, key);
   }
 }
 
+void Stations::updateDriveClasses(StationId id, const HeapKey &key) {
+  int numZones = travel_.numZones();
+  const DriveSlot *slots = &driveSlots_[static_cast<size_t>(id) * numZones];
+  for (int z = 0; z < numZones; z++) {
+    IndexedDaryHeap<HeapKey> &heap = driveClasses_[slots[z].class_].heap_;
+    if (heap.contains(slots[z].item_)) {
+      heap.update(slots[z].item_, key);
+    } else {
+      heap.push(slots[z].item_, key);
+    }
+  }
+}
+
+// A truck can start unloading at a station once it has driven there and the
+// station is free, i.e. at max(now + driving, lastUnloadEndTs_). That is
+// conservative: a truck that arrives before trucks already on their way
+// from further away overtakes them (see Station::addArrivingTruck) and
+// starts earlier, which is not taken into account, since it would mean
+// walking the arriving trucks of every station. All stations
+// of a drive class share the first term, so the top of the class's heap is
+// its best station, and only the tops of the zone's classes are compared.
+// The classes go by ascending drive time, so once a class cannot even be
+// reached before the best start found so far, neither can the rest. A truck
+// unloads for as long at every station, so the earliest start is also the
+// earliest completion. Ties go to the shorter drive.
+Station &Stations::selectByTravelTime(const Truck &truck) {
+  timepoint_t now = timerService_->now();
+  const DriveClass *best = nullptr;
+  timepoint_t bestStartTs = 0;
+  for (uint32_t c = zoneClasses_[truck.zone()];
+       c < zoneClasses_[truck.zone() + 1]; c++) {
+    const DriveClass &dc = driveClasses_[c];
+    timepoint_t arrivalTs = now + dc.driving_;
+    if (best && arrivalTs >= bestStartTs) {
+      break;
+    }
+    // All stations of a class may be closed.
+    if (dc.heap_.empty()) {
+      continue;
+    }
+    timepoint_t startTs = std::max(arrivalTs, dc.heap_.topKey().first);
+    if (!best || startTs < bestStartTs) {
+      best = &dc;
+      bestStartTs = startTs;
+    }
+  }
+  assert(best);
+  return stationHolder_[best->stations_[best->heap_.top()]];
+}
+
+// Picks the same station as selectByTravelTime: the earliest (conservative)
+// start, then the shorter drive, then the smaller key in heap_.
+Station &Stations::selectByScan(const Truck &truck) {
+  timepoint_t now = timerService_->now();
+  Station *best = nullptr;
+  timepoint_t bestStartTs = 0;
+  Minutes bestDriving = 0;
+  for (Station &st : stationHolder_) {
+    if (st.closed_) {
+      continue;
+    }
+    Minutes driving = travel_.at(truck.zone(), st.id_);
+    timepoint_t startTs = std::max(now + driving, st.lastUnloadEndTs_);
+    if (!best || startTs < bestStartTs ||
+        (startTs == bestStartTs &&
+         (driving < bestDriving ||
+          (driving == bestDriving &&
+           heap_.key(st.id_) < heap_.key(best->id_))))) {
+      best = &st;
+      bestStartTs = startTs;
+      bestDriving = driving;
+    }
+  }
+  assert(best);
+  return *best;
+}
+
 Station *Stations::selectUnloadingStation(Truck *truck) {
-  // select "smallest" element from stations_
-  auto itr = stations_.begin();
-  Station &st = *itr;
+  Minutes drivingDuration;
+  Station *selected;
+  if (travel_.empty()) {
+    // select "smallest" element from stations_
+    selected = indexKind_ == StationIndexKind::Multiset
+                   ? &*stations_.begin()
+                   : &stationHolder_[heap_.top()];
+    drivingDuration = selected->drivingDuration_;
+  } else {
+    selected = driveClasses_.empty() ? &selectByScan(*truck)
+                                     : &selectByTravelTime(*truck);
+    drivingDuration = travel_.at(truck->zone(), selected->id_);
+  }
+  Station &st = *selected;
   // Remove it from stations_. Note that this does not destroy the actual
   // Station object
-  stations_.erase(itr);
-  truck->proceedToUnloadingStation(st.timerService_->now(), &st);
-  st.arrivingTrucks_.push_back(truck);
+  detach(st);
+  truck->proceedToUnloadingStation(st.timerService_->now(), &st,
+                                   drivingDuration);
+  st.addArrivingTruck(truck);
   // Reinsert Station into the container
-  stations_.insert(st);
+  attach(st);
+  numDrivingTrucks_++;
   return &st;
 }
 
-Truck::State Stations::onTruckArrivedForUnloading(Station *st) {
-  assert(!st->arrivingTrucks_.empty());
-  st->sHook_.unlink();
-  Truck *truck = st->arrivingTrucks_.front();
-  st->arrivingTrucks_.pop_front();
-  Truck::State result;
-  if (!st->unloadingTruck_) {
-    st->unloadingTruck_ = truck;
-    // Station was previously idle and is now busy
-    st->idleDuration_ += (st->timerService_->now() - st->phaseStartTs_);
-    st->phaseStartTs_ = st->timerService_->now();
-    result = Truck::Unloading;
+Truck::State Stations::onTruckArrivedForUnloading(Station *st,
+                                                  Truck *truck) {
+  recordArrival(*st, timerService_->now());
+  detach(*st);
+  Truck::State result = st->onTruckArrived(truck);
+  attach(*st);
+  numDrivingTrucks_--;
+  if (result == Truck::Unloading) {
+    numBusyStations_++;
   } else {
-    st->waitingTrucks_.push_back(truck);
-    result = Truck::Waiting;
+    numWaitingTrucks_++;
   }
-  stations_.insert(*st);
   return result;
 }
 
 void Stations::onUnloadingFinished(timepoint_t now, Station *st) {
-  st->unloadingTruck_ = nullptr;
-  st->sHook_.unlink();
-  // If we have waitingTrucks, start unloading the earliest one
-  if (!st->waitingTrucks_.empty()) {
-    Truck *truck = st->waitingTrucks_.front();
-    st->waitingTrucks_.pop_front();
-    truck->unloadAtStation(now);
-    st->unloadingTruck_ = truck;
+  recordUnloadingFinished(*st, now);
+  detach(*st);
+  st->onUnloadingFinished(now);
+  attach(*st);
+  if (st->unloadingTruck_) {
+    numWaitingTrucks_--;
+  } else {
+    numBusyStations_--;
   }
+}
 
-  // Station was previously busy and is now idle
-  st->busyDuration_ += (now - st->phaseStartTs_);
-  st->phaseStartTs_ = now;
+// A truck that arrives at a busy station joins the waiting trucks, and one
+// that arrives at an idle station is unloaded right away.
+void Stations::recordArrival(const Station &st, timepoint_t now) {
+  StationStats &stats = stats_[st.id_];
+  if (!st.unloadingTruck_) {
+    stats.waits_.add(0);
+    return;
+  }
+  stats.queueLengths_.add(st.waitingTrucks_.size(),
+                          now - stats.queueChangeTs_);
+  stats.queueChangeTs_ = now;
+}
 
-  stations_.insert(*st);
+// The first waiting truck, if any, is about to be unloaded.
+void Stations::recordUnloadingFinished(const Station &st, timepoint_t now) {
+  if (st.waitingTrucks_.empty()) {
+    return;
+  }
+  StationStats &stats = stats_[st.id_];
+  stats.waits_.add(now - st.waitingTrucks_.front()->stateEntryTs());
+  stats.queueLengths_.add(st.waitingTrucks_.size(),
+                          now - stats.queueChangeTs_);
+  stats.queueChangeTs_ = now;
+}
+
+LogHistogram Stations::waits() const {
+  LogHistogram all;
+  for (const StationStats &stats : stats_) {
+    all.merge(stats.waits_);
+  }
+  return all;
+}
+
+LogHistogram Stations::queueLengths(StationId id, timepoint_t now) const {
+  const StationStats &stats = stats_[id];
+  LogHistogram lengths = stats.queueLengths_;
+  lengths.add(stationHolder_[id].waitingTrucks_.size(),
+              now - stats.queueChangeTs_);
+  return lengths;
+}
+
+LogHistogram Stations::queueLengths(timepoint_t now) const {
+  LogHistogram all;
+  for (StationId id = 0; id < stationHolder_.size(); id++) {
+    all.merge(queueLengths(id, now));
+  }
+  return all;
 }
 
 // Print some station stats. To keep things simple, am only calculating the
-// the average cumulative utilization across all stations. Since the
-// information is stored on a per Station basis, it should also
-// be possible to present a per-Station statistic (like mean idleTime with
-// stddev or mean waitingTrucks queue size)
-void Stations::printStats() const {
+// the average cumulative utilization across all stations. The per-Station
+// statistics are printed by printStationStats.
+double Stations::utilization() const {
   double totalIdle = 0.0;
   double totalBusy = 0.0;
   for (const auto& st : stationHolder_) {
     totalIdle += st.idleDuration_;
     totalBusy += st.busyDuration_;
   }
+  return totalBusy / (totalIdle + totalBusy);
+}
 
-  std::cout << "Avg station utilization: " << totalBusy/(totalIdle + totalBusy) << std::endl;
+void Stations::printStats() const {
+  std::cout << "Avg station utilization: " << utilization() << std::endl;
+}
+
+void Stations::printStationStats(timepoint_t now) const {
+  auto printRow = [](const LogHistogram &waits,
+                     const LogHistogram &lengths) {
+    std::cout << "\t" << waits.quantile(0.5) << "\t" << waits.quantile(0.95)
+              << "\t" << waits.quantile(0.99) << "\t" << lengths.quantile(0.5)
+              << "\t" << lengths.quantile(0.95) << "\t"
+              << lengths.quantile(1.0) << std::endl;
+  };
+  std::cout << std::fixed << std::setprecision(4);
+  std::cout << "Station\tutil\twait p50\tp95\tp99\tqueue p50\tp95\tmax"
+            << std::endl;
+  for (const Station &st : stationHolder_) {
+    std::cout << st.id_ << "\t" << st.utilization();
+    printRow(waits(st.id_), queueLengths(st.id_, now));
+  }
+  std::cout << "All\t" << utilization();
+  printRow(waits(), queueLengths(now));
 }
@@ -1,26 +1,40 @@
 #pragma once
 
+#include "indexedheap.h"
+#include "instrument.h"
+#include "stats.h"
+#include "timerservice.h"
+#include "travel.h"
 #include "truck.h"
+#include <algorithm>
 #include <boost/intrusive/set.hpp>
-#include <deque>
-#include <list>
+#include <vector>
 #include <optional>
 
 namespace bi = boost::intrusive;
-class TimerService;
 
 // Station represents one UnloadingStation.
 struct Station {
-  // Station ID.
-  int id_;
-  TimerService *timerService_ = nullptr;
+  // Station ID, which is also its index in Stations.
+  StationId id_;
+  // How long it takes a truck to drive to this station. How long it takes to
+  // unload depends on the truck (see Truck::unloadingDuration).
+  Minutes drivingDuration_ = kDrivingDuration;
+  // The sum of the unloading durations of the waitingTrucks_, so that a
+  // truck that joins them knows when it will be unloaded in O(1) however
+  // mixed the fleet (see Truck::waitAtStation).
+  Minutes waitingUnloading_ = 0;
+  // A closed station is left out of the index, so that no further trucks are
+  // sent to it (see Stations::close).
+  bool closed_ = false;
+  TimerServiceBase *timerService_ = nullptr;
   // The truck that is currently being unloaded or nullptr.
   Truck *unloadingTruck_ = nullptr;
   // FIFO Queue of trucks that have arrived and are waiting to be unloaded.
-  std::deque<Truck *> waitingTrucks_;
+  TruckQueue waitingTrucks_;
   // FIFO Queue of trucks that have been dispatched to this station but have
   // not yet arrived. The front of the queue is the first arriving truck.
-  std::deque<Truck *> arrivingTrucks_;
+  TruckQueue arrivingTrucks_;
 
   // Total Idle and Busy time for this station.
   Minutes idleDuration_ = 0;
@@ -29,21 +43,73 @@ struct Station {
   //  between these two phases.
   timepoint_t phaseStartTs_ = 0;
 
+  // The ts at which the last truck that has been dispatched to this station
+  // will finish unloading. Together with the current time this gives freeTs()
+  // without walking the queues (see addArrivingTruck).
+  timepoint_t lastUnloadEndTs_ = 0;
+
   // intrusive hook to be able to store all Station's in an ordered
-  // container, see class Stations below for more details.
-  bi::set_member_hook<bi::link_mode<bi::auto_unlink>> sHook_;
+  // container, see class Stations below for more details. The node color is
+  // packed into the parent pointer, which keeps a Station at 128 bytes.
+  using SetHook = bi::set_member_hook<bi::link_mode<bi::auto_unlink>,
+                                      bi::optimize_size<true>>;
+  SetHook sHook_;
 
   // Constructor
-  Station(int id, TimerService *timerSvc) : id_{id}, timerService_{timerSvc} {}
+  Station(StationId id, TimerServiceBase *timerSvc,
+          const Durations &durations = {})
+      : id_{id}, drivingDuration_{durations.driving},
+        timerService_{timerSvc} {}
+
+  // Back to the state of a station newly constructed with the given
+  // durations. The station must not be in an index (see Stations).
+  void reset(const Durations &durations);
+
+  // Writes the state of the station, with its trucks as ids, to a checkpoint
+  // and reads it back (see checkpoint.h). The station must not be in an
+  // index, and the trucks must have been restored already.
+  void checkpoint(CheckpointWriter &out) const;
+  void restore(CheckpointReader &in, std::vector<Truck> &trucks);
 
   // When is this station going to be free? The station may already be free
   // or will become free after all currently unloading/waiting/arriving trucks
   // have been processed. This value is used to determine which is the least
   // loaded truck at any time.
-  timepoint_t freeTs() const;
+  timepoint_t freeTs() const {
+    return std::max(timerService_->now(), lastUnloadEndTs_);
+  }
+
+  // Calculates freeTs() from scratch by walking the unloading/waiting/arriving
+  // trucks. Used to cross-check the incrementally maintained value in debug
+  // builds.
+  timepoint_t recomputeFreeTs() const;
+
+  // Adds a truck that has just been dispatched to this station to the
+  // arrivingTrucks_ queue, in the order of arrival, and updates the projected
+  // free time.
+  void addArrivingTruck(Truck *truck);
+
+  // A truck of the arrivingTrucks_ has arrived. It is the first one, or one
+  // that arrives at the same ts. If the station was free, the truck
+  // immediately begins unloading, else it is queued up in the waitingTrucks_
+  // queue. Returns either Truck::Unloading or Truck::Waiting to indicate what
+  // happened.
+  Truck::State onTruckArrived(Truck *truck);
+  // The unloading truck has finished unloading. Starts unloading the next
+  // waiting truck if any.
+  void onUnloadingFinished(timepoint_t now);
+
+  // Fraction of the time so far that the station spent unloading trucks.
+  double utilization() const {
+    return static_cast<double>(busyDuration_) /
+           (idleDuration_ + busyDuration_);
+  }
 
   // Stations are ordered based on their freeTs.
-  bool operator<(const Station &rhs) const { return freeTs() < rhs.freeTs(); }
+  bool operator<(const Station &rhs) const {
+    instrument::countStationComparison();
+    return freeTs() < rhs.freeTs();
+  }
 };
 
 ////////////////////////////////////////////////////////////////////////////
@@ -60,39 +126,195 @@ struct Station {
 // a STL multiset, we would first have to locate the Station using a linear scan
 // since the multiset is ordered by the station load and is not directly
 // searchable using the station ID.
+//
+// With many stations the multiset's tree nodes are scattered across memory, so
+// as an alternative Stations can also keep the stations in an indexed d-ary
+// heap (see indexedheap.h) held in one contiguous array. The index used is
+// selected at construction. Both always select the same station, which lets
+// them be benchmarked against each other on identical runs.
+//
+// Stations that will become free at the same ts are selected in the order of
+// their last update, or in station id order with TieBreak::ById. Only the
+// heap supports the latter.
+enum class StationIndexKind { Heap, Multiset };
+
+// Distributions gathered for a station as the simulation runs, see
+// Stations::waits() and Stations::queueLengths(). Kept apart from Station so
+// that a Station stays within two cache lines, and aligned so that the
+// workers of ParallelSimulation do not share cache lines for the stations
+// they own.
+struct alignas(64) StationStats {
+  // The wait of every truck unloaded at the station.
+  LogHistogram waits_;
+  // Minutes during which each number of trucks were waiting, up to
+  // queueChangeTs_.
+  LogHistogram queueLengths_;
+  // When the number of waiting trucks last changed.
+  timepoint_t queueChangeTs_ = 0;
+};
+
 class Stations {
   // We need to create all Station objects in a container which guarantees
-  // that the location of the object will not move during run-time.
-  std::list<Station> stationHolder_;
+  // that the location of the object will not move during run-time. The
+  // vector is sized once at construction and is indexed by StationId.
+  std::vector<Station> stationHolder_;
+  // Indexed by StationId like stationHolder_.
+  std::vector<StationStats> stats_;
+  TimerServiceBase *timerService_;
   using SetMemberHookOption =
-      bi::member_hook<Station,
-                      bi::set_member_hook<bi::link_mode<bi::auto_unlink>>,
-                      &Station::sHook_>;
+      bi::member_hook<Station, Station::SetHook, &Station::sHook_>;
 
   // This is the ordered view of all Stations. It will be maintained based on
   // each Station's load. The way this works internally in boost is that it is a
   // view on objects owned and held elsewhere (stationHolder_ in our case).
   bi::multiset<Station, SetMemberHookOption, bi::constant_time_size<false>>
       stations_;
+
+  // The heap based index, keyed on (lastUnloadEndTs_, sequence number of the
+  // station's last update). On equal keys the multiset keeps stations in the
+  // order in which they were (re)inserted, and since a station is never
+  // reinserted with a freeTs in the past, its order is exactly that of the key
+  // above. Including the sequence number makes the heap pick the same station.
+  // With TieBreak::ById the station id takes the place of the sequence number.
+  using HeapKey = std::pair<timepoint_t, uint64_t>;
+  IndexedDaryHeap<HeapKey> heap_;
+  uint64_t updateSeq_ = 0;
+
+  // With TravelTimes, how soon a station can unload a truck also depends on
+  // how far it is from the truck's zone. The stations that are the same
+  // drive time away from a zone form one of its drive classes, and every
+  // class keeps its stations in a heap with the same keys as heap_, so that
+  // within a class the top is the best station. See selectByTravelTime.
+  struct DriveClass {
+    Minutes driving_ = 0;
+    IndexedDaryHeap<HeapKey> heap_;
+    // The stations of the class, indexed by their item in heap_.
+    std::vector<StationId> stations_;
+  };
+  // Where a station is in the drive classes of a zone.
+  struct DriveSlot {
+    uint32_t class_;
+    uint32_t item_;
+  };
+  TravelTimes travel_;
+  // The classes of zone z are driveClasses_[zoneClasses_[z]] up to
+  // driveClasses_[zoneClasses_[z + 1]], by ascending drive time.
+  std::vector<DriveClass> driveClasses_;
+  std::vector<uint32_t> zoneClasses_;
+  // The slot of station s in zone z is driveSlots_[s * numZones + z], so
+  // that the slots of a station in all zones are next to each other.
+  std::vector<DriveSlot> driveSlots_;
+  // See numDrivingTrucks() etc.
+  uint64_t numDrivingTrucks_ = 0;
+  uint64_t numWaitingTrucks_ = 0;
+  uint64_t numBusyStations_ = 0;
+  StationIndexKind indexKind_;
+  TieBreak tieBreak_;
+
+  // A station's load can only be changed while it is detached from the index.
+  void detach(Station &st);
+  void attach(Station &st);
+  // Empties the index, keeping its memory.
+  void clearIndex();
+  // Sorts the stations into the drive classes of every zone of travel_,
+  // unless there are so many zones that keeping them up to date would cost
+  // more than scanning the stations, in which case there are none.
+  void buildDriveClasses();
+  // Puts a station into the drive classes of every zone with the given key,
+  // or changes its key there.
+  void updateDriveClasses(StationId id, const HeapKey &key);
+  Station &selectByTravelTime(const Truck &truck);
+  Station &selectByScan(const Truck &truck);
   friend class StationsTest_StationEta_Test;
   friend class StationsTest_StationEta2_Test;
+  friend class StationsTest_IncrementalFreeTs_Test;
 
 public:
-  Stations(int numStations, TimerService *timerSvc);
+  // With travel times, which need the heap index, the drive time to a
+  // station depends on the zone of the truck (see TravelTimes) rather than
+  // being durations.driving, and numStations must be that of travel. Throws
+  // std::invalid_argument otherwise.
+  Stations(int numStations, TimerServiceBase *timerSvc,
+           StationIndexKind indexKind = StationIndexKind::Heap,
+           TieBreak tieBreak = TieBreak::Fifo,
+           const Durations &durations = {}, const TravelTimes &travel = {});
+
+  Station *station(StationId id) { return &stationHolder_[id]; }
+  const Station *station(StationId id) const { return &stationHolder_[id]; }
+  size_t size() const { return stationHolder_.size(); }
+
+  // Back to the state right after construction with numStations stations and
+  // the given durations. Existing stations and the index are reused, so that
+  // no memory needs to be allocated unless numStations grows. Invalidates
+  // Station pointers if it does. Throws std::invalid_argument if there are
+  // travel times for another number of stations.
+  void reset(int numStations, const Durations &durations = {});
+  const TravelTimes &travelTimes() const { return travel_; }
+
+  // Takes a station out of service: no further trucks are sent to it, while
+  // the trucks already on their way or waiting there are still unloaded.
+  // Throws std::invalid_argument if id is out of range or it is the last
+  // open station.
+  void close(StationId id);
+
+  // Writes all stations, the order of the index and the StationStats to a
+  // checkpoint, and reads them back (see checkpoint.h). The number of
+  // stations must already match that of the checkpoint, and the current time
+  // must have been restored for the multiset index to be ordered.
+  void checkpoint(CheckpointWriter &out) const;
+  void restore(CheckpointReader &in, std::vector<Truck> &trucks);
 
   // When a truck has finished Mining, this method is used to determine
-  // which UnloadingStation to send the truck to.
+  // which UnloadingStation to send the truck to, and sends it there. Without
+  // travel times this is the station that will be free the soonest. With
+  // them, it is the one at which the truck can start unloading the soonest,
+  // counting its drive there, if it were queued behind every truck already
+  // sent to the station. Since a truck that arrives first overtakes trucks
+  // still on their way, this is conservative, and a station that it would
+  // reach ahead of others can be passed over. Without travel times this takes
+  // O(log numStations) rather than a scan of all stations. With them it
+  // compares the drive classes of the truck's zone, i.e. up to as many as
+  // there are distinct drive times from the zone, and every arrival and
+  // unloading updates the classes of every zone in O(numZones *
+  // log numStations). Sites with more zones than numStations /
+  // log2(numStations) scan the open stations instead, in O(numStations).
   Station *selectUnloadingStation(Truck *truck);
 
   // Event dispatched by timer service when a truck arrives for unloading.
-  // If station was free, truck immediately begins unloading, else it
-  // is queued up in the station's FIFO waitingTrucks_ queue.
-  // Returns either Truck::Unloading or Truck::Waiting to indicate what
-  // happened.
-  Truck::State onTruckArrivedForUnloading(Station *st);
+  // See Station::onTruckArrived.
+  Truck::State onTruckArrivedForUnloading(Station *st, Truck *truck);
   // Event dispatched by timer service when an unloading truck finishes
   // unloading and is ready to start mining again.
   void onUnloadingFinished(timepoint_t now, Station *st);
 
+  // Update the StationStats of st. Called from the two methods above, before
+  // the station handles the event, and directly by simulations that call the
+  // Station handlers themselves.
+  void recordArrival(const Station &st, timepoint_t now);
+  void recordUnloadingFinished(const Station &st, timepoint_t now);
+
+  // The wait of every truck unloaded at a station so far, or at any station.
+  // Trucks unloaded on arrival waited 0 minutes, and trucks that are still
+  // waiting are not counted yet.
+  const LogHistogram &waits(StationId id) const { return stats_[id].waits_; }
+  LogHistogram waits() const;
+  // The number of trucks waiting at a station, or at each station, weighted
+  // by the minutes they were waiting for up to now.
+  LogHistogram queueLengths(StationId id, timepoint_t now) const;
+  LogHistogram queueLengths(timepoint_t now) const;
+
+  // The number of trucks driving to, waiting at and being unloaded at (i.e.
+  // busy) stations right now. They are counted as trucks come and go in the
+  // event methods above, so reading them costs nothing. ParallelSimulation
+  // calls the Station handlers directly and does not keep them.
+  uint64_t numDrivingTrucks() const { return numDrivingTrucks_; }
+  uint64_t numWaitingTrucks() const { return numWaitingTrucks_; }
+  uint64_t numBusyStations() const { return numBusyStations_; }
+
+  // Fraction of the total time that stations spent unloading trucks.
+  double utilization() const;
   void printStats() const;
+  // Prints the utilization and the wait and queue length quantiles of every
+  // station, followed by those of all stations together.
+  void printStationStats(timepoint_t now) const;
 };
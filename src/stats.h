@@ -0,0 +1,156 @@
+#pragma once
+#include <boost/math/distributions/students_t.hpp>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Tracks the running avg and variance of a stream of observations.
+class RunningStats {
+  std::string name_;
+  int num_ = 0;
+  double total_ = 0;
+  double k_ = 0.0;
+  double ex_ = 0.0;
+  double ex2_ = 0.0;
+
+public:
+  // See here for more details:
+  // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
+  void addObservation(double m) {
+    if (num_ == 0) {
+      k_ = m;
+    }
+    num_ += 1;
+    ex_ += (m - k_);
+    ex2_ += (m - k_) * (m - k_);
+    total_ += m;
+  }
+
+  void name(std::string_view name) { name_ = name; }
+
+  std::string_view name() const { return name_; }
+
+  int count() const { return num_; }
+
+  double total() const { return total_; }
+
+  double mean() const { return k_ + ex_ / num_; }
+
+  double stddev() const {
+    double variance = (ex2_ - ((ex_ * ex_) / num_)) / (num_ - 1);
+    return sqrt(variance);
+  }
+
+  // Half width of the two sided confidence interval of the mean at the given
+  // level (e.g. 0.95), assuming independent, roughly normal observations.
+  double confidenceHalfWidth(double level = 0.95) const {
+    if (num_ < 2) {
+      return 0.0;
+    }
+    boost::math::students_t dist(num_ - 1);
+    double t = boost::math::quantile(dist, 0.5 + level / 2);
+    return t * stddev() / sqrt(num_);
+  }
+};
+
+// A histogram of non-negative integers in logarithmic buckets, for the
+// quantiles of long tailed distributions such as waits and queue lengths.
+// Values below 2^kSubBucketBits each have their own bucket, and every power
+// of two above that is split into 2^kSubBucketBits buckets, so a quantile is
+// off by less than 1/16 of its value. The buckets only go up to that of the
+// largest value added (at most 976 for any 64 bit value), so the memory is
+// bounded however many values are added. Adding a value costs a few bit
+// operations and an increment.
+//
+// Histograms are merged by adding up their counts, which gives exactly the
+// histogram of all their values. So the histograms of several stations,
+// threads or replicas combine without losing precision.
+class LogHistogram {
+public:
+  static constexpr int kSubBucketBits = 4;
+
+private:
+  static constexpr uint64_t kSubBuckets = uint64_t{1} << kSubBucketBits;
+  std::vector<uint64_t> counts_;
+  uint64_t total_ = 0;
+
+public:
+  static size_t bucketOf(uint64_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    int shift = std::bit_width(value) - 1 - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+  }
+  // The largest value that falls into the bucket.
+  static uint64_t highestValueOf(size_t bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    int shift = bucket / kSubBuckets - 1;
+    uint64_t lowest = (kSubBuckets + bucket % kSubBuckets) << shift;
+    return lowest + ((uint64_t{1} << shift) - 1);
+  }
+
+  LogHistogram() = default;
+  // A histogram with the given counts per bucket, e.g. from counts().
+  explicit LogHistogram(std::vector<uint64_t> counts)
+      : counts_{std::move(counts)} {
+    while (!counts_.empty() && counts_.back() == 0) {
+      counts_.pop_back();
+    }
+    for (uint64_t c : counts_) {
+      total_ += c;
+    }
+  }
+
+  // Adds value weight times, e.g. weighted by how long it lasted.
+  void add(uint64_t value, uint64_t weight = 1) {
+    if (weight == 0) {
+      return;
+    }
+    size_t bucket = bucketOf(value);
+    if (bucket >= counts_.size()) {
+      counts_.resize(bucket + 1);
+    }
+    counts_[bucket] += weight;
+    total_ += weight;
+  }
+  void merge(const LogHistogram &other) {
+    if (other.counts_.size() > counts_.size()) {
+      counts_.resize(other.counts_.size());
+    }
+    for (size_t b = 0; b < other.counts_.size(); b++) {
+      counts_[b] += other.counts_[b];
+    }
+    total_ += other.total_;
+  }
+  // Removes all values, keeping the memory.
+  void clear() {
+    counts_.clear();
+    total_ = 0;
+  }
+
+  // The total weight of all values added.
+  uint64_t total() const { return total_; }
+  bool empty() const { return total_ == 0; }
+  const std::vector<uint64_t> &counts() const { return counts_; }
+  // The smallest value that at least a fraction q (in [0, 1]) of the weight
+  // is at or below, rounded up to the end of its bucket. 0 if empty.
+  uint64_t quantile(double q) const {
+    uint64_t rank = std::max<uint64_t>(std::ceil(q * total_), 1);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < counts_.size(); b++) {
+      seen += counts_[b];
+      if (seen >= rank) {
+        return highestValueOf(b);
+      }
+    }
+    return 0;
+  }
+  bool operator==(const LogHistogram &) const = default;
+};
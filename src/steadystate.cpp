@@ -0,0 +1,119 @@
+#include "steadystate.h"
+#include "sampler.h"
+#include "stats.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+size_t mserTruncation(const std::vector<double> &values) {
+  size_t n = values.size();
+  size_t best = 0;
+  double bestStatistic = std::numeric_limits<double>::infinity();
+  // From the back, so that the sums over values[d..n) grow by one value per
+  // step. On ties the smaller d wins.
+  double sum = 0.0;
+  double sumSquares = 0.0;
+  for (size_t d = n; d-- > 0;) {
+    sum += values[d];
+    sumSquares += values[d] * values[d];
+    if (d > n / 2) {
+      continue;
+    }
+    double k = n - d;
+    double deviations = std::max(sumSquares - sum * sum / k, 0.0);
+    double statistic = deviations / (k * k);
+    if (statistic <= bestStatistic) {
+      best = d;
+      bestStatistic = statistic;
+    }
+  }
+  return best;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void SteadyStateEstimate::printStats() const {
+  std::cout << std::fixed;
+  std::cout << (converged ? "Steady state reached" : "Steady state not reached")
+            << " after " << stoppedAfter << " min (warm-up " << warmup
+            << " min, " << numBatches << " batches): " << std::setprecision(4)
+            << "Truck utilization " << truckUtilization << " +- "
+            << truckUtilizationHalfWidth << "; Station utilization "
+            << stationUtilization << " +- " << stationUtilizationHalfWidth
+            << std::endl;
+}
+
+SteadyStateDetector::SteadyStateDetector(const SteadyStateConfig &config)
+    : config_{config} {
+  if (!(config.tolerance >= 0) || !(config.level > 0 && config.level < 1) ||
+      config.batchLength < 1 || config.minBatches < 1) {
+    throw std::invalid_argument("Invalid steady state config");
+  }
+}
+
+SteadyStateEstimate SteadyStateDetector::estimate() const {
+  SteadyStateEstimate e;
+  size_t warmup = std::max(mserTruncation(truckBatches_),
+                           mserTruncation(stationBatches_));
+  e.warmup = warmup * config_.batchLength;
+  e.numBatches = truckBatches_.size() - warmup;
+  RunningStats trucks;
+  RunningStats stations;
+  for (size_t i = warmup; i < truckBatches_.size(); i++) {
+    trucks.addObservation(truckBatches_[i]);
+    stations.addObservation(stationBatches_[i]);
+  }
+  if (e.numBatches > 0) {
+    e.truckUtilization = trucks.mean();
+    e.stationUtilization = stations.mean();
+  }
+  e.truckUtilizationHalfWidth = trucks.confidenceHalfWidth(config_.level);
+  e.stationUtilizationHalfWidth = stations.confidenceHalfWidth(config_.level);
+  e.converged =
+      e.numBatches >= config_.minBatches &&
+      e.truckUtilizationHalfWidth <= config_.tolerance * e.truckUtilization &&
+      e.stationUtilizationHalfWidth <=
+          config_.tolerance * e.stationUtilization;
+  return e;
+}
+
+SteadyStateEstimate SteadyStateDetector::run(Simulation &sim) {
+  truckBatches_.clear();
+  stationBatches_.clear();
+  double numTrucks = sim.trucks().size();
+  double numStations = sim.stations().size();
+  timepoint_t start = sim.now();
+  double truckSum = 0.0;
+  double stationSum = 0.0;
+  Minutes minutesInBatch = 0;
+  for (timepoint_t ts = start;; ts++) {
+    sim.resume(ts + 1);
+    // A simulation without events cannot get any further either.
+    if (sim.finished() || sim.numPendingEvents() == 0) {
+      break;
+    }
+    // The state from ts up to the next minute.
+    Sample sample = takeSample(sim);
+    truckSum += sample.trucks[Truck::Mining] / numTrucks;
+    stationSum += sample.busyStations / numStations;
+    if (++minutesInBatch < config_.batchLength) {
+      continue;
+    }
+    truckBatches_.push_back(truckSum / config_.batchLength);
+    stationBatches_.push_back(stationSum / config_.batchLength);
+    truckSum = 0.0;
+    stationSum = 0.0;
+    minutesInBatch = 0;
+    SteadyStateEstimate e = estimate();
+    if (e.converged) {
+      e.stoppedAfter = ts + 1 - start;
+      return e;
+    }
+  }
+  // The last, partial batch is left out.
+  SteadyStateEstimate e = estimate();
+  e.stoppedAfter = sim.now() - start;
+  return e;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "simulation.h"
+#include <vector>
+
+// When SteadyStateDetector stops a simulation.
+struct SteadyStateConfig {
+  // The largest half width of a confidence interval, relative to its mean,
+  // at which an estimate counts as stable, e.g. 0.01 for +-1%.
+  double tolerance = 0.01;
+  // Confidence level of the intervals.
+  double level = 0.95;
+  // Minutes of simulated time per batch. Batches must be long enough for
+  // their means to be roughly independent of each other.
+  Minutes batchLength = 60;
+  // The least number of batches, after the warm-up is cut off, that the
+  // intervals are computed from.
+  int minBatches = 10;
+};
+
+// The steady-state estimates of a simulation, and when they were made.
+struct SteadyStateEstimate {
+  // Minutes of simulated time from where run() took up the simulation to
+  // where it stopped it, or to the end of the simulation if it never
+  // converged.
+  Minutes stoppedAfter = 0;
+  // Whether both intervals were within the tolerance.
+  bool converged = false;
+  // Minutes at the beginning that MSER cut off as warm-up.
+  Minutes warmup = 0;
+  // Batches after the warm-up.
+  int numBatches = 0;
+  // Means of the batches after the warm-up, and the half widths of their
+  // confidence intervals.
+  double truckUtilization = 0.0;
+  double truckUtilizationHalfWidth = 0.0;
+  double stationUtilization = 0.0;
+  double stationUtilizationHalfWidth = 0.0;
+  bool operator==(const SteadyStateEstimate &) const = default;
+  // Prints when the simulation stopped and the estimates.
+  void printStats() const;
+};
+
+// The number of leading values to drop so that the rest is free of the
+// initial transient, by the MSER rule: the d in [0, n/2] that minimizes the
+// squared deviations of values[d..n) from their mean, divided by (n - d)^2.
+size_t mserTruncation(const std::vector<double> &values);
+
+// Runs a simulation only until its truck and station utilizations have
+// stabilized, by the method of batch means: simulated time is cut into
+// batches of batchLength minutes, the utilizations are averaged over each
+// batch, the batches of the warm-up are dropped (see mserTruncation) and the
+// rest are treated as independent observations of the steady state. The
+// simulation stops at the end of the first batch after which both confidence
+// intervals are within the tolerance.
+//
+// All events happen at whole minutes, so the state after the events of a
+// minute holds until the next one. Pausing the simulation once a minute
+// (see SimulationBase::resume) and reading the O(1) counters of Stations
+// gives the exact time averages, without adding to the cost of the events.
+class SteadyStateDetector {
+  SteadyStateConfig config_;
+  std::vector<double> truckBatches_;
+  std::vector<double> stationBatches_;
+
+  // The estimate from the batches so far.
+  SteadyStateEstimate estimate() const;
+
+public:
+  // Throws std::invalid_argument if the tolerance is negative, the level not
+  // in (0, 1), or batchLength or minBatches is not positive.
+  explicit SteadyStateDetector(const SteadyStateConfig &config);
+
+  // Resumes sim, which must have begun, until its estimates have converged
+  // or it has finished. A converged simulation is left paused.
+  SteadyStateEstimate run(Simulation &sim);
+
+  // The mean utilizations of every batch so far, including the warm-up.
+  const std::vector<double> &truckBatches() const { return truckBatches_; }
+  const std::vector<double> &stationBatches() const {
+    return stationBatches_;
+  }
+};
@@ -0,0 +1,270 @@
+#include "sweep.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+SweepRange SweepRange::parse(std::string_view text) {
+  int fields[3] = {0, 0, 1};
+  int numFields = 0;
+  const char *pos = text.data();
+  const char *end = text.data() + text.size();
+  // Every field must be a number, separated by single colons.
+  while (true) {
+    auto [ptr, ec] = std::from_chars(pos, end, fields[numFields]);
+    if (ec != std::errc{}) {
+      throw std::invalid_argument("Malformed range: " + std::string{text});
+    }
+    numFields++;
+    pos = ptr;
+    if (pos == end) {
+      break;
+    }
+    if (*pos != ':' || numFields == 3) {
+      throw std::invalid_argument("Malformed range: " + std::string{text});
+    }
+    pos++;
+  }
+  SweepRange range{fields[0], numFields > 1 ? fields[1] : fields[0],
+                   fields[2]};
+  if (range.step <= 0 || range.last < range.first) {
+    throw std::invalid_argument("Empty range: " + std::string{text});
+  }
+  return range;
+}
+
+std::vector<int> SweepRange::values() const {
+  std::vector<int> values;
+  // In 64 bits so that the last step cannot overflow.
+  for (int64_t v = first; v <= last; v += step) {
+    values.push_back(v);
+  }
+  return values;
+}
+
+std::vector<SweepPoint> SweepRanges::grid() const {
+  std::vector<SweepPoint> points;
+  SweepPoint p;
+  for (int n : trucks.values()) {
+    p.numTrucks = n;
+    for (int m : stations.values()) {
+      p.numStations = m;
+      for (Minutes u : unloading.values()) {
+        p.durations.unloading = u;
+        for (Minutes d : driving.values()) {
+          p.durations.driving = d;
+          for (Minutes lo : miningMin.values()) {
+            p.durations.miningMin = lo;
+            for (Minutes hi : miningMax.values()) {
+              p.durations.miningMax = hi;
+              for (Minutes s : sim.values()) {
+                p.durations.sim = s;
+                if (p.durations.valid()) {
+                  points.push_back(p);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return points;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+SweepRunner::SweepRunner(const SimulationConfig &config,
+                         std::vector<SweepPoint> points, int numThreads,
+                         std::optional<SteadyStateConfig> steadyState)
+    : config_{config}, points_{std::move(points)},
+      numThreads_{std::clamp(numThreads, 1,
+                             std::max<int>(points_.size(), 1))},
+      steadyState_{steadyState}, results_(points_.size()) {
+  // Checked up front, since the simulations run on other threads.
+  for (const SweepPoint &p : points_) {
+    if (!config_.travelTimes.empty() &&
+        p.numStations != config_.travelTimes.numStations()) {
+      throw std::invalid_argument(
+          "The travel times are for " +
+          std::to_string(config_.travelTimes.numStations()) + " stations");
+    }
+  }
+  if (steadyState_) {
+    // Throws for an invalid config before anything runs.
+    SteadyStateDetector{*steadyState_};
+  }
+}
+
+void SweepRunner::run() {
+  std::atomic<size_t> nextPoint = 0;
+  // A point may throw, e.g. when its simulation runs out of memory. The
+  // exception of each point is kept in its slot and the first one is
+  // rethrown once all threads are done.
+  std::vector<std::exception_ptr> errors(points_.size());
+  auto worker = [this, &nextPoint, &errors]() {
+    // Constructed for the first point of the thread and reconfigured for the
+    // others.
+    std::optional<Simulation> sim;
+    for (size_t i = nextPoint++; i < points_.size(); i = nextPoint++) {
+      try {
+        const SweepPoint &p = points_[i];
+        if (!sim) {
+          SimulationConfig config = config_;
+          config.numTrucks = p.numTrucks;
+          config.numStations = p.numStations;
+          config.durations = p.durations;
+          sim.emplace(config);
+        } else {
+          sim->reconfigure(p.numTrucks, p.numStations, p.durations);
+        }
+
+        // Each point writes to its own slot, so no locking is needed.
+        SweepResult &result = results_[i];
+        std::optional<SteadyStateEstimate> estimate;
+        if (steadyState_) {
+          sim->begin();
+          estimate = SteadyStateDetector{*steadyState_}.run(*sim);
+          result.simulatedTime = sim->now();
+        } else {
+          result.simulatedTime = sim->start();
+        }
+        TrucksStats trucksStats;
+        for (const Truck &truck : sim->trucks()) {
+          trucksStats.absorbTruck(truck.retrieveStats());
+        }
+        result.truckUtilization = trucksStats.utilization();
+        for (auto st : {Truck::Mining, Truck::Driving, Truck::Waiting,
+                        Truck::Unloading}) {
+          result.stateMeans[st] = trucksStats.stateStats(st).mean();
+          // The stddev of a single truck is undefined.
+          result.stateStddevs[st] =
+              p.numTrucks > 1 ? trucksStats.stateStats(st).stddev() : 0.0;
+        }
+        result.stationUtilization = sim->stations().utilization();
+        if (estimate) {
+          result.truckUtilization = estimate->truckUtilization;
+          result.stationUtilization = estimate->stationUtilization;
+          result.converged = estimate->converged;
+          result.warmup = estimate->warmup;
+          result.truckUtilizationHalfWidth =
+              estimate->truckUtilizationHalfWidth;
+          result.stationUtilizationHalfWidth =
+              estimate->stationUtilizationHalfWidth;
+        }
+      } catch (...) {
+        errors[i] = std::current_exception();
+        // The simulation may be left half done, so the next point
+        // constructs a new one.
+        sim.reset();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads_; t++) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (const std::exception_ptr &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+constexpr std::array<const char *, 4> kStateNames = {"mining", "driving",
+                                                     "waiting", "unloading"};
+
+// Calls field(name, value) for every column of a row, in column order. The
+// steady state columns come last, so that the others keep their positions.
+template <class Field>
+void forEachField(const SweepPoint &p, const SweepResult &r, bool steadyState,
+                  Field &&field) {
+  field("trucks", p.numTrucks);
+  field("stations", p.numStations);
+  field("unloading", p.durations.unloading);
+  field("driving", p.durations.driving);
+  field("mining_min", p.durations.miningMin);
+  field("mining_max", p.durations.miningMax);
+  field("sim_duration", p.durations.sim);
+  field("simulated_time", r.simulatedTime);
+  field("truck_utilization", r.truckUtilization);
+  for (size_t st = 0; st < kStateNames.size(); st++) {
+    field(std::string{kStateNames[st]} + "_mean", r.stateMeans[st]);
+    field(std::string{kStateNames[st]} + "_stddev", r.stateStddevs[st]);
+  }
+  field("station_utilization", r.stationUtilization);
+  if (steadyState) {
+    field("converged", int{r.converged});
+    field("warmup", r.warmup);
+    field("truck_utilization_half_width", r.truckUtilizationHalfWidth);
+    field("station_utilization_half_width", r.stationUtilizationHalfWidth);
+  }
+}
+
+// Writes a value of a field, or nonFinite for a nan or infinite double (e.g.
+// the utilization of a simulation in which no time passed), which neither
+// format can represent as a number.
+template <class T>
+void writeValue(std::ostream &os, T value, const char *nonFinite) {
+  if constexpr (std::is_floating_point_v<T>) {
+    if (!std::isfinite(value)) {
+      os << nonFinite;
+      return;
+    }
+  }
+  os << value;
+}
+
+} // namespace
+
+void SweepRunner::writeCsv(std::ostream &os) const {
+  const char *sep = "";
+  forEachField(SweepPoint{}, SweepResult{}, steadyState_.has_value(),
+               [&os, &sep](const std::string &name, auto) {
+                 os << sep << name;
+                 sep = ",";
+               });
+  os << "\n";
+  os << std::defaultfloat << std::setprecision(6);
+  for (size_t i = 0; i < points_.size(); i++) {
+    sep = "";
+    forEachField(points_[i], results_[i], steadyState_.has_value(),
+                 [&os, &sep](const std::string &, auto value) {
+                   os << sep;
+                   writeValue(os, value, "");
+                   sep = ",";
+                 });
+    os << "\n";
+  }
+}
+
+void SweepRunner::writeJson(std::ostream &os) const {
+  os << std::defaultfloat << std::setprecision(6) << "[";
+  for (size_t i = 0; i < points_.size(); i++) {
+    os << (i == 0 ? "\n  {" : ",\n  {");
+    const char *sep = "";
+    forEachField(points_[i], results_[i], steadyState_.has_value(),
+                 [&os, &sep](const std::string &name, auto value) {
+                   os << sep << "\"" << name << "\": ";
+                   writeValue(os, value, "null");
+                   sep = ", ";
+                 });
+    os << "}";
+  }
+  os << "\n]\n";
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "simulation.h"
+#include "steadystate.h"
+#include <array>
+#include <iosfwd>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// An inclusive range of integer parameter values: first, first + step, ...
+// up to and including last.
+struct SweepRange {
+  int first = 0;
+  int last = 0;
+  int step = 1;
+
+  // Parses "value", "first:last" or "first:last:step". Throws
+  // std::invalid_argument if the text is malformed, step is not positive or
+  // last < first.
+  static SweepRange parse(std::string_view text);
+  static SweepRange single(int value) { return {value, value, 1}; }
+  std::vector<int> values() const;
+  bool isSingle() const { return first == last; }
+};
+
+// One point of the grid: what differs between the simulations of a sweep.
+struct SweepPoint {
+  int numTrucks = 1;
+  int numStations = 1;
+  Durations durations;
+  bool operator==(const SweepPoint &) const = default;
+};
+
+// The ranges of all swept parameters. Every parameter is a single value,
+// taken from Durations' defaults, unless set.
+struct SweepRanges {
+  SweepRange trucks = SweepRange::single(1);
+  SweepRange stations = SweepRange::single(1);
+  SweepRange unloading = SweepRange::single(kUnloadingDuration);
+  SweepRange driving = SweepRange::single(kDrivingDuration);
+  SweepRange miningMin = SweepRange::single(kMiningDurationMin);
+  SweepRange miningMax = SweepRange::single(kMiningDurationMax);
+  SweepRange sim = SweepRange::single(kSimDuration);
+
+  // The cartesian product of the ranges, with trucks varying slowest and sim
+  // fastest. Points whose durations are not valid() (e.g. miningMin >
+  // miningMax) are left out.
+  std::vector<SweepPoint> grid() const;
+};
+
+// The results of the simulation at one grid point.
+struct SweepResult {
+  Minutes simulatedTime = 0;
+  double truckUtilization = 0.0;
+  // Mean and stddev across trucks of the time spent in each of the 4 states.
+  std::array<double, 4> stateMeans = {};
+  std::array<double, 4> stateStddevs = {};
+  double stationUtilization = 0.0;
+  // Only set when the runner detects the steady state, in which case the
+  // utilizations above are its estimates, see SteadyStateEstimate.
+  bool converged = false;
+  Minutes warmup = 0;
+  double truckUtilizationHalfWidth = 0.0;
+  double stationUtilizationHalfWidth = 0.0;
+  bool operator==(const SweepResult &) const = default;
+};
+
+// Runs one simulation per grid point. The simulations share the config
+// (seed, rng, event queue etc.) apart from the numbers of trucks and stations
+// and the durations. Like ReplicaRunner, the points are spread across a pool
+// of threads, each taking the next point that has not been started yet, and
+// each thread reconfigures one Simulation for all of its points rather than
+// constructing a new one. A point's results do not depend on the number of
+// threads.
+//
+// With a steadyState config, every simulation only runs until its
+// utilizations have stabilized (see SteadyStateDetector) rather than for
+// its whole durations.sim, which cuts short the points that settle early.
+// The output then has 4 more columns: converged, warmup and the half widths
+// of the utilizations.
+class SweepRunner {
+  SimulationConfig config_;
+  std::vector<SweepPoint> points_;
+  int numThreads_;
+  std::optional<SteadyStateConfig> steadyState_;
+  std::vector<SweepResult> results_;
+
+public:
+  SweepRunner(const SimulationConfig &config, std::vector<SweepPoint> points,
+              int numThreads,
+              std::optional<SteadyStateConfig> steadyState = std::nullopt);
+
+  // Runs all points and returns once they have all finished. Rethrows the
+  // exception of the first point that threw, if any.
+  void run();
+  const std::vector<SweepPoint> &points() const { return points_; }
+  // Results of every point, in the order of points().
+  const std::vector<SweepResult> &results() const { return results_; }
+
+  // One row (or object) per point with its parameters and results. The JSON
+  // output is an array of objects with the same keys as the CSV columns.
+  void writeCsv(std::ostream &os) const;
+  void writeJson(std::ostream &os) const;
+};
@@ -1,54 +1,181 @@
 #include "timerservice.h"
-#include "simulation.h"
-#include <random>
+#include "checkpoint.h"
+#include "trace.h"
+#include <stdexcept>
 
-// Helper function to generate random mining durations
-Minutes randomDuration(Minutes min, Minutes max) {
-  // Use fixed seed to have a deterministic simulation
-  static std::mt19937 generator(0);
+TimerServiceBase::TimerServiceBase(EventQueueKind queueKind,
+                                   TieBreak tieBreak, Minutes horizon)
+    : events_{CalendarEventQueue{horizon, tieBreak}} {
+  if (queueKind == EventQueueKind::Multimap) {
+    // The multimap can only keep events with the same ts in FIFO order.
+    if (tieBreak != TieBreak::Fifo) {
+      throw std::invalid_argument(
+          "The multimap event queue only supports FIFO tie breaking");
+    }
+    events_.emplace<MultimapEventQueue>();
+  }
+}
 
-  // Create a uniform integer distribution between min and max (inclusive)
-  std::uniform_int_distribution<Minutes> distribution(min, max);
+void TimerServiceBase::reset() {
+  std::visit([](auto &q) { q.clear(); }, events_);
+  cancelled_.clear();
+  numCancelled_ = 0;
+  now_ = 0;
+  numDispatchedEvents_ = 0;
+}
 
-  // Generate and return the random number
-  return distribution(generator);
+size_t TimerServiceBase::numPendingEvents() const {
+  return std::visit([](const auto &q) { return q.size(); }, events_) -
+         numCancelled_;
 }
 
-void TimerService::scheduleEvent(MiningFinished evt) {
-  events_.insert({evt.ts_, SimulationEvent{evt}});
+size_t TimerServiceBase::EventHash::operator()(
+    const SimulationEvent &evt) const {
+  return std::visit(
+      [&evt](const auto &e) {
+        uint64_t h = static_cast<uint64_t>(e.ts_) * 0x9e3779b97f4a7c15ULL;
+        h ^= (static_cast<uint64_t>(e.truck_) << 2 | evt.index()) *
+             0xc2b2ae3d27d4eb4fULL;
+        if constexpr (!std::is_same_v<std::decay_t<decltype(e)>,
+                                      MiningFinished>) {
+          h ^= static_cast<uint64_t>(e.station_) * 0x165667b19e3779f9ULL;
+        }
+        return static_cast<size_t>(h ^ (h >> 29));
+      },
+      evt);
 }
 
-void TimerService::scheduleEvent(ArrivedAtStation evt) {
-  events_.insert({evt.ts_, SimulationEvent{evt}});
+bool TimerServiceBase::isPending(const SimulationEvent &evt) const {
+  size_t copies = 0;
+  std::visit(
+      [&evt, &copies](const auto &q) {
+        q.forEach([&evt, &copies](const SimulationEvent &e) {
+          copies += e == evt;
+        });
+      },
+      events_);
+  auto itr = cancelled_.find(evt);
+  return copies > (itr == cancelled_.end() ? 0 : itr->second);
 }
 
-void TimerService::scheduleEvent(UnloadingFinished evt) {
-  events_.insert({evt.ts_, SimulationEvent{evt}});
+void TimerServiceBase::cancelEvent(const EventHandle &handle) {
+#ifdef MININGSIM_CHECK_EVENTS
+  assert(isPending(handle.evt_));
+#endif
+  cancelled_[handle.evt_]++;
+  numCancelled_++;
 }
 
-// Picks the next event to dispatch. Each event has a compile-time-known
-// handler that is invoked when the event happens. Before the event
-// handler is invoked, time is advanced.
-bool TimerService::dispatchNextEvent() {
-  auto itr = events_.begin();
-  if (itr != events_.end()) {
-    SimulationEvent &evt = itr->second;
-    if (MiningFinished *e = std::get_if<MiningFinished>(&evt)) {
-      assert(e->ts_ == itr->first);
-      now_ = e->ts_;
-      simulation_->onMiningFinished(e->ts_, e->truck_);
-    } else if (ArrivedAtStation *e = std::get_if<ArrivedAtStation>(&evt)) {
-      assert(e->ts_ == itr->first);
-      now_ = e->ts_;
-      simulation_->onArrivedAtStation(e->ts_, e->truck_, e->station_);
-    } else {
-      UnloadingFinished *u = std::get_if<UnloadingFinished>(&evt);
-      assert(u && u->ts_ == itr->first);
-      now_ = u->ts_;
-      simulation_->onUnloadingFinished(u->ts_, u->truck_, u->station_);
+EventHandle TimerServiceBase::rescheduleEvent(const EventHandle &handle,
+                                              timepoint_t ts) {
+  assert(ts >= now_);
+  cancelEvent(handle);
+  SimulationEvent evt = handle.evt_;
+  std::visit([ts](Event &e) { e.ts_ = ts; }, evt);
+  return schedule(evt);
+}
+
+bool TimerServiceBase::dropCancelled(const SimulationEvent &evt) {
+  auto itr = cancelled_.find(evt);
+  if (itr == cancelled_.end()) {
+    return false;
+  }
+  if (--itr->second == 0) {
+    cancelled_.erase(itr);
+  }
+  numCancelled_--;
+  return true;
+}
+
+bool TimerServiceBase::popNextEvent(timepoint_t end, SimulationEvent &evt) {
+  // Costs one predictable branch per event unless events were cancelled.
+  do {
+    if (!std::visit([end, &evt](auto &q) { return q.popBefore(end, evt); },
+                    events_)) {
+      return false;
+    }
+  } while (numCancelled_ > 0 && dropCancelled(evt));
+  assert(eventTs(evt) >= now_);
+  now_ = eventTs(evt);
+  numDispatchedEvents_++;
+  instrument::countEvent(evt.index());
+  if (trace_) {
+    trace_->record(evt);
+  }
+  return true;
+}
+
+// Each event is written as its type, ts, truck and station (or kNoStation).
+// Cancelled events are left out, so a restored queue has none. The copies
+// that are dropped are the ones that would have been dropped when popped.
+void TimerServiceBase::checkpoint(CheckpointWriter &out) const {
+  out.write(now_);
+  out.write(numDispatchedEvents_);
+  out.write<uint64_t>(numPendingEvents());
+  auto cancelled = cancelled_;
+  std::visit(
+      [&out, &cancelled](const auto &q) {
+        q.forEach([&out, &cancelled](const SimulationEvent &evt) {
+          if (!cancelled.empty()) {
+            auto itr = cancelled.find(evt);
+            if (itr != cancelled.end()) {
+              if (--itr->second == 0) {
+                cancelled.erase(itr);
+              }
+              return;
+            }
+          }
+          out.write<uint8_t>(evt.index());
+          std::visit(
+              [&out](const auto &e) {
+                out.write(e.ts_);
+                out.write(e.truck_);
+                if constexpr (std::is_same_v<std::decay_t<decltype(e)>,
+                                             MiningFinished>) {
+                  out.write(kNoStation);
+                } else {
+                  out.write(e.station_);
+                }
+              },
+              evt);
+        });
+      },
+      events_);
+}
+
+// Pushing the events in the order they were written keeps events with the
+// same ts in their FIFO order. Under TieBreak::ById they are sorted again
+// when their minute comes.
+void TimerServiceBase::restore(CheckpointReader &in, size_t numTrucks,
+                               size_t numStations) {
+  now_ = in.read<timepoint_t>();
+  numDispatchedEvents_ = in.read<uint64_t>();
+  std::visit([this](auto &q) { q.clear(now_); }, events_);
+  cancelled_.clear();
+  numCancelled_ = 0;
+  uint64_t numEvents = in.read<uint64_t>();
+  for (uint64_t i = 0; i < numEvents; i++) {
+    uint8_t type = in.read<uint8_t>();
+    timepoint_t ts = in.read<timepoint_t>();
+    TruckId truck = in.read<TruckId>();
+    StationId station = in.read<StationId>();
+    if (ts < now_ || truck >= numTrucks ||
+        (type != 0 && station >= numStations)) {
+      throw std::runtime_error("Corrupt checkpoint");
+    }
+    // The type is the index in SimulationEvent.
+    switch (type) {
+    case 0:
+      schedule(SimulationEvent{MiningFinished{{ts}, truck}});
+      break;
+    case 1:
+      schedule(SimulationEvent{ArrivedAtStation{{ts}, truck, station}});
+      break;
+    case 2:
+      schedule(SimulationEvent{UnloadingFinished{{ts}, truck, station}});
+      break;
+    default:
+      throw std::runtime_error("Corrupt checkpoint");
     }
-    events_.erase(itr);
-    return true;
   }
-  return false;
 }
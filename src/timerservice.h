@@ -1,82 +1,227 @@
 #pragma once
-#include <inttypes.h>
-#include <map>
+#include "eventqueue.h"
+#include "events.h"
+#include "instrument.h"
+#include "random.h"
+#include <type_traits>
+#include <unordered_map>
 #include <variant>
+#include <vector>
 
-//////////////////////////////////////////////////////////////////////////////
-// Some helper types for simulated time
-using timepoint_t = int64_t;
-using Minutes = int;
+class CheckpointReader;
+class CheckpointWriter;
+class TraceWriter;
 
-static constexpr Minutes kUnloadingDuration = Minutes{5};
-static constexpr Minutes kDrivingDuration = Minutes{30};
-static constexpr Minutes kMiningDurationMin = Minutes{60};
-static constexpr Minutes kMiningDurationMax = Minutes{60 * 5};
-static constexpr Minutes kSimDuration = Minutes{60 * 24 * 3};
-
-class Truck;
-struct Station;
-
-////////////////////////////////////
-
-Minutes randomDuration(Minutes min, Minutes max);
-
-////////////////////////////////////
-// These are the events of interest within the simulation. The timer service
-// is "event aware" in the sense that the handler for an event is
-// not stored within the event (via say a virtual member function dispatch)
-// but is instead known to the TimerService. See TimerService::dispatchNextEvent
-// for more details.
-
-// Base class for all events. It stores the ts at which the event happened/
-// will happen.
-struct Event {
-  timepoint_t ts_;
-  bool operator==(const Event &) const = default;
-};
-
-struct MiningFinished : Event {
-  Truck *truck_;
-  bool operator==(const MiningFinished &) const = default;
-};
+///////////////////////////////////////////////////////////////////////////
 
-struct ArrivedAtStation : Event {
-  Truck *truck_;
-  Station *station_;
-  bool operator==(const ArrivedAtStation &) const = default;
-};
+// Identifies a pending event, so that it can be cancelled or moved, see
+// TimerServiceBase::cancelEvent. Events are plain values that say which truck
+// they are about, so the event itself serves as its handle: handles take no
+// space in the event queue, and taking one costs nothing.
+class EventHandle {
+  SimulationEvent evt_;
+  friend class TimerServiceBase;
 
-struct UnloadingFinished : Event {
-  Truck *truck_;
-  Station *station_;
-  bool operator==(const UnloadingFinished &) const = default;
+public:
+  explicit EventHandle(const SimulationEvent &evt) : evt_{evt} {}
+  const SimulationEvent &event() const { return evt_; }
+  timepoint_t ts() const { return eventTs(evt_); }
+  bool operator==(const EventHandle &) const = default;
 };
 
-// A variant type to store all the three events.
-using SimulationEvent =
-    std::variant<MiningFinished, ArrivedAtStation, UnloadingFinished>;
-
-///////////////////////////////////////////////////////////////////////////
-
-class SimulationBase;
-
-// TimerService is used to schedule events to happen at specified timepoints
-// events are stored in a multimap. After an event's handler is invoked,
-// the next event is immediately dispatched. When an event "happens", the
-// TimerService's time is advanced to that event's timestamp.
-class TimerService {
+// TimerServiceBase holds the pending events, which are stored in an event
+// queue (see eventqueue.h), and the current simulated time. Events are
+// scheduled to happen at specified timepoints, and when an event "happens",
+// time is advanced to that event's timestamp. It does not know what to do with
+// an event, which lets it be used on its own by owners that handle the events
+// they pull with popNextEvent() themselves.
+class TimerServiceBase {
+protected:
   timepoint_t now_ = 0;
-  SimulationBase *simulation_ = nullptr;
-  std::multimap<timepoint_t, SimulationEvent> events_;
+  std::variant<CalendarEventQueue, MultimapEventQueue> events_;
+  uint64_t numDispatchedEvents_ = 0;
+  TraceWriter *trace_ = nullptr;
+
+private:
+  struct EventHash {
+    size_t operator()(const SimulationEvent &evt) const;
+  };
+  // Cancelled events that are still in the queue, each with the number of
+  // copies of it that were cancelled. Neither queue can erase from its
+  // middle, so a cancelled event is only dropped when it comes up (lazy
+  // deletion). Events with the same ts, truck, station and type are
+  // interchangeable, so it does not matter which copy is dropped.
+  std::unordered_map<SimulationEvent, uint32_t, EventHash> cancelled_;
+  size_t numCancelled_ = 0;
 
   void setNow(timepoint_t now) { now_ = now; }
+  // Inline since every handler schedules events.
+  EventHandle schedule(const SimulationEvent &evt) {
+    std::visit([&evt](auto &q) { q.push(evt); }, events_);
+    if constexpr (instrument::kEnabled) {
+      instrument::countPendingEvents(numPendingEvents());
+    }
+    return EventHandle{evt};
+  }
+  // Whether evt is cancelled, in which case one cancelled copy is used up.
+  bool dropCancelled(const SimulationEvent &evt);
+  // Whether an event that is not cancelled is pending. Walks the queue, so
+  // cancelEvent only asserts on it when built with MININGSIM_CHECK_EVENTS.
+  bool isPending(const SimulationEvent &evt) const;
   friend class StationsTest_StationEta_Test;
 
 public:
-  TimerService(SimulationBase *sim) : simulation_{sim} {}
+  // horizon sizes the calendar queue, see CalendarEventQueue.
+  explicit TimerServiceBase(EventQueueKind queueKind = EventQueueKind::Calendar,
+                            TieBreak tieBreak = TieBreak::Fifo,
+                            Minutes horizon = kMiningDurationMax);
   timepoint_t now() const { return now_; }
-  void scheduleEvent(MiningFinished);
-  void scheduleEvent(ArrivedAtStation);
-  void scheduleEvent(UnloadingFinished);
-  bool dispatchNextEvent();
-};
\ No newline at end of file
+  // Schedules an event, and returns the handle to cancel or move it by.
+  EventHandle scheduleEvent(MiningFinished evt) {
+    return schedule(SimulationEvent{evt});
+  }
+  EventHandle scheduleEvent(ArrivedAtStation evt) {
+    return schedule(SimulationEvent{evt});
+  }
+  EventHandle scheduleEvent(UnloadingFinished evt) {
+    return schedule(SimulationEvent{evt});
+  }
+  // Cancels a pending event, e.g. the arrival of a truck at a station that
+  // went down on its way there. O(1): the event stays in the queue until it
+  // comes up, and is then dropped without being dispatched. Cancelling an
+  // event that has already been dispatched or cancelled is a bug, which is
+  // only asserted on when built with cmake -DMININGSIM_CHECK_EVENTS=ON, since
+  // the check walks the whole event queue.
+  void cancelEvent(const EventHandle &handle);
+  // Moves a pending event to ts, which must not be before now (or, under
+  // TieBreak::ById with the calendar queue, be now). Same as cancelling it
+  // and scheduling it again at ts, e.g. to hold up an unloading while a
+  // station is broken down. Returns the handle of the moved event.
+  EventHandle rescheduleEvent(const EventHandle &handle, timepoint_t ts);
+  // Removes the next event into evt if it happens before end, and advances
+  // time to it. Cancelled events are skipped. Returns false if there is no
+  // such event.
+  bool popNextEvent(timepoint_t end, SimulationEvent &evt);
+  // The events that will still be dispatched, i.e. not counting cancelled
+  // ones.
+  size_t numPendingEvents() const;
+  // Drops all pending events and moves time back to 0, keeping the memory
+  // held by the event queue.
+  void reset();
+  // Number of events that have happened so far.
+  uint64_t numDispatchedEvents() const { return numDispatchedEvents_; }
+  // Writes the current time and the pending events, in the order in which
+  // they would be dispatched, to a checkpoint, and reads them back (see
+  // checkpoint.h). Restoring replaces all pending events and throws
+  // std::runtime_error if an event refers to a truck or station beyond
+  // numTrucks or numStations.
+  void checkpoint(CheckpointWriter &out) const;
+  void restore(CheckpointReader &in, size_t numTrucks, size_t numStations);
+  // Records every event from now on to trace as it happens, or stops
+  // recording if trace is null. Not recording costs one predictable branch
+  // per event.
+  void setTrace(TraceWriter *trace) { trace_ = trace; }
+};
+
+// TimerService also dispatches the events to their handlers. After an event's
+// handler is invoked, the next event is immediately dispatched. The handlers
+// are members of Handler, which is known at compile time, so that they can be
+// inlined into the dispatch loop rather than be called through a vtable.
+// Handler is normally the simulation, which also resolves the ids in the
+// events to its Truck/Station objects, see SimulationBase.
+template <class Handler> class TimerService : public TimerServiceBase {
+  Handler *handler_;
+  // The events of the minute being dispatched by dispatchNextBatch(), grouped
+  // by type. Kept across calls so that they do not have to be reallocated.
+  std::vector<UnloadingFinished> unloadingFinishedBatch_;
+  std::vector<ArrivedAtStation> arrivedAtStationBatch_;
+  std::vector<MiningFinished> miningFinishedBatch_;
+
+public:
+  TimerService(Handler *handler,
+               EventQueueKind queueKind = EventQueueKind::Calendar,
+               TieBreak tieBreak = TieBreak::Fifo,
+               Minutes horizon = kMiningDurationMax)
+      : TimerServiceBase{queueKind, tieBreak, horizon}, handler_{handler} {}
+
+  // Picks the next event to dispatch if it happens before end. Each event
+  // has a compile-time-known handler that is invoked when the event happens.
+  // Before the event handler is invoked, time is advanced and the ids in the
+  // event are resolved to the Truck/Station objects held by the simulation.
+  // Returns false if there is no event before end.
+  bool dispatchNextEvent(timepoint_t end = kEndOfTime) {
+    // The event is copied out of the queue since the handler will schedule
+    // further events into it.
+    SimulationEvent evt;
+    if (!popNextEvent(end, evt)) {
+      return false;
+    }
+    instrument::HandlerTimer timer{evt.index()};
+    std::visit(
+        [this](const auto &e) {
+          using E = std::decay_t<decltype(e)>;
+          if constexpr (std::is_same_v<E, MiningFinished>) {
+            handler_->onMiningFinished(e.ts_, handler_->truck(e.truck_));
+          } else if constexpr (std::is_same_v<E, ArrivedAtStation>) {
+            handler_->onArrivedAtStation(e.ts_, handler_->truck(e.truck_),
+                                         handler_->station(e.station_));
+          } else {
+            handler_->onUnloadingFinished(e.ts_, handler_->truck(e.truck_),
+                                          handler_->station(e.station_));
+          }
+        },
+        evt);
+    return true;
+  }
+
+  // Dispatches all events that happen at the ts of the next event, provided
+  // that it is before end. The events are grouped by type, and each group is
+  // passed to its batch handler in one call: first UnloadingFinished, then
+  // ArrivedAtStation and then MiningFinished. Within a group, events keep
+  // the order in which they would be dispatched one at a time. Returns false
+  // if there is no event before end.
+  //
+  // This changes the order of events with the same ts on the same station, so
+  // it only gives the same results as dispatchNextEvent() under
+  // TieBreak::ById (see SimulationConfig::batchDispatch).
+  bool dispatchNextBatch(timepoint_t end) {
+    SimulationEvent evt;
+    if (!popNextEvent(end, evt)) {
+      return false;
+    }
+    timepoint_t ts = now_;
+    do {
+      std::visit(
+          [this](const auto &e) {
+            using E = std::decay_t<decltype(e)>;
+            if constexpr (std::is_same_v<E, MiningFinished>) {
+              miningFinishedBatch_.push_back(e);
+            } else if constexpr (std::is_same_v<E, ArrivedAtStation>) {
+              arrivedAtStationBatch_.push_back(e);
+            } else {
+              unloadingFinishedBatch_.push_back(e);
+            }
+          },
+          evt);
+    } while (popNextEvent(ts + 1, evt));
+
+    // The handlers only schedule events after ts, so the batches cannot grow
+    // while they are being handled.
+    if (!unloadingFinishedBatch_.empty()) {
+      instrument::HandlerTimer timer{instrument::eventType<UnloadingFinished>};
+      handler_->onUnloadingFinishedBatch(ts, unloadingFinishedBatch_);
+      unloadingFinishedBatch_.clear();
+    }
+    if (!arrivedAtStationBatch_.empty()) {
+      instrument::HandlerTimer timer{instrument::eventType<ArrivedAtStation>};
+      handler_->onArrivedAtStationBatch(ts, arrivedAtStationBatch_);
+      arrivedAtStationBatch_.clear();
+    }
+    if (!miningFinishedBatch_.empty()) {
+      instrument::HandlerTimer timer{instrument::eventType<MiningFinished>};
+      handler_->onMiningFinishedBatch(ts, miningFinishedBatch_);
+      miningFinishedBatch_.clear();
+    }
+    return true;
+  }
+};
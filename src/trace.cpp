@@ -0,0 +1,154 @@
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::runtime_error systemError(const std::string &what,
+                               const std::string &path) {
+  return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+// Writes all of [data, data + size), retrying short writes.
+bool writeAll(int fd, const void *data, size_t size) {
+  const char *pos = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t written = ::write(fd, pos, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    pos += written;
+    size -= written;
+  }
+  return true;
+}
+
+} // namespace
+
+const char *traceEventTypeName(TraceEventType type) {
+  switch (type) {
+  case TraceEventType::MiningFinished:
+    return "MiningFinished";
+  case TraceEventType::ArrivedAtStation:
+    return "ArrivedAtStation";
+  case TraceEventType::UnloadingFinished:
+    return "UnloadingFinished";
+  }
+  return "Unknown";
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+TraceWriter::TraceWriter(const std::string &path, size_t bufferCapacity)
+    : buffer_{std::make_unique<TraceRecord[]>(std::max<size_t>(bufferCapacity,
+                                                               1))},
+      bufferCapacity_{std::max<size_t>(bufferCapacity, 1)} {
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    throw systemError("Cannot create trace", path);
+  }
+  TraceHeader header{.version_ = TraceHeader::kVersion,
+                     .recordSize_ = sizeof(TraceRecord)};
+  std::copy(std::begin(TraceHeader::kMagic), std::end(TraceHeader::kMagic),
+            header.magic_);
+  if (!writeAll(fd_, &header, sizeof(header))) {
+    ::close(fd_);
+    throw systemError("Cannot write trace", path);
+  }
+}
+
+TraceWriter::~TraceWriter() {
+  writeBuffer();
+  ::close(fd_);
+}
+
+bool TraceWriter::writeBuffer() {
+  bool ok = writeAll(fd_, buffer_.get(), bufferSize_ * sizeof(TraceRecord));
+  numRecords_ += bufferSize_;
+  bufferSize_ = 0;
+  return ok;
+}
+
+void TraceWriter::flush() {
+  if (!writeBuffer()) {
+    throw std::runtime_error(std::string{"Cannot write trace: "} +
+                             std::strerror(errno));
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+TraceReader::TraceReader(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw systemError("Cannot open trace", path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) < 0) {
+    ::close(fd);
+    throw systemError("Cannot stat trace", path);
+  }
+  size_ = st.st_size;
+  if (size_ < sizeof(TraceHeader)) {
+    ::close(fd);
+    throw std::runtime_error("Not a trace: " + path);
+  }
+  data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the file is closed.
+  ::close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw systemError("Cannot map trace", path);
+  }
+
+  const TraceHeader *header = static_cast<const TraceHeader *>(data_);
+  if (!std::equal(std::begin(TraceHeader::kMagic),
+                  std::end(TraceHeader::kMagic), header->magic_) ||
+      header->version_ != TraceHeader::kVersion ||
+      header->recordSize_ != sizeof(TraceRecord) ||
+      (size_ - sizeof(TraceHeader)) % sizeof(TraceRecord) != 0) {
+    ::munmap(data_, size_);
+    throw std::runtime_error("Not a trace or an incompatible one: " + path);
+  }
+  // mmap returns page aligned memory and the header keeps the records
+  // aligned.
+  static_assert(sizeof(TraceHeader) % alignof(TraceRecord) == 0);
+  records_ = {reinterpret_cast<const TraceRecord *>(header + 1),
+              (size_ - sizeof(TraceHeader)) / sizeof(TraceRecord)};
+  // Readers index by the type, so a corrupt one must not get through.
+  for (const TraceRecord &r : records_) {
+    if (static_cast<size_t>(r.type_) >= std::variant_size_v<SimulationEvent>) {
+      ::munmap(data_, size_);
+      data_ = nullptr;
+      throw std::runtime_error("Not a trace or an incompatible one: " + path);
+    }
+  }
+  // The records are mostly read front to back.
+  ::madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+TraceReader::~TraceReader() {
+  if (data_) {
+    ::munmap(data_, size_);
+  }
+}
+
+std::span<const TraceRecord> TraceReader::between(timepoint_t from,
+                                                  timepoint_t to) const {
+  auto begin = std::partition_point(
+      records_.begin(), records_.end(),
+      [from](const TraceRecord &r) { return timepoint_t{r.ts_} < from; });
+  auto end = std::partition_point(
+      begin, records_.end(),
+      [to](const TraceRecord &r) { return timepoint_t{r.ts_} < to; });
+  return {begin, end};
+}
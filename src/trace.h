@@ -0,0 +1,120 @@
+#pragma once
+#include "events.h"
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <variant>
+
+//////////////////////////////////////////////////////////////////////////////
+// A trace is a binary file of every event that a TimerService dispatched, in
+// the order they were dispatched (and hence in ts order). It starts with a
+// TraceHeader, followed by fixed size TraceRecords in the native byte order.
+// Since the records are plain data they are read by mapping the file into
+// memory and viewing it as an array of records, without any parsing.
+
+// The type of a traced event, which is its index in SimulationEvent.
+enum class TraceEventType : uint8_t {
+  MiningFinished,
+  ArrivedAtStation,
+  UnloadingFinished
+};
+
+struct TraceRecord {
+  // Simulated time starts at 0 and runs for an int number of Minutes, so that
+  // 32 bits are enough. This keeps a record at 16 bytes.
+  uint32_t ts_;
+  TruckId truck_;
+  StationId station_;
+  TraceEventType type_;
+  // Always zero, so that the whole record is written out as set and traces
+  // of identical runs are identical files.
+  uint8_t padding_[3] = {};
+  bool operator==(const TraceRecord &) const = default;
+};
+static_assert(std::is_trivially_copyable_v<TraceRecord>);
+static_assert(sizeof(TraceRecord) == 16);
+
+struct TraceHeader {
+  static constexpr char kMagic[8] = {'M', 'S', 'T', 'R', 'A', 'C', 'E', 0};
+  static constexpr uint32_t kVersion = 1;
+  char magic_[8];
+  uint32_t version_;
+  uint32_t recordSize_;
+};
+
+// Inline since it is called for every traced event.
+inline TraceRecord toTraceRecord(const SimulationEvent &evt) {
+  return std::visit(
+      [&evt](const auto &e) {
+        assert(e.ts_ >= 0 && e.ts_ <= std::numeric_limits<uint32_t>::max());
+        TraceRecord record{.ts_ = static_cast<uint32_t>(e.ts_),
+                           .truck_ = e.truck_,
+                           .station_ = kNoStation,
+                           .type_ = static_cast<TraceEventType>(evt.index())};
+        if constexpr (!std::is_same_v<std::decay_t<decltype(e)>,
+                                      MiningFinished>) {
+          record.station_ = e.station_;
+        }
+        return record;
+      },
+      evt);
+}
+
+const char *traceEventTypeName(TraceEventType type);
+
+// Appends the events passed to record() to a trace file. Records are
+// collected in a buffer that is written out whenever it is full, so tracing
+// costs one copy of the event per event plus the sequential writes. Throws
+// std::runtime_error if the file cannot be written.
+class TraceWriter {
+  int fd_ = -1;
+  std::unique_ptr<TraceRecord[]> buffer_;
+  size_t bufferSize_ = 0;
+  size_t bufferCapacity_;
+  uint64_t numRecords_ = 0;
+
+  bool writeBuffer();
+
+public:
+  explicit TraceWriter(const std::string &path,
+                       size_t bufferCapacity = 4096);
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+  // Writes out the buffered records, ignoring errors. Call flush() first to
+  // find out about them.
+  ~TraceWriter();
+
+  void record(const SimulationEvent &evt) {
+    buffer_[bufferSize_++] = toTraceRecord(evt);
+    if (bufferSize_ == bufferCapacity_) {
+      flush();
+    }
+  }
+  // Writes out the buffered records.
+  void flush();
+  // Number of records so far, including buffered ones.
+  uint64_t numRecords() const { return numRecords_ + bufferSize_; }
+};
+
+// Maps a trace file into memory read-only. Throws std::runtime_error if the
+// file cannot be mapped or is not a trace, which includes a record of an
+// unknown event type.
+class TraceReader {
+  void *data_ = nullptr;
+  size_t size_ = 0;
+  std::span<const TraceRecord> records_;
+
+public:
+  explicit TraceReader(const std::string &path);
+  TraceReader(const TraceReader &) = delete;
+  TraceReader &operator=(const TraceReader &) = delete;
+  ~TraceReader();
+
+  std::span<const TraceRecord> records() const { return records_; }
+  // The records with from <= ts < to, found by binary search.
+  std::span<const TraceRecord> between(timepoint_t from, timepoint_t to) const;
+};
@@ -0,0 +1,104 @@
+#include "trace.h"
+#include <algorithm>
+#include <array>
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <optional>
+
+namespace po = boost::program_options;
+
+// Replays a trace written by simulator --trace, printing the events that
+// match the given filters one per line, or summarizes it.
+int main(int argc, char **argv) {
+  std::string path;
+  int64_t truck = -1;
+  int64_t station = -1;
+  std::string type;
+  timepoint_t from = 0;
+  timepoint_t to = kEndOfTime;
+  bool summary = false;
+  try {
+    po::options_description desc{"Options"};
+    desc.add_options()("help,h", "help screen")(
+        "trace", po::value<std::string>(&path), "Trace file to read")(
+        "truck", po::value<int64_t>(&truck), "Only events of this truck")(
+        "station", po::value<int64_t>(&station),
+        "Only events at this station")(
+        "type", po::value<std::string>(&type),
+        "Only events of this type: MiningFinished, ArrivedAtStation or "
+        "UnloadingFinished")(
+        "from", po::value<timepoint_t>(&from),
+        "Only events at or after this ts")(
+        "to", po::value<timepoint_t>(&to), "Only events before this ts")(
+        "summary", po::bool_switch(&summary),
+        "Print the number of matching events per type instead of the "
+        "events");
+    po::positional_options_description positional;
+    positional.add("trace", 1);
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv)
+                  .options(desc)
+                  .positional(positional)
+                  .run(),
+              vm);
+    po::notify(vm);
+
+    std::optional<TraceEventType> typeFilter;
+    for (auto t :
+         {TraceEventType::MiningFinished, TraceEventType::ArrivedAtStation,
+          TraceEventType::UnloadingFinished}) {
+      if (type == traceEventTypeName(t)) {
+        typeFilter = t;
+      }
+    }
+    if (vm.count("help") || path.empty() || (!type.empty() && !typeFilter)) {
+      std::cout << "Usage: tracetool [options] trace" << std::endl;
+      std::cout << desc << std::endl;
+      return 0;
+    }
+
+    TraceReader reader{path};
+    // The records are in ts order, so the time filter narrows down the
+    // records to look at rather than being checked on each of them.
+    std::array<uint64_t, 3> counts = {};
+    timepoint_t firstTs = kEndOfTime;
+    timepoint_t lastTs = 0;
+    for (const TraceRecord &r : reader.between(from, to)) {
+      if ((truck >= 0 && r.truck_ != truck) ||
+          (station >= 0 && r.station_ != station) ||
+          (typeFilter && r.type_ != *typeFilter)) {
+        continue;
+      }
+      if (summary) {
+        counts[static_cast<size_t>(r.type_)]++;
+        firstTs = std::min<timepoint_t>(firstTs, r.ts_);
+        lastTs = std::max<timepoint_t>(lastTs, r.ts_);
+        continue;
+      }
+      std::cout << r.ts_ << "\t" << traceEventTypeName(r.type_) << "\ttruck "
+                << r.truck_;
+      if (r.station_ != kNoStation) {
+        std::cout << "\tstation " << r.station_;
+      }
+      std::cout << "\n";
+    }
+
+    if (summary) {
+      std::cout << "Trace of " << reader.records().size() << " events"
+                << std::endl;
+      uint64_t total = counts[0] + counts[1] + counts[2];
+      std::cout << "Matching events: " << total;
+      if (total > 0) {
+        std::cout << " from ts " << firstTs << " to " << lastTs;
+      }
+      std::cout << std::endl;
+      for (size_t t = 0; t < counts.size(); t++) {
+        std::cout << "\t" << traceEventTypeName(static_cast<TraceEventType>(t))
+                  << "\t" << counts[t] << std::endl;
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,66 @@
+#include "travel.h"
+#include <algorithm>
+#include <charconv>
+#include <istream>
+#include <stdexcept>
+#include <string>
+
+TravelTimes::TravelTimes(const std::vector<std::vector<Minutes>> &rows) {
+  if (rows.empty() || rows.front().empty()) {
+    throw std::invalid_argument("Travel times need at least one station");
+  }
+  if (rows.size() > static_cast<size_t>(kMaxZones)) {
+    throw std::invalid_argument("Too many zones");
+  }
+  numZones_ = rows.size();
+  numStations_ = rows.front().size();
+  minutes_.reserve(static_cast<size_t>(numZones_) * numStations_);
+  for (const std::vector<Minutes> &row : rows) {
+    if (row.size() != static_cast<size_t>(numStations_)) {
+      throw std::invalid_argument(
+          "Every zone needs a drive time to every station");
+    }
+    for (Minutes m : row) {
+      if (m <= 0) {
+        throw std::invalid_argument("Drive times must be positive");
+      }
+    }
+    minutes_.insert(minutes_.end(), row.begin(), row.end());
+  }
+}
+
+TravelTimes TravelTimes::parseCsv(std::istream &is) {
+  std::vector<std::vector<Minutes>> rows;
+  std::string line;
+  while (std::getline(is, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    std::vector<Minutes> &row = rows.emplace_back();
+    const char *pos = line.data();
+    const char *end = line.data() + line.size();
+    // Every field must be a number, separated by single commas.
+    while (true) {
+      Minutes m = 0;
+      auto [ptr, ec] = std::from_chars(pos, end, m);
+      if (ec != std::errc{}) {
+        throw std::invalid_argument("Malformed travel times: " + line);
+      }
+      row.push_back(m);
+      pos = ptr;
+      if (pos == end) {
+        break;
+      }
+      if (*pos != ',') {
+        throw std::invalid_argument("Malformed travel times: " + line);
+      }
+      pos++;
+    }
+  }
+  return TravelTimes{rows};
+}
+
+Minutes TravelTimes::longest() const {
+  return minutes_.empty() ? 0
+                          : *std::max_element(minutes_.begin(), minutes_.end());
+}
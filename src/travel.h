@@ -0,0 +1,44 @@
+#pragma once
+#include "events.h"
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+// The drive times from every mining zone to every station, for sites where
+// the stations are not all durations.driving away from the trucks. Each
+// truck mines in one zone, assigned round robin: truck t in zone
+// t % numZones(). A simulation without travel times (empty()) has every
+// station durations.driving away from every truck.
+class TravelTimes {
+  int numZones_ = 0;
+  int numStations_ = 0;
+  // Row major, one row of numStations_ per zone.
+  std::vector<Minutes> minutes_;
+
+public:
+  // The most zones a simulation can have, since a Truck keeps its zone in 16
+  // bits.
+  static constexpr int kMaxZones = UINT16_MAX + 1;
+
+  TravelTimes() = default;
+  // One row per zone, each with the drive time to every station. Throws
+  // std::invalid_argument if there are no stations, the rows differ in
+  // length, there are more than kMaxZones of them or a drive time is not
+  // positive.
+  explicit TravelTimes(const std::vector<std::vector<Minutes>> &rows);
+  // Reads rows of comma separated drive times, one line per zone. Throws
+  // std::invalid_argument if the text is malformed or as above.
+  static TravelTimes parseCsv(std::istream &is);
+
+  bool empty() const { return numZones_ == 0; }
+  int numZones() const { return numZones_; }
+  int numStations() const { return numStations_; }
+  Minutes at(int zone, StationId station) const {
+    return minutes_[static_cast<size_t>(zone) * numStations_ + station];
+  }
+  int zoneOf(TruckId truck) const { return truck % numZones_; }
+  // The longest drive time, or 0 if empty.
+  Minutes longest() const;
+  const std::vector<Minutes> &minutes() const { return minutes_; }
+  bool operator==(const TravelTimes &) const = default;
+};
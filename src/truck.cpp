@@ -1,11 +1,15 @@
 #include "truck.h"
+#include "checkpoint.h"
 #include "simulation.h"
 #include <iomanip>
 #include <iostream>
 
-Truck::Truck(int id) : id_{id} {}
+Truck::Truck(TruckId id, uint16_t zone, uint8_t truckClass,
+             Minutes unloadingDuration)
+    : id_{id}, class_{truckClass}, zone_{zone},
+      unloadingDuration_{unloadingDuration} {}
 
-Truck::Truck(int id, State st, Station *unloadingStation)
+Truck::Truck(TruckId id, State st, Station *unloadingStation)
     : id_{id}, state_{st}, unloadingStation_{unloadingStation} {
   for (auto &duration : stateDurations_) {
     duration = 0;
@@ -15,6 +19,7 @@ Truck::Truck(int id, State st, Station *unloadingStation)
 void Truck::startMining(timepoint_t now, timepoint_t end) {
   assert(state_ == Unloading);
   state_ = Mining;
+  miningCycles_++;
   unloadingStation_ = nullptr;
   stateEntryTs_ = now;
   stateExitTs_ = end;
@@ -22,14 +27,15 @@ void Truck::startMining(timepoint_t now, timepoint_t end) {
 }
 
 void Truck::proceedToUnloadingStation(timepoint_t now,
-                                      Station *assignedUnloadingStation) {
+                                      Station *assignedUnloadingStation,
+                                      Minutes drivingDuration) {
   assert(state_ == Mining);
   assert(!unloadingStation_);
   unloadingStation_ = assignedUnloadingStation;
   state_ = Driving;
   stateEntryTs_ = now;
-  stateExitTs_ = now + kDrivingDuration;
-  stateDurations_[Driving] += kDrivingDuration;
+  stateExitTs_ = now + drivingDuration;
+  stateDurations_[Driving] += drivingDuration;
 }
 
 void Truck::unloadAtStation(timepoint_t now) {
@@ -37,8 +43,8 @@ void Truck::unloadAtStation(timepoint_t now) {
   assert(unloadingStation_);
   state_ = Unloading;
   stateEntryTs_ = now;
-  stateExitTs_ = now + kUnloadingDuration;
-  stateDurations_[Unloading] += kUnloadingDuration;
+  stateExitTs_ = now + unloadingDuration_;
+  stateDurations_[Unloading] += unloadingDuration_;
 }
 
 void Truck::waitAtStation(timepoint_t now) {
@@ -48,11 +54,12 @@ void Truck::waitAtStation(timepoint_t now) {
   stateEntryTs_ = now;
 
   assert(unloadingStation_->unloadingTruck_->state() == Truck::Unloading);
-  // Calculate wait time
+  // The truck starts unloading once the unloading truck and all the trucks
+  // ahead of it, whose unloading the station counts along with its own, are
+  // done.
   assert(unloadingStation_->waitingTrucks_.back() == this);
-  stateExitTs_ = unloadingStation_->unloadingTruck_->stateExitTs_;
-  stateExitTs_ +=
-      ((unloadingStation_->waitingTrucks_.size() - 1) * kUnloadingDuration);
+  stateExitTs_ = unloadingStation_->unloadingTruck_->stateExitTs_ +
+                 unloadingStation_->waitingUnloading_ - unloadingDuration_;
 
   stateDurations_[Waiting] += (stateExitTs_ - stateEntryTs_);
 }
@@ -61,11 +68,35 @@ const std::array<Minutes, 4> &Truck::retrieveStats() const {
   return stateDurations_;
 }
 
+void Truck::checkpoint(CheckpointWriter &out) const {
+  out.write(state_);
+  out.write(miningCycles_);
+  out.write(stateEntryTs_);
+  out.write(stateExitTs_);
+  out.write(unloadingStation_ ? unloadingStation_->id_ : kNoStation);
+  out.write(stateDurations_);
+}
+
+void Truck::restore(CheckpointReader &in, Stations &stations) {
+  assert(!nextInQueue_);
+  state_ = in.read<State>();
+  miningCycles_ = in.read<uint32_t>();
+  stateEntryTs_ = in.read<timepoint_t>();
+  stateExitTs_ = in.read<timepoint_t>();
+  StationId station = in.read<StationId>();
+  if (station != kNoStation && station >= stations.size()) {
+    throw std::runtime_error("Corrupt checkpoint");
+  }
+  unloadingStation_ =
+      station == kNoStation ? nullptr : stations.station(station);
+  stateDurations_ = in.read<std::array<Minutes, 4>>();
+}
+
 ////////////////////////////////////////////////////////////
 
 TrucksStats::TrucksStats() {
-  for (Stats &st : allTrucksStats_) {
-    st = Stats{};
+  for (RunningStats &st : allTrucksStats_) {
+    st = RunningStats{};
   }
   allTrucksStats_[Truck::Mining].name("Mining   ");
   allTrucksStats_[Truck::Driving].name("Driving  ");
@@ -80,16 +111,18 @@ void TrucksStats::absorbTruck(const std::array<Minutes, 4> &truckStats) {
   }
 }
 
-void TrucksStats::printStats() const {
+double TrucksStats::utilization() const {
   double mining = allTrucksStats_[Truck::Mining].total();
   double driving = allTrucksStats_[Truck::Driving].total();
   double waiting = allTrucksStats_[Truck::Waiting].total();
   double unloading = allTrucksStats_[Truck::Unloading].total();
+  return mining / (mining + driving + waiting + unloading);
+}
 
+void TrucksStats::printStats() const {
   std::cout << std::fixed;
   std::cout << std::setprecision(2);
-  std::cout << "Trucks avg utilization: "
-            << mining / (mining + driving + waiting + unloading)
+  std::cout << "Trucks avg utilization: " << utilization()
             << "; State breakdown:" << std::endl;
   std::cout << "\t\tAvg\t\tstddev\n";
   for (auto &st : allTrucksStats_) {
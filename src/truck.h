@@ -1,13 +1,18 @@
 #pragma once
 
+#include "stats.h"
 #include "timerservice.h"
 #include <array>
+#include <cassert>
 #include <cmath>
 #include <inttypes.h>
 #include <iomanip>
 #include <iostream>
 
 struct Station;
+class Stations;
+class CheckpointReader;
+class CheckpointWriter;
 
 // Represents one truck wihin the simulation
 class Truck {
@@ -18,36 +23,59 @@ public:
   //             |                     ^
   //             V                     |
   //           Waiting -----------------
-  enum State { Mining, Driving, Waiting, Unloading };
+  enum State : uint8_t { Mining, Driving, Waiting, Unloading };
 
 private:
-  // The truck ID.
-  int id_;
+  // The truck ID, which is also its index in the simulation's trucks.
+  TruckId id_;
   // The state of the truck.
   State state_ = Unloading;
+  // The class of the truck, see Fleet, and its mining zone, see TravelTimes.
+  // Kept in what would otherwise be padding.
+  uint8_t class_ = 0;
+  uint16_t zone_ = 0;
+  // Number of times this truck has started Mining.
+  uint32_t miningCycles_ = 0;
+  // How long the truck takes to unload, which depends on its class. Also in
+  // padding, so that a Truck stays within one cache line.
+  Minutes unloadingDuration_ = kUnloadingDuration;
   // The timepoints at which current state was entered/exited
   // Due to the specifics of this simulation, we are able
   // to always calculate the exit ts based on the entry ts of the
   // state.
-  timepoint_t stateEntryTs_;
-  timepoint_t stateExitTs_;
+  timepoint_t stateEntryTs_ = 0;
+  timepoint_t stateExitTs_ = 0;
   // Is null when in Mining state. In all other states, it is the
   // assigned unloading station for this round of unloading.
   Station *unloadingStation_ = nullptr;
-
-  // Track total time spent in each of the 4 states
+  // The truck behind this one in the station queue that it is in, see
+  // TruckQueue.
+  Truck *nextInQueue_ = nullptr;
+
+  // Track total time spent in each of the 4 states. Although these are only
+  // read once at the end of the simulation, one of them is updated on every
+  // state transition, so they are kept next to the rest of the state rather
+  // than in a separate array that would cost a second cache miss per event.
   std::array<Minutes, 4> stateDurations_ = {};
 
+  friend class TruckQueue;
   friend class TrucksTest_TruckLifecycle_Test;
+  friend class TrucksTest_QueueByExitTs_Test;
   friend class StationsTest_StationEta_Test;
   friend class StationsTest_StationEta2_Test;
 
 public:
   // Start off as if we have just finished unloading and are about to start
   // mining
-  Truck(int id);
-  Truck(int id, State st, Station *unloadingStation);
+  Truck(TruckId id, uint16_t zone = 0, uint8_t truckClass = 0,
+        Minutes unloadingDuration = kUnloadingDuration);
+  Truck(TruckId id, State st, Station *unloadingStation);
+  TruckId id() const { return id_; }
   State state() const { return state_; }
+  uint8_t truckClass() const { return class_; }
+  uint16_t zone() const { return zone_; }
+  Minutes unloadingDuration() const { return unloadingDuration_; }
+  uint32_t miningCycles() const { return miningCycles_; }
   Station *unloadingStation() { return unloadingStation_; }
   timepoint_t stateEntryTs() const { return stateEntryTs_; }
   timepoint_t stateExitTs() const { return stateExitTs_; }
@@ -57,61 +85,137 @@ public:
   // Trucks and Stations.
   void startMining(timepoint_t now, timepoint_t end);
   void proceedToUnloadingStation(timepoint_t now,
-                                 Station *assignedUnloadingStation);
+                                 Station *assignedUnloadingStation,
+                                 Minutes drivingDuration);
   void unloadAtStation(timepoint_t now);
   void waitAtStation(timepoint_t now);
 
   // This function retrieves the cumulative times spent in each state so far by
   // this truck.
   const std::array<Minutes, 4> &retrieveStats() const;
+
+  // Writes the state of the truck to a checkpoint, and reads it back with its
+  // station resolved through stations (see checkpoint.h). The truck must not
+  // be in a station queue. The queues are restored by the stations.
+  void checkpoint(CheckpointWriter &out) const;
+  void restore(CheckpointReader &in, Stations &stations);
 };
 
 /////////////////////////////////////////////////////////////////////////////
-// This is a helper class used to calculate stats across all trucks
-class TrucksStats {
-  // An inner private class that tracks the running avg and variance
-  // of a stream of observations
-  class Stats {
-    std::string name_;
-    int num_ = 0;
-    double total_ = 0;
-    double k_ = 0.0;
-    double ex_ = 0.0;
-    double ex2_ = 0.0;
+// A FIFO queue of trucks at a station, linked through the trucks themselves.
+// A truck is in at most one station queue at a time (it is either driving to
+// or waiting at its station), so the queue needs no storage beyond its two
+// ends. An empty queue costs a few bytes rather than the chunk that a
+// std::deque allocates up front, and pushing and popping never allocate.
+class TruckQueue {
+  Truck *head_ = nullptr;
+  Truck *tail_ = nullptr;
+  size_t size_ = 0;
+
+public:
+  class Iterator {
+    Truck *truck_;
 
   public:
-    // See here for more details:
-    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
-    void addObservation(Minutes m) {
-      if (num_ == 0) {
-        k_ = m;
-      }
-      num_ += 1;
-      ex_ += (m - k_);
-      ex2_ += (m - k_) * (m - k_);
-      total_ += m;
+    explicit Iterator(Truck *truck) : truck_{truck} {}
+    Truck *operator*() const { return truck_; }
+    Iterator &operator++() {
+      truck_ = truck_->nextInQueue_;
+      return *this;
     }
+    bool operator==(const Iterator &) const = default;
+  };
 
-    void name(std::string_view name) { name_ = name; }
-
-    std::string_view name() const { return name_; }
-
-    double total() const { return total_; }
-
-    double mean() const { return k_ + ex_ / num_; }
-
-    double stddev() const {
-      double variance = (ex2_ - ((ex_ * ex_) / num_)) / (num_ - 1);
-      return sqrt(variance);
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  Truck *front() const { return head_; }
+  Truck *back() const { return tail_; }
+  Iterator begin() const { return Iterator{head_}; }
+  Iterator end() const { return Iterator{nullptr}; }
+
+  void push_back(Truck *truck) {
+    assert(!truck->nextInQueue_ && truck != tail_);
+    if (tail_) {
+      tail_->nextInQueue_ = truck;
+    } else {
+      head_ = truck;
     }
-  };
+    tail_ = truck;
+    size_++;
+  }
+
+  // Empties the queue. The trucks in it must be reset separately.
+  void clear() { *this = TruckQueue{}; }
+
+  // Inserts a truck behind all trucks whose stateExitTs() is not later than
+  // its own, which keeps a queue ordered by stateExitTs() in that order.
+  // Walks the queue unless the truck goes to the back.
+  void insertByExitTs(Truck *truck) {
+    assert(!truck->nextInQueue_ && truck != tail_);
+    if (!tail_ || tail_->stateExitTs_ <= truck->stateExitTs_) {
+      push_back(truck);
+      return;
+    }
+    if (truck->stateExitTs_ < head_->stateExitTs_) {
+      truck->nextInQueue_ = head_;
+      head_ = truck;
+    } else {
+      Truck *prev = head_;
+      while (prev->nextInQueue_->stateExitTs_ <= truck->stateExitTs_) {
+        prev = prev->nextInQueue_;
+      }
+      truck->nextInQueue_ = prev->nextInQueue_;
+      prev->nextInQueue_ = truck;
+    }
+    size_++;
+  }
+
+  // Removes a truck that is in the queue. Walks the queue up to the truck.
+  void remove(Truck *truck) {
+    if (truck == head_) {
+      pop_front();
+      return;
+    }
+    Truck *prev = head_;
+    while (prev->nextInQueue_ != truck) {
+      assert(prev->nextInQueue_);
+      prev = prev->nextInQueue_;
+    }
+    prev->nextInQueue_ = truck->nextInQueue_;
+    truck->nextInQueue_ = nullptr;
+    if (tail_ == truck) {
+      tail_ = prev;
+    }
+    size_--;
+  }
+
+  void pop_front() {
+    assert(head_);
+    Truck *truck = head_;
+    head_ = truck->nextInQueue_;
+    truck->nextInQueue_ = nullptr;
+    if (!head_) {
+      tail_ = nullptr;
+    }
+    size_--;
+  }
+};
 
-  std::array<Stats, 4> allTrucksStats_ = {};
+/////////////////////////////////////////////////////////////////////////////
+// This is a helper class used to calculate stats across all trucks
+class TrucksStats {
+  std::array<RunningStats, 4> allTrucksStats_ = {};
 
 public:
   TrucksStats();
   // Accumulates stats of a single truck into the cumulative stats of all trucks
   void absorbTruck(const std::array<Minutes, 4> &truckStats);
+  // Fraction of the total time spent by all trucks that was spent Mining.
+  double utilization() const;
+  // Stats of the time spent by each truck in the given state.
+  const RunningStats &stateStats(Truck::State st) const {
+    return allTrucksStats_[st];
+  }
   // Prints cumulative stats accumulated so far.
   void printStats() const;
 };
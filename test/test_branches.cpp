@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include "branches.h"
+#include "simulation.h"
+#include <stdexcept>
+
+// A branch without a perturbation is the run that was never forked.
+TEST(BranchRunner, BaselineMatchesUninterruptedRun) {
+  SimulationConfig config{.numTrucks = 300, .numStations = 6, .seed = 2};
+  Simulation sim{config};
+  sim.start();
+  for (StationIndexKind kind :
+       {StationIndexKind::Heap, StationIndexKind::Multiset}) {
+    config.stationIndex = kind;
+    BranchRunner runner{config, 40 * 60, {{"baseline", {}}}, 1};
+    runner.run();
+    ASSERT_EQ(runner.results()[0], summarizeSimulation(sim));
+  }
+}
+
+// The branches do not depend on each other or on the number of threads.
+TEST(BranchRunner, IndependentOfThreads) {
+  SimulationConfig config{.numTrucks = 300, .numStations = 6, .seed = 8};
+  std::vector<Branch> branches = {{"baseline", {}}};
+  for (StationId id = 0; id < 6; id++) {
+    branches.push_back({"close", [id](Simulation &sim) {
+                          sim.closeStation(id);
+                        }});
+  }
+  BranchRunner one{config, 1000, branches, 1};
+  one.run();
+  BranchRunner three{config, 1000, branches, 3};
+  three.run();
+  ASSERT_EQ(one.results(), three.results());
+  // Fewer stations leave the trucks waiting longer.
+  for (size_t i = 1; i < branches.size(); i++) {
+    ASSERT_GT(one.results()[i].stateMeans[Truck::Waiting],
+              one.results()[0].stateMeans[Truck::Waiting]);
+  }
+}
+
+TEST(BranchRunner, RethrowsErrors) {
+  SimulationConfig config{.numTrucks = 10, .numStations = 2};
+  BranchRunner runner{config,
+                      100,
+                      {{"baseline", {}},
+                       {"bad", [](Simulation &sim) { sim.closeStation(7); }}},
+                      2};
+  ASSERT_THROW(runner.run(), std::invalid_argument);
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include "simulation.h"
+#include "testutil.h"
+#include <sstream>
+
+namespace {
+
+// Runs config uninterrupted, and once more paused at pauseTs, checkpointed,
+// restored into a simulation constructed with other counts and seed, and
+// resumed there. Both must end up the same.
+void checkRoundTrip(SimulationConfig config, timepoint_t pauseTs) {
+  Simulation uninterrupted{config};
+  Minutes end = uninterrupted.start();
+
+  Simulation paused{config};
+  paused.begin();
+  ASSERT_LT(paused.resume(pauseTs), pauseTs);
+  ASSERT_FALSE(paused.finished());
+  std::stringstream checkpoint;
+  paused.saveCheckpoint(checkpoint);
+
+  SimulationConfig other = config;
+  other.numTrucks = 3;
+  other.numStations = 1;
+  other.seed = config.seed + 1;
+  Simulation restored{other};
+  restored.restoreCheckpoint(checkpoint);
+  ASSERT_EQ(restored.resume(), end);
+  ASSERT_TRUE(restored.finished());
+  expectSameResults(restored, uninterrupted);
+
+  // The paused simulation itself carries on just the same.
+  ASSERT_EQ(paused.resume(), end);
+  expectSameResults(paused, uninterrupted);
+}
+
+} // namespace
+
+TEST(CheckpointTest, RoundTrip) {
+  SimulationConfig config{.numTrucks = 200, .numStations = 7, .seed = 3};
+  checkRoundTrip(config, 1);
+  checkRoundTrip(config, 600);
+  checkRoundTrip(config, 72 * 60);
+}
+
+TEST(CheckpointTest, RoundTripVariants) {
+  SimulationConfig config{.numTrucks = 150, .numStations = 4, .seed = 9};
+  config.stationIndex = StationIndexKind::Multiset;
+  checkRoundTrip(config, 1000);
+  config.stationIndex = StationIndexKind::Heap;
+  config.eventQueue = EventQueueKind::Multimap;
+  checkRoundTrip(config, 1000);
+  config.eventQueue = EventQueueKind::Calendar;
+  config.rng = RngKind::Philox;
+  checkRoundTrip(config, 1000);
+  config.tieBreak = TieBreak::ById;
+  checkRoundTrip(config, 1000);
+  config.batchDispatch = true;
+  checkRoundTrip(config, 1000);
+  // Long trips are parked in the overflow of the calendar queue.
+  config = SimulationConfig{.numTrucks = 40, .numStations = 3, .seed = 5};
+  config.durations.driving = 5000;
+  config.durations.sim = 30000;
+  checkRoundTrip(config, 12345);
+}
+
+// Checkpointing a finished simulation keeps it finished.
+TEST(CheckpointTest, Finished) {
+  SimulationConfig config{.numTrucks = 20, .numStations = 2};
+  Simulation sim{config};
+  Minutes end = sim.start();
+  std::stringstream checkpoint;
+  sim.saveCheckpoint(checkpoint);
+  Simulation restored{config};
+  restored.restoreCheckpoint(checkpoint);
+  ASSERT_TRUE(restored.finished());
+  ASSERT_EQ(restored.resume(), end);
+  expectSameResults(restored, sim);
+}
+
+TEST(CheckpointTest, RejectsBadCheckpoints) {
+  SimulationConfig config{.numTrucks = 50, .numStations = 3};
+  Simulation sim{config};
+  sim.begin();
+  sim.resume(500);
+  std::stringstream checkpoint;
+  sim.saveCheckpoint(checkpoint);
+  std::string data = checkpoint.str();
+
+  Simulation restored{config};
+  std::stringstream garbage{"not a checkpoint at all"};
+  ASSERT_THROW(restored.restoreCheckpoint(garbage), std::runtime_error);
+  for (size_t size : {size_t{4}, size_t{40}, data.size() / 2,
+                      data.size() - 1}) {
+    std::stringstream truncated{data.substr(0, size)};
+    ASSERT_THROW(restored.restoreCheckpoint(truncated), std::runtime_error);
+  }
+
+  SimulationConfig multiset = config;
+  multiset.stationIndex = StationIndexKind::Multiset;
+  Simulation incompatible{multiset};
+  std::stringstream copy{data};
+  ASSERT_THROW(incompatible.restoreCheckpoint(copy), std::runtime_error);
+
+  // A simulation that failed to restore can be reset and used again.
+  restored.reset(0);
+  std::stringstream good{data};
+  restored.restoreCheckpoint(good);
+  ASSERT_EQ(restored.resume(), Simulation{config}.start());
+}
@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+
+#include "fleet.h"
+#include "parallelsimulation.h"
+#include "simulation.h"
+#include "testutil.h"
+#include <sstream>
+
+namespace {
+
+// A haul truck that takes long to unload and mines for long, and a small one
+// that is quick at both, three of them for every big one.
+Fleet mixedFleet() {
+  return Fleet{{{.payload = 220, .weight = 1, .unloading = 12,
+                 .miningMin = 120, .miningMax = 400},
+                {.payload = 90, .weight = 3, .unloading = 4,
+                 .miningMin = 40, .miningMax = 150}}};
+}
+
+} // namespace
+
+TEST(FleetTest, Validation) {
+  Fleet fleet = mixedFleet();
+  ASSERT_FALSE(fleet.empty());
+  ASSERT_EQ(fleet.numClasses(), 2);
+  ASSERT_EQ(fleet.at(1).unloading, 4);
+  ASSERT_EQ(fleet.horizon(), 400);
+  ASSERT_TRUE(Fleet{}.empty());
+  ASSERT_EQ(Fleet{}.horizon(), 0);
+
+  ASSERT_THROW(Fleet{{}}, std::invalid_argument);
+  for (TruckClass c : {TruckClass{.payload = 0}, TruckClass{.weight = 0},
+                       TruckClass{.unloading = 0}, TruckClass{.miningMin = 0},
+                       TruckClass{.miningMin = 10, .miningMax = 9}}) {
+    ASSERT_THROW(Fleet{{c}}, std::invalid_argument);
+  }
+  ASSERT_THROW(Fleet{std::vector<TruckClass>(Fleet::kMaxClasses + 1)},
+               std::invalid_argument);
+}
+
+TEST(FleetTest, ClassOf) {
+  // Weights 1 and 3 repeat as 0, 1, 1, 1.
+  Fleet fleet = mixedFleet();
+  std::vector<int> classes;
+  for (TruckId t = 0; t < 8; t++) {
+    classes.push_back(fleet.classOf(t));
+  }
+  ASSERT_EQ(classes, (std::vector<int>{0, 1, 1, 1, 0, 1, 1, 1}));
+
+  Fleet single{{TruckClass{.weight = 5}}};
+  ASSERT_EQ(single.classOf(0), 0);
+  ASSERT_EQ(single.classOf(1234), 0);
+}
+
+TEST(FleetTest, ParseCsv) {
+  std::istringstream csv{"220,1,12,120,400\n\n90.0,3,4,40,150\n"};
+  ASSERT_EQ(Fleet::parseCsv(csv), mixedFleet());
+
+  for (const char *text : {"", "220,1,12,120\n", "220,1,12,120,400,\n",
+                           "220,1,12,120,400,5\n", "220;1;12;120;400\n",
+                           "220,1.5,12,120,400\n", "220,1,12,400,120\n"}) {
+    std::istringstream bad{text};
+    ASSERT_THROW(Fleet::parseCsv(bad), std::invalid_argument) << text;
+  }
+}
+
+// Trucks that arrive at a station together are unloaded one after the
+// other, each for as long as its own class takes.
+TEST(FleetTest, WaitsForMixedUnloading) {
+  Simulation sim{{.numTrucks = 3,
+                  .numStations = 1,
+                  .fleet = Fleet{{{.unloading = 5}, {.unloading = 12}}}}};
+  Station *st = sim.station(0);
+  for (TruckId t = 0; t < 3; t++) {
+    Truck *truck = sim.truck(t);
+    truck->startMining(0, 0);
+    truck->proceedToUnloadingStation(0, st, 30);
+    st->addArrivingTruck(truck);
+  }
+  ASSERT_EQ(st->freeTs(), 30 + 5 + 12 + 5);
+
+  ASSERT_EQ(st->onTruckArrived(sim.truck(0)), Truck::Unloading);
+  sim.truck(0)->unloadAtStation(30);
+  for (TruckId t = 1; t < 3; t++) {
+    ASSERT_EQ(st->onTruckArrived(sim.truck(t)), Truck::Waiting);
+    sim.truck(t)->waitAtStation(30);
+  }
+  ASSERT_EQ(sim.truck(0)->stateExitTs(), 35);
+  ASSERT_EQ(sim.truck(1)->stateExitTs(), 35);
+  ASSERT_EQ(sim.truck(2)->stateExitTs(), 35 + 12);
+  ASSERT_EQ(st->freeTs(), st->recomputeFreeTs());
+}
+
+// A fleet of one class with the durations of the simulation is the same as
+// none.
+TEST(FleetTest, SingleClassMatchesDefault) {
+  for (RngKind rng : {RngKind::Mt19937, RngKind::Philox}) {
+    SimulationConfig config{.numTrucks = 300, .numStations = 7, .seed = 5,
+                            .rng = rng};
+    Simulation plain{config};
+    plain.start();
+    config.fleet = Fleet{{TruckClass{}}};
+    Simulation single{config};
+    single.start();
+    expectSameResults(plain, single);
+  }
+}
+
+TEST(FleetTest, MixedFleet) {
+  SimulationConfig config{.numTrucks = 400, .numStations = 6, .seed = 9,
+                          .fleet = mixedFleet()};
+  Simulation sim{config};
+  sim.begin();
+  while (!sim.finished()) {
+    sim.resume(sim.now() + 60);
+    for (StationId s = 0; s < sim.stations().size(); s++) {
+      ASSERT_EQ(sim.station(s)->freeTs(), sim.station(s)->recomputeFreeTs());
+    }
+  }
+  for (const Truck &truck : sim.trucks()) {
+    const TruckClass &c = config.fleet.at(truck.truckClass());
+    ASSERT_EQ(truck.truckClass(), config.fleet.classOf(truck.id()));
+    ASSERT_EQ(truck.unloadingDuration(), c.unloading);
+    // Every cycle mines within the range of the class. The last one may be
+    // cut short by the end of the simulation.
+    const std::array<Minutes, 4> &stats = truck.retrieveStats();
+    ASSERT_EQ(stats[Truck::Unloading] % c.unloading, 0);
+    ASSERT_LE(stats[Truck::Mining],
+              static_cast<Minutes>(truck.miningCycles()) * c.miningMax);
+    ASSERT_GE(stats[Truck::Mining],
+              static_cast<Minutes>(truck.miningCycles() - 1) * c.miningMin);
+  }
+}
+
+TEST(FleetTest, CheckpointRoundTrip) {
+  SimulationConfig config{.numTrucks = 200, .numStations = 5, .seed = 3,
+                          .fleet = mixedFleet()};
+  Simulation uninterrupted{config};
+  Minutes end = uninterrupted.start();
+
+  Simulation paused{config};
+  paused.begin();
+  paused.resume(600);
+  std::stringstream checkpoint;
+  paused.saveCheckpoint(checkpoint);
+
+  Simulation restored{config};
+  restored.restoreCheckpoint(checkpoint);
+  ASSERT_EQ(restored.resume(), end);
+  expectSameResults(restored, uninterrupted);
+
+  // The truck classes are not restored from a checkpoint, so they must
+  // match.
+  SimulationConfig other = config;
+  other.fleet = Fleet{{TruckClass{}}};
+  Simulation mismatched{other};
+  checkpoint.seekg(0);
+  ASSERT_THROW(mismatched.restoreCheckpoint(checkpoint), std::runtime_error);
+  other.fleet = {};
+  Simulation without{other};
+  checkpoint.seekg(0);
+  ASSERT_THROW(without.restoreCheckpoint(checkpoint), std::runtime_error);
+}
+
+TEST(FleetTest, ParallelUnsupported) {
+  SimulationConfig config{.numTrucks = 10,
+                          .numStations = 4,
+                          .rng = RngKind::Philox,
+                          .tieBreak = TieBreak::ById,
+                          .fleet = mixedFleet()};
+  ASSERT_THROW((ParallelSimulation{config, 2}), std::invalid_argument);
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include "instrument.h"
+#include "simulation.h"
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+// The instrumentation is switched on with cmake -DMININGSIM_INSTRUMENT=ON.
+// Otherwise it must cost nothing and count nothing.
+TEST(InstrumentTest, DisabledCompilesToNothing) {
+  if constexpr (instrument::kEnabled) {
+    GTEST_SKIP() << "Built with MININGSIM_INSTRUMENT";
+  }
+  ASSERT_TRUE(std::is_empty_v<instrument::HandlerTimer>);
+  Simulation sim{{.numTrucks = 50, .numStations = 3}};
+  sim.start();
+  instrument::Counters counters = instrument::collect();
+  ASSERT_EQ(counters.events[0], 0);
+  ASSERT_EQ(counters.stationComparisons, 0);
+  ASSERT_EQ(counters.peakPendingEvents, 0);
+}
+
+TEST(InstrumentTest, CountsEvents) {
+  if constexpr (!instrument::kEnabled) {
+    GTEST_SKIP() << "Built without MININGSIM_INSTRUMENT";
+  }
+  for (StationIndexKind kind :
+       {StationIndexKind::Heap, StationIndexKind::Multiset}) {
+    instrument::reset();
+    Simulation sim{{.numTrucks = 200, .numStations = 4, .stationIndex = kind}};
+    sim.start();
+    instrument::Counters counters = instrument::collect();
+    uint64_t numEvents = 0;
+    for (size_t t = 0; t < instrument::kNumEventTypes; t++) {
+      numEvents += counters.events[t];
+      ASSERT_EQ(counters.handlerCalls[t], counters.events[t]);
+      ASSERT_EQ(counters.handlerLatency[t].total(), counters.events[t]);
+    }
+    ASSERT_EQ(numEvents, sim.numDispatchedEvents());
+    // Every truck arrives once per trip and unloads once per trip.
+    ASSERT_GE(counters.events[instrument::eventType<ArrivedAtStation>],
+              counters.events[instrument::eventType<UnloadingFinished>]);
+    // All trucks start out mining.
+    ASSERT_GE(counters.peakPendingEvents, 200);
+    // The multiset compares stations, the heap their keys.
+    ASSERT_GT(counters.stationComparisons, 0);
+  }
+}
+
+// The counts of other threads are kept after they exit.
+TEST(InstrumentTest, CollectsAllThreads) {
+  if constexpr (!instrument::kEnabled) {
+    GTEST_SKIP() << "Built without MININGSIM_INSTRUMENT";
+  }
+  instrument::reset();
+  SimulationConfig config{.numTrucks = 100, .numStations = 2};
+  uint64_t numEvents[2] = {};
+  std::thread first{[&config, &numEvents]() {
+    Simulation sim{config};
+    sim.start();
+    numEvents[0] = sim.numDispatchedEvents();
+  }};
+  std::thread second{[&config, &numEvents]() {
+    Simulation sim{config};
+    sim.start();
+    numEvents[1] = sim.numDispatchedEvents();
+  }};
+  first.join();
+  second.join();
+  instrument::Counters counters = instrument::collect();
+  uint64_t total = 0;
+  for (uint64_t n : counters.events) {
+    total += n;
+  }
+  ASSERT_EQ(total, numEvents[0] + numEvents[1]);
+}
+
+// The counters of a running thread can be collected and reset while it
+// counts, and the counts never go down between two resets.
+TEST(InstrumentTest, CollectsRunningThreads) {
+  if constexpr (!instrument::kEnabled) {
+    GTEST_SKIP() << "Built without MININGSIM_INSTRUMENT";
+  }
+  instrument::reset();
+  std::atomic<bool> done = false;
+  std::thread worker{[&done]() {
+    for (int i = 0; i < 20; i++) {
+      Simulation sim{{.numTrucks = 100, .numStations = 2}};
+      sim.start();
+    }
+    done = true;
+  }};
+  // The worker is joined before asserting, so that a failure is reported
+  // rather than terminating with a joinable thread.
+  uint64_t last = 0;
+  bool decreased = false;
+  while (!done && !decreased) {
+    uint64_t events = instrument::collect().events[0];
+    decreased = events < last;
+    last = events;
+  }
+  worker.join();
+  ASSERT_FALSE(decreased);
+  instrument::reset();
+  ASSERT_EQ(instrument::collect().events[0], 0);
+}
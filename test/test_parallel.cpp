@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include "parallelsimulation.h"
+#include "simulation.h"
+#include "spscchannel.h"
+#include <thread>
+
+TEST(SpscChannel, PushPop) {
+  SpscChannel<int> channel{3};
+  int value;
+  ASSERT_FALSE(channel.tryPop(value));
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(channel.tryPush(i));
+  }
+  // The capacity was rounded up to 4.
+  ASSERT_FALSE(channel.tryPush(4));
+  ASSERT_TRUE(channel.tryPop(value));
+  ASSERT_EQ(value, 0);
+  ASSERT_TRUE(channel.tryPush(4));
+  for (int i = 1; i <= 4; i++) {
+    ASSERT_TRUE(channel.tryPop(value));
+    ASSERT_EQ(value, i);
+  }
+  ASSERT_FALSE(channel.tryPop(value));
+}
+
+// Values arrive in order and none is lost or duplicated when the producer
+// and consumer run concurrently on a small channel.
+TEST(SpscChannel, Concurrent) {
+  SpscChannel<int> channel{16};
+  constexpr int kNumValues = 100000;
+  std::thread producer{[&channel]() {
+    for (int i = 0; i < kNumValues; i++) {
+      while (!channel.tryPush(i)) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+  for (int i = 0; i < kNumValues; i++) {
+    int value;
+    while (!channel.tryPop(value)) {
+      std::this_thread::yield();
+    }
+    ASSERT_EQ(value, i);
+  }
+  producer.join();
+}
+
+// A parallel simulation must produce exactly the same results as a sequential
+// one with the same config, whatever the number of threads.
+TEST(ParallelSimulation, MatchesSequential) {
+  for (auto [numTrucks, numStations] :
+       {std::pair{200, 5}, std::pair{1000, 3}, std::pair{50, 50}}) {
+    SimulationConfig config{.numTrucks = numTrucks,
+                            .numStations = numStations,
+                            .seed = 7,
+                            .rng = RngKind::Philox,
+                            .tieBreak = TieBreak::ById};
+    Simulation sequential{config};
+    Minutes sequentialEnd = sequential.start();
+
+    for (int numThreads : {1, 2, 3, 5}) {
+      ParallelSimulation parallel{config, numThreads};
+      ASSERT_EQ(parallel.start(), sequentialEnd);
+      for (TruckId i = 0; i < TruckId(numTrucks); i++) {
+        ASSERT_EQ(parallel.trucks()[i].retrieveStats(),
+                  sequential.trucks()[i].retrieveStats());
+      }
+      ASSERT_EQ(parallel.stations().utilization(),
+                sequential.stations().utilization());
+      ASSERT_EQ(parallel.stations().waits(), sequential.stations().waits());
+      ASSERT_EQ(parallel.stations().queueLengths(sequentialEnd),
+                sequential.stations().queueLengths(sequentialEnd));
+    }
+  }
+}
+
+// The lookahead follows the durations, and antithetic durations are drawn
+// the same way in both.
+TEST(ParallelSimulation, MatchesSequentialWithDurations) {
+  for (bool antithetic : {false, true}) {
+    SimulationConfig config{.numTrucks = 300,
+                            .numStations = 4,
+                            .seed = 2,
+                            .rng = RngKind::Philox,
+                            .antithetic = antithetic,
+                            .tieBreak = TieBreak::ById,
+                            .durations = {.unloading = 3,
+                                          .driving = 1,
+                                          .miningMin = 2,
+                                          .miningMax = 400,
+                                          .sim = 2000}};
+    Simulation sequential{config};
+    Minutes sequentialEnd = sequential.start();
+    ParallelSimulation parallel{config, 3};
+    ASSERT_EQ(parallel.start(), sequentialEnd);
+    for (TruckId i = 0; i < 300; i++) {
+      ASSERT_EQ(parallel.trucks()[i].retrieveStats(),
+                sequential.trucks()[i].retrieveStats());
+    }
+  }
+}
+
+TEST(ParallelSimulation, RequiresOrderIndependence) {
+  SimulationConfig config{.numTrucks = 10, .numStations = 2};
+  ASSERT_THROW((ParallelSimulation{config, 2}), std::invalid_argument);
+  config.rng = RngKind::Philox;
+  ASSERT_THROW((ParallelSimulation{config, 2}), std::invalid_argument);
+  config.tieBreak = TieBreak::ById;
+  config.stationIndex = StationIndexKind::Multiset;
+  ASSERT_THROW(Simulation{config}, std::invalid_argument);
+  config.stationIndex = StationIndexKind::Heap;
+  config.eventQueue = EventQueueKind::Multimap;
+  ASSERT_THROW(Simulation{config}, std::invalid_argument);
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include "random.h"
+#include "simulation.h"
+#include <set>
+
+// Known answer tests from the Random123 reference implementation.
+TEST(RandomTest, PhiloxKnownAnswers) {
+  using C = Philox4x32::Counter;
+  using K = Philox4x32::Key;
+  ASSERT_EQ(Philox4x32::generate(C{0, 0, 0, 0}, K{0, 0}),
+            (C{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+  ASSERT_EQ(Philox4x32::generate(
+                C{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                K{0xffffffff, 0xffffffff}),
+            (C{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}));
+  ASSERT_EQ(Philox4x32::generate(
+                C{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+                K{0xa4093822, 0x299f31d0}),
+            (C{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+}
+
+// Durations are pure functions of (seed, stream, id, cycle): they stay within
+// range, cover the whole range and come out the same whatever the order they
+// are drawn in.
+TEST(RandomTest, CounterRngDurations) {
+  CounterRng rng{7};
+  std::vector<Minutes> forward;
+  std::set<Minutes> seen;
+  for (uint32_t cycle = 0; cycle < 5000; cycle++) {
+    Minutes d = rng.duration(RandomStream::MiningDuration, 3, cycle,
+                             kMiningDurationMin, kMiningDurationMax);
+    ASSERT_GE(d, kMiningDurationMin);
+    ASSERT_LE(d, kMiningDurationMax);
+    forward.push_back(d);
+    seen.insert(d);
+  }
+  ASSERT_EQ(seen.size(), kMiningDurationMax - kMiningDurationMin + 1);
+
+  for (uint32_t cycle = 5000; cycle-- > 0;) {
+    ASSERT_EQ(rng.duration(RandomStream::MiningDuration, 3, cycle,
+                           kMiningDurationMin, kMiningDurationMax),
+              forward[cycle]);
+  }
+  ASSERT_NE(forward[0], CounterRng{8}.duration(RandomStream::MiningDuration,
+                                               3, 0, kMiningDurationMin,
+                                               kMiningDurationMax));
+}
+
+// With the counter-based generator, the total mining time of every truck is
+// the sum of the durations of its cycles, independent of everything else
+// that happened in the simulation.
+TEST(RandomTest, PhiloxSimulation) {
+  SimulationConfig config{.numTrucks = 100,
+                          .numStations = 4,
+                          .seed = 5,
+                          .rng = RngKind::Philox};
+  Simulation sim{config};
+  sim.start();
+
+  CounterRng rng{5};
+  for (const Truck &truck : sim.trucks()) {
+    ASSERT_GT(truck.miningCycles(), 1);
+    Minutes mining = 0;
+    for (uint32_t cycle = 0; cycle < truck.miningCycles(); cycle++) {
+      mining += rng.duration(RandomStream::MiningDuration, truck.id(), cycle,
+                             kMiningDurationMin, kMiningDurationMax);
+    }
+    ASSERT_EQ(truck.retrieveStats()[Truck::Mining], mining);
+  }
+}
+
+// An antithetic generator reflects every duration of the plain one with the
+// same seed within its range. In either kind of simulation the first draws
+// of every truck are paired, but with mt19937 the later ones are only paired
+// while both simulations handle their events in the same order.
+TEST(RandomTest, AntitheticDurations) {
+  CounterRng plain{7};
+  CounterRng antithetic{7, true};
+  for (uint32_t cycle = 0; cycle < 1000; cycle++) {
+    ASSERT_EQ(antithetic.duration(RandomStream::MiningDuration, 3, cycle, 10,
+                                  20),
+              30 - plain.duration(RandomStream::MiningDuration, 3, cycle, 10,
+                                  20));
+  }
+
+  for (RngKind rng : {RngKind::Mt19937, RngKind::Philox}) {
+    // Trucks that never wait mine for as long in total in both as they
+    // would for min + max every cycle.
+    SimulationConfig config{.numTrucks = 3, .numStations = 3, .seed = 2,
+                            .rng = rng};
+    Simulation sim{config};
+    sim.begin();
+    config.antithetic = true;
+    Simulation reflected{config};
+    reflected.begin();
+    for (TruckId t = 0; t < 3; t++) {
+      ASSERT_EQ(sim.truck(t)->stateExitTs() +
+                    reflected.truck(t)->stateExitTs(),
+                kMiningDurationMin + kMiningDurationMax);
+    }
+  }
+}
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+
+#include "replicas.h"
+#include "simulation.h"
+#include <cmath>
+#include <sstream>
+
+// Simulations with the same seed must produce identical results, even when
+// they run in the same process, while a different seed must give different
+// results.
+TEST(ReplicasTest, SeededSimulations) {
+  SimulationConfig config{.numTrucks = 200, .numStations = 5, .seed = 3};
+  Simulation sim1{config};
+  Simulation sim2{config};
+  config.seed = 4;
+  Simulation sim3{config};
+  sim1.start();
+  sim2.start();
+  sim3.start();
+
+  bool allSame = true;
+  for (TruckId i = 0; i < 200; i++) {
+    ASSERT_EQ(sim1.trucks()[i].retrieveStats(),
+              sim2.trucks()[i].retrieveStats());
+    allSame = allSame && sim1.trucks()[i].retrieveStats() ==
+                             sim3.trucks()[i].retrieveStats();
+  }
+  ASSERT_FALSE(allSame);
+}
+
+// The results of each replica depend only on its seed and not on how many
+// threads the replicas were spread across.
+TEST(ReplicasTest, IndependentOfThreads) {
+  SimulationConfig config{.numTrucks = 300, .numStations = 7, .seed = 10};
+  ReplicaRunner sequential{config, 6, 1};
+  ReplicaRunner parallel{config, 6, 4};
+  sequential.run();
+  parallel.run();
+  ASSERT_EQ(sequential.results(), parallel.results());
+
+  // Replica i is the same as a single simulation seeded with seed + i.
+  config.seed += 5;
+  Simulation sim{config};
+  sim.start();
+  ASSERT_EQ(summarizeSimulation(sim), parallel.results()[5]);
+}
+
+// A simulation that is reset or reconfigured must give exactly the same
+// results as a newly constructed one.
+// A replica that throws on its thread does not terminate the process, but
+// is rethrown by run() once all replicas are done.
+TEST(ReplicasTest, RethrowsErrors) {
+  // The multimap event queue only supports FIFO tie breaking.
+  SimulationConfig config{.numTrucks = 10, .numStations = 2,
+                          .eventQueue = EventQueueKind::Multimap,
+                          .tieBreak = TieBreak::ById};
+  ReplicaRunner runner{config, 4, 2};
+  ASSERT_THROW(runner.run(), std::invalid_argument);
+}
+
+TEST(ReplicasTest, ResetSimulation) {
+  for (StationIndexKind kind :
+       {StationIndexKind::Heap, StationIndexKind::Multiset}) {
+    Simulation sim{{.numTrucks = 300, .numStations = 7, .seed = 1,
+                    .stationIndex = kind}};
+    sim.start();
+
+    auto expectSame = [kind, &sim](int numTrucks, int numStations,
+                                   uint32_t seed, Minutes end) {
+      Simulation fresh{{.numTrucks = numTrucks, .numStations = numStations,
+                        .seed = seed, .stationIndex = kind}};
+      ASSERT_EQ(fresh.start(), end);
+      ASSERT_EQ(sim.trucks().size(), size_t(numTrucks));
+      for (TruckId i = 0; i < TruckId(numTrucks); i++) {
+        ASSERT_EQ(sim.trucks()[i].retrieveStats(),
+                  fresh.trucks()[i].retrieveStats());
+      }
+      ASSERT_EQ(summarizeSimulation(sim), summarizeSimulation(fresh));
+    };
+
+    sim.reset(2);
+    expectSame(300, 7, 2, sim.start());
+    sim.reconfigure(500, 20);
+    expectSame(500, 20, 2, sim.start());
+    sim.reconfigure(100, 3);
+    expectSame(100, 3, 2, sim.start());
+  }
+}
+
+// Antithetic replicas come in pairs that share a seed, and each pair is one
+// observation of the ensemble. Since the durations of a pair mirror each
+// other, the mean of a pair varies less than a single replica does.
+TEST(ReplicasTest, AntitheticPairs) {
+  SimulationConfig config{.numTrucks = 300, .numStations = 7, .seed = 10,
+                          .rng = RngKind::Philox};
+  ASSERT_THROW((ReplicaRunner{config, 5, 1, ReplicaSampling::Antithetic}),
+               std::invalid_argument);
+  SimulationConfig mt19937 = config;
+  mt19937.rng = RngKind::Mt19937;
+  ASSERT_THROW((ReplicaRunner{mt19937, 4, 1, ReplicaSampling::Antithetic}),
+               std::invalid_argument);
+  ReplicaRunner independent{config, 20, 4};
+  ReplicaRunner antithetic{config, 20, 4, ReplicaSampling::Antithetic};
+  independent.run();
+  antithetic.run();
+  ASSERT_EQ(antithetic.results().size(), 20u);
+  ASSERT_EQ(antithetic.observations().size(), 10u);
+  ASSERT_EQ(antithetic.aggregate().truckUtilization.count(), 10);
+
+  // Replicas 6 and 7 are the plain and antithetic simulations of seed + 3.
+  config.seed += 3;
+  Simulation plain{config};
+  plain.start();
+  config.antithetic = true;
+  Simulation reflected{config};
+  reflected.start();
+  ASSERT_EQ(summarizeSimulation(plain), antithetic.results()[6]);
+  ASSERT_EQ(summarizeSimulation(reflected), antithetic.results()[7]);
+  ASSERT_DOUBLE_EQ(antithetic.observations()[3].truckUtilization,
+                   (antithetic.results()[6].truckUtilization +
+                    antithetic.results()[7].truckUtilization) /
+                       2);
+
+  // A pair takes two simulations, so it has to beat half the variance of one.
+  double independentStddev = independent.aggregate().truckUtilization.stddev();
+  double pairStddev = antithetic.aggregate().truckUtilization.stddev();
+  ASSERT_LT(pairStddev, independentStddev / std::sqrt(2.0));
+}
+
+// The antithetic flag is restored from a checkpoint like the seed.
+TEST(ReplicasTest, AntitheticCheckpoint) {
+  SimulationConfig config{.numTrucks = 200, .numStations = 5, .seed = 3,
+                          .antithetic = true};
+  Simulation uninterrupted{config};
+  Minutes end = uninterrupted.start();
+
+  Simulation paused{config};
+  paused.begin();
+  paused.resume(600);
+  std::stringstream checkpoint;
+  paused.saveCheckpoint(checkpoint);
+
+  config.antithetic = false;
+  Simulation restored{config};
+  restored.restoreCheckpoint(checkpoint);
+  ASSERT_EQ(restored.resume(), end);
+  ASSERT_EQ(summarizeSimulation(restored),
+            summarizeSimulation(uninterrupted));
+}
+
+// With common random numbers, identical scenarios differ by exactly nothing,
+// and the paired differences between two numbers of stations are known far
+// more precisely than the difference between the two ensembles.
+TEST(ComparisonTest, CommonRandomNumbers) {
+  SimulationConfig baseline{.numTrucks = 500, .numStations = 10, .seed = 1,
+                            .rng = RngKind::Philox};
+  ComparisonRunner same{baseline, baseline, 6, 3};
+  same.run();
+  EnsembleStats zero = same.differences();
+  ASSERT_EQ(zero.truckUtilization.count(), 6);
+  ASSERT_EQ(zero.truckUtilization.mean(), 0.0);
+  ASSERT_EQ(zero.stationUtilization.mean(), 0.0);
+
+  SimulationConfig alternative = baseline;
+  alternative.numStations = 11;
+  for (ReplicaSampling sampling :
+       {ReplicaSampling::Independent, ReplicaSampling::Antithetic}) {
+    ComparisonRunner runner{baseline, alternative, 20, 3, sampling};
+    runner.run();
+    ASSERT_EQ(runner.baseline().results().size(), 20u);
+    ASSERT_EQ(runner.alternative().observations().size(),
+              runner.baseline().observations().size());
+    const RunningStats &paired = runner.differences().truckUtilization;
+    const RunningStats &b = runner.baseline().aggregate().truckUtilization;
+    const RunningStats &a = runner.alternative().aggregate().truckUtilization;
+    ASSERT_NEAR(paired.mean(), a.mean() - b.mean(), 1e-12);
+    ASSERT_GT(paired.mean(), 0.0);
+    if (sampling == ReplicaSampling::Independent) {
+      // The stddev of the difference of independent observations.
+      double unpaired =
+          std::sqrt(a.stddev() * a.stddev() + b.stddev() * b.stddev());
+      ASSERT_LT(paired.stddev(), unpaired / 3);
+    }
+  }
+
+  alternative.rng = RngKind::Mt19937;
+  ASSERT_THROW((ComparisonRunner{baseline, alternative, 4, 1}),
+               std::invalid_argument);
+  alternative.rng = RngKind::Philox;
+  alternative.seed = 2;
+  ASSERT_THROW((ComparisonRunner{baseline, alternative, 4, 1}),
+               std::invalid_argument);
+}
+
+TEST(ReplicasTest, ConfidenceInterval) {
+  RunningStats stats;
+  ASSERT_EQ(stats.confidenceHalfWidth(), 0.0);
+  for (int i = 1; i <= 5; i++) {
+    stats.addObservation(i);
+  }
+  ASSERT_DOUBLE_EQ(stats.mean(), 3.0);
+  // t(0.975, 4) * stddev / sqrt(5)
+  ASSERT_NEAR(stats.confidenceHalfWidth(0.95),
+              2.7764451 * std::sqrt(2.5) / std::sqrt(5.0), 1e-6);
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include "sampler.h"
+#include "simulation.h"
+#include <sstream>
+#include <string>
+
+namespace {
+
+// The same sample, counted by walking all trucks and stations.
+Sample scanSample(const Simulation &sim) {
+  Sample sample;
+  sample.ts = sim.now();
+  for (const Truck &truck : sim.trucks()) {
+    sample.trucks[truck.state()]++;
+  }
+  for (StationId id = 0; id < sim.stations().size(); id++) {
+    sample.busyStations += sim.stations().station(id)->unloadingTruck_ ? 1 : 0;
+  }
+  sample.pendingEvents = sim.numPendingEvents();
+  sample.dispatchedEvents = sim.numDispatchedEvents();
+  return sample;
+}
+
+} // namespace
+
+// The incrementally kept counters always agree with a full scan.
+TEST(SamplerTest, CountersMatchScan) {
+  for (StationIndexKind kind :
+       {StationIndexKind::Heap, StationIndexKind::Multiset}) {
+    SimulationConfig config{
+        .numTrucks = 300, .numStations = 5, .seed = 4, .stationIndex = kind};
+    Simulation sim{config};
+    sim.begin();
+    ASSERT_EQ(takeSample(sim), scanSample(sim));
+    for (timepoint_t ts = 7; !sim.finished(); ts += 7) {
+      sim.resume(ts);
+      ASSERT_EQ(takeSample(sim), scanSample(sim));
+    }
+
+    // Also after a restore and a reset.
+    std::stringstream checkpoint;
+    sim.saveCheckpoint(checkpoint);
+    Simulation restored{config};
+    restored.restoreCheckpoint(checkpoint);
+    ASSERT_EQ(takeSample(restored), scanSample(restored));
+    sim.reset(1);
+    sim.begin();
+    ASSERT_EQ(takeSample(sim), scanSample(sim));
+  }
+}
+
+TEST(SamplerTest, WritesTimeSeries) {
+  SimulationConfig config{.numTrucks = 100, .numStations = 3, .seed = 2};
+  Simulation sampled{config};
+  sampled.begin();
+  std::ostringstream os;
+  Minutes end = Sampler{os, 60}.run(sampled);
+
+  // Sampling does not change the outcome.
+  Simulation plain{config};
+  ASSERT_EQ(plain.start(), end);
+  for (size_t i = 0; i < 100; i++) {
+    ASSERT_EQ(sampled.trucks()[i].retrieveStats(),
+              plain.trucks()[i].retrieveStats());
+  }
+
+  std::istringstream is{os.str()};
+  std::string line;
+  std::getline(is, line);
+  ASSERT_EQ(line, "ts,mining,driving,waiting,unloading,busy_stations,"
+                  "pending_events,dispatched_events");
+  // At 0 and every hour of the 72.
+  std::getline(is, line);
+  ASSERT_EQ(line, "0,100,0,0,0,0,100,0");
+  int numRows = 1;
+  timepoint_t lastTs = 0;
+  while (std::getline(is, line)) {
+    timepoint_t ts = std::stol(line);
+    ASSERT_EQ(ts, lastTs + 60);
+    lastTs = ts;
+    numRows++;
+  }
+  ASSERT_EQ(numRows, 73);
+
+  ASSERT_THROW((Sampler{os, 0}), std::invalid_argument);
+}
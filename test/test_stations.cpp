@@ -3,34 +3,44 @@
 #include "simulation.h"
 #include "timerservice.h"
 #include "truck.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
 
-struct TestSimulation : public SimulationBase {
+struct TestSimulation : public SimulationBase<TestSimulation> {
   std::vector<SimulationEvent> events_;
   TestSimulation(int numTrucks, int numStations)
-      : SimulationBase{numTrucks, numStations} {}
+      : SimulationBase{{.numTrucks = numTrucks, .numStations = numStations}} {}
 
   void onUnloadingFinished(timepoint_t now, Truck *truck,
-                           Station *station) override {
-    events_.push_back(SimulationEvent{UnloadingFinished{now, truck, station}});
+                           Station *station) {
+    events_.push_back(
+        SimulationEvent{UnloadingFinished{now, truck->id(), station->id_}});
   }
-  void onMiningFinished(timepoint_t now, Truck *truck) override {
-    events_.push_back(SimulationEvent{MiningFinished{now, truck}});
+  void onMiningFinished(timepoint_t now, Truck *truck) {
+    events_.push_back(SimulationEvent{MiningFinished{now, truck->id()}});
   }
   void onArrivedAtStation(timepoint_t now, Truck *truck,
-                          Station *station) override {
-    events_.push_back(SimulationEvent{ArrivedAtStation{now, truck, station}});
+                          Station *station) {
+    events_.push_back(
+        SimulationEvent{ArrivedAtStation{now, truck->id(), station->id_}});
   }
 
-  TimerService *timerService() { return &timerService_; }
+  TimerService<TestSimulation> *timerService() { return &timerService_; }
 };
 
 TEST(StationsTest, StationEta) {
   int numTrucks = 10;
   int numStations = 2;
-  Simulation simulation(numTrucks, numStations);
+  Simulation simulation({.numTrucks = numTrucks,
+                         .numStations = numStations,
+                         .stationIndex = StationIndexKind::Multiset});
   ASSERT_EQ(simulation.stations_.stationHolder_.size(), numStations);
 
-  TimerService *timerService = &simulation.timerService_;
+  auto *timerService = &simulation.timerService_;
   auto &stations = simulation.stations_.stations_;
   ASSERT_EQ(stations.size(), numStations);
 
@@ -52,7 +62,7 @@ TEST(StationsTest, StationEta) {
   // Truck0 is driving to st1 which is currently free.
   std::unique_ptr<Truck> tr{new Truck{0, Truck::Driving, st1}};
   ASSERT_FALSE(st1->unloadingTruck_);
-  st1->arrivingTrucks_.push_back(tr.get());
+  st1->addArrivingTruck(tr.get());
 
   // Truck0 arrives at St1.
   simulation.onArrivedAtStation(timerService->now(), tr.get(), st1);
@@ -69,7 +79,8 @@ TEST(StationsTest, StationEta) {
   timerService->setNow(timerService->now() + Minutes{3});
   // Send a truck to st2
   std::unique_ptr<Truck> tr1{new Truck{1, Truck::Driving, st2}};
-  st2->arrivingTrucks_.push_back(tr1.get());
+  tr1->stateExitTs_ = timerService->now();
+  st2->addArrivingTruck(tr1.get());
 
   // Tr1 arrives
   simulation.onArrivedAtStation(timerService->now(), tr1.get(), st2);
@@ -80,7 +91,8 @@ TEST(StationsTest, StationEta) {
 
   // Tr2 is now sent to St2
   std::unique_ptr<Truck> tr2{new Truck{2, Truck::Driving, st2}};
-  st2->arrivingTrucks_.push_back(tr2.get());
+  tr2->stateExitTs_ = timerService->now();
+  st2->addArrivingTruck(tr2.get());
   // St2 is still unloading Tr1 and Tr2 will be the first arrivingTruck
   ASSERT_EQ(st2->unloadingTruck_, tr1.get());
   ASSERT_EQ(st2->arrivingTrucks_.size(), 1);
@@ -115,6 +127,7 @@ TEST(StationsTest, StationEta2) {
   tr3.state_ = Truck::Waiting;
   tr3.unloadingStation_ = &st;
   st.waitingTrucks_.push_back(&tr3);
+  st.waitingUnloading_ += tr3.unloadingDuration();
 
   // TR4 will arrive before TR3 finishes
   Truck tr4{4};
@@ -131,5 +144,239 @@ TEST(StationsTest, StationEta2) {
   st.arrivingTrucks_.push_back(&tr5);
 
   // Station will only become free at end of tr5
-  ASSERT_EQ(st.freeTs(), ts + 15 + 5);
+  ASSERT_EQ(st.recomputeFreeTs(), ts + 15 + 5);
+}
+
+// Run a simulation with many trucks per station so that the queues get long,
+// and verify that the incrementally maintained freeTs matches a full
+// recomputation for every station. Every event handler also cross-checks this
+// in debug builds.
+TEST(StationsTest, IncrementalFreeTs) {
+  Simulation simulation({.numTrucks = 500, .numStations = 3});
+  simulation.start();
+  for (const Station &st : simulation.stations().stationHolder_) {
+    ASSERT_FALSE(st.arrivingTrucks_.empty() && st.waitingTrucks_.empty());
+    ASSERT_EQ(st.freeTs(), st.recomputeFreeTs());
+  }
+}
+
+// The indexed heap must always return the item with the smallest key,
+// whichever way keys are updated.
+TEST(IndexedDaryHeap, UpdateKeys) {
+  constexpr uint32_t kItems = 100;
+  IndexedDaryHeap<int> heap(kItems);
+  std::vector<int> keys(kItems);
+  std::mt19937 generator(7);
+  std::uniform_int_distribution<int> dist(0, 1000);
+  for (uint32_t i = 0; i < kItems; i++) {
+    keys[i] = dist(generator);
+    heap.push(i, keys[i]);
+  }
+  for (int round = 0; round < 1000; round++) {
+    uint32_t minItem = std::min_element(keys.begin(), keys.end()) - keys.begin();
+    ASSERT_EQ(heap.topKey(), keys[minItem]);
+    ASSERT_EQ(heap.key(heap.top()), keys[heap.top()]);
+    uint32_t item = dist(generator) % kItems;
+    keys[item] = dist(generator);
+    heap.update(item, keys[item]);
+  }
+}
+
+TEST(IndexedDaryHeap, Erase) {
+  constexpr uint32_t kItems = 100;
+  IndexedDaryHeap<int> heap(kItems);
+  std::vector<int> keys(kItems);
+  std::mt19937 generator(5);
+  std::uniform_int_distribution<int> dist(0, 1000);
+  for (uint32_t i = 0; i < kItems; i++) {
+    keys[i] = dist(generator);
+    heap.push(i, keys[i]);
+  }
+  std::vector<uint32_t> items(kItems);
+  std::iota(items.begin(), items.end(), 0);
+  std::shuffle(items.begin(), items.end(), generator);
+  for (uint32_t item : items) {
+    heap.erase(item);
+    keys[item] = std::numeric_limits<int>::max();
+    ASSERT_FALSE(heap.contains(item));
+    if (!heap.empty()) {
+      ASSERT_EQ(heap.topKey(), *std::min_element(keys.begin(), keys.end()));
+      ASSERT_EQ(heap.key(heap.top()), keys[heap.top()]);
+    }
+  }
+  ASSERT_TRUE(heap.empty());
+  heap.push(3, 1);
+  ASSERT_EQ(heap.top(), 3u);
+}
+
+// Same event handling as Simulation, but the mining durations come from a
+// generator local to this simulation so that two instances see the same
+// durations. Records the station picked for every truck dispatch.
+struct ReplaySimulation : public SimulationBase<ReplaySimulation> {
+  std::mt19937 generator_{11};
+  std::vector<int> picks_;
+  ReplaySimulation(int numTrucks, int numStations, StationIndexKind kind)
+      : SimulationBase{{.numTrucks = numTrucks,
+                        .numStations = numStations,
+                        .stationIndex = kind}} {}
+
+  Minutes miningDuration() {
+    return std::uniform_int_distribution<Minutes>(kMiningDurationMin,
+                                                  kMiningDurationMax)(generator_);
+  }
+  void run(timepoint_t end) {
+    for (Truck &truck : trucks_) {
+      Minutes d = miningDuration();
+      truck.startMining(0, d);
+      timerService_.scheduleEvent(MiningFinished{{d}, truck.id()});
+    }
+    while (timerService_.dispatchNextEvent() && timerService_.now() < end) {
+    }
+  }
+
+  void onUnloadingFinished(timepoint_t now, Truck *truck,
+                           Station *station) {
+    Minutes d = miningDuration();
+    truck->startMining(now, now + d);
+    timerService_.scheduleEvent(MiningFinished{{now + d}, truck->id()});
+    stations_.onUnloadingFinished(now, station);
+    if (station->unloadingTruck_) {
+      timerService_.scheduleEvent(
+          UnloadingFinished{{now + kUnloadingDuration},
+                            station->unloadingTruck_->id(), station->id_});
+    }
+  }
+  void onMiningFinished(timepoint_t now, Truck *truck) {
+    Station *st = stations_.selectUnloadingStation(truck);
+    picks_.push_back(st->id_);
+    timerService_.scheduleEvent(
+        ArrivedAtStation{{now + kDrivingDuration}, truck->id(), st->id_});
+  }
+  void onArrivedAtStation(timepoint_t now, Truck *truck,
+                          Station *station) {
+    if (stations_.onTruckArrivedForUnloading(station, truck) ==
+        Truck::Unloading) {
+      truck->unloadAtStation(now);
+      timerService_.scheduleEvent(UnloadingFinished{
+          {now + kUnloadingDuration}, truck->id(), station->id_});
+    } else {
+      truck->waitAtStation(now);
+    }
+  }
+};
+
+// The heap and the multiset station indexes must pick the same station for
+// every truck dispatch.
+TEST(StationsTest, HeapMatchesMultiset) {
+  ReplaySimulation heapSim(2000, 37, StationIndexKind::Heap);
+  ReplaySimulation multisetSim(2000, 37, StationIndexKind::Multiset);
+  heapSim.run(kSimDuration);
+  multisetSim.run(kSimDuration);
+  ASSERT_GT(heapSim.picks_.size(), 2000);
+  ASSERT_EQ(heapSim.picks_, multisetSim.picks_);
+}
+
+TEST(LogHistogramTest, Quantiles) {
+  LogHistogram hist;
+  ASSERT_EQ(hist.quantile(0.5), 0u);
+  // Small values are exact.
+  for (uint64_t v = 0; v < 16; v++) {
+    ASSERT_EQ(LogHistogram::highestValueOf(LogHistogram::bucketOf(v)), v);
+  }
+  std::mt19937_64 generator(3);
+  std::vector<uint64_t> values;
+  for (int i = 0; i < 10000; i++) {
+    // Spread over many orders of magnitude.
+    uint64_t v = generator() >> (generator() % 64);
+    uint64_t highest = LogHistogram::highestValueOf(LogHistogram::bucketOf(v));
+    ASSERT_GE(highest, v);
+    ASSERT_LE(highest - v, v / 16);
+    values.push_back(v);
+    hist.add(v);
+  }
+  ASSERT_EQ(hist.total(), 10000u);
+  std::sort(values.begin(), values.end());
+  for (double q : {0.0, 0.5, 0.95, 0.99, 1.0}) {
+    uint64_t exact = values[std::max<int>(std::ceil(q * 10000), 1) - 1];
+    ASSERT_EQ(hist.quantile(q),
+              LogHistogram::highestValueOf(LogHistogram::bucketOf(exact)));
+  }
+  ASSERT_LT(hist.counts().size(), 1000u);
+}
+
+// Merging gives the histogram of all values, weights included.
+TEST(LogHistogramTest, Merge) {
+  LogHistogram all;
+  LogHistogram lhs;
+  LogHistogram rhs;
+  for (uint64_t v = 0; v < 3000; v += 7) {
+    all.add(v, v % 3);
+    (v % 2 ? lhs : rhs).add(v, v % 3);
+  }
+  lhs.merge(rhs);
+  ASSERT_EQ(lhs, all);
+  ASSERT_EQ(LogHistogram{all.counts()}, all);
+  all.clear();
+  ASSERT_EQ(all, LogHistogram{});
+}
+
+// Every truck that started unloading has one wait, and the queue lengths of
+// a station cover every minute of the run.
+TEST(StationsTest, WaitsAndQueueLengths) {
+  SimulationConfig config{.numTrucks = 500, .numStations = 4, .seed = 6};
+  Simulation sim{config};
+  Minutes end = sim.start();
+
+  uint64_t numUnloads = 0;
+  Minutes totalWait = 0;
+  for (const Truck &truck : sim.trucks()) {
+    numUnloads += truck.miningCycles() - 1 +
+                  (truck.state() == Truck::Unloading ? 1 : 0);
+    totalWait += truck.retrieveStats()[Truck::Waiting];
+  }
+  LogHistogram waits = sim.stations().waits();
+  ASSERT_EQ(waits.total(), numUnloads);
+  ASSERT_GT(waits.quantile(0.99), waits.quantile(0.5));
+  // With 125 trucks per station most of them wait.
+  ASSERT_GT(waits.quantile(0.5), 0u);
+  ASSERT_LE(waits.quantile(1.0), static_cast<uint64_t>(totalWait));
+
+  LogHistogram lengths;
+  for (StationId id = 0; id < 4; id++) {
+    LogHistogram station = sim.stations().queueLengths(id, end);
+    ASSERT_EQ(station.total(), static_cast<uint64_t>(end));
+    lengths.merge(station);
+    ASSERT_GT(sim.station(id)->utilization(), 0.9);
+  }
+  ASSERT_EQ(lengths, sim.stations().queueLengths(end));
+
+  // Back to nothing after a reset.
+  sim.reset(0);
+  ASSERT_TRUE(sim.stations().waits().empty());
+  ASSERT_EQ(sim.stations().queueLengths(0).total(), 0u);
+}
+
+// A closed station is sent no further trucks, but unloads those already
+// on their way.
+TEST(StationsTest, CloseStation) {
+  for (StationIndexKind kind :
+       {StationIndexKind::Heap, StationIndexKind::Multiset}) {
+    SimulationConfig config{
+        .numTrucks = 100, .numStations = 3, .stationIndex = kind};
+    Simulation sim{config};
+    sim.begin();
+    sim.resume(1000);
+    sim.closeStation(1);
+    sim.closeStation(1);
+    ASSERT_THROW(sim.closeStation(3), std::invalid_argument);
+    timepoint_t lastUnloadEndTs = sim.station(1)->lastUnloadEndTs_;
+    sim.resume();
+    ASSERT_EQ(sim.station(1)->lastUnloadEndTs_, lastUnloadEndTs);
+    ASSERT_TRUE(sim.station(1)->arrivingTrucks_.empty());
+    ASSERT_TRUE(sim.station(1)->waitingTrucks_.empty());
+    ASSERT_GT(sim.station(0)->lastUnloadEndTs_, lastUnloadEndTs);
+
+    sim.closeStation(0);
+    ASSERT_THROW(sim.closeStation(2), std::invalid_argument);
+  }
 }
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include "simulation.h"
+#include "steadystate.h"
+#include "sweep.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+TEST(SteadyStateTest, MserTruncation) {
+  ASSERT_EQ(mserTruncation({}), 0u);
+  ASSERT_EQ(mserTruncation({1.0, 1.0, 1.0, 1.0}), 0u);
+  // The decaying start is cut off, the noise after it is kept.
+  std::vector<double> values = {9.0, 6.0, 4.0, 3.0};
+  for (int i = 0; i < 20; i++) {
+    values.push_back(i % 2 ? 1.1 : 0.9);
+  }
+  ASSERT_EQ(mserTruncation(values), 4u);
+  // Never more than half.
+  ASSERT_LE(mserTruncation({5.0, 4.0, 3.0, 2.0, 1.0}), 2u);
+}
+
+TEST(SteadyStateTest, StopsOnceConverged) {
+  SimulationConfig config{.numTrucks = 1000, .numStations = 50, .seed = 1};
+  Simulation sim{config};
+  sim.begin();
+  SteadyStateDetector detector{{.tolerance = 0.05, .batchLength = 60}};
+  SteadyStateEstimate e = detector.run(sim);
+  ASSERT_TRUE(e.converged);
+  ASSERT_FALSE(sim.finished());
+  ASSERT_LT(e.stoppedAfter, kSimDuration);
+  ASSERT_EQ(e.stoppedAfter % 60, 0);
+  ASSERT_EQ(detector.truckBatches().size(), size_t(e.stoppedAfter / 60));
+  ASSERT_EQ(e.warmup + e.numBatches * 60, e.stoppedAfter);
+  ASSERT_GE(e.numBatches, 10);
+  ASSERT_LE(e.truckUtilizationHalfWidth, 0.05 * e.truckUtilization);
+  ASSERT_LE(e.stationUtilizationHalfWidth, 0.05 * e.stationUtilization);
+
+  // The estimates agree with those of the whole run.
+  Simulation full{config};
+  full.start();
+  TrucksStats trucksStats;
+  for (const Truck &truck : full.trucks()) {
+    trucksStats.absorbTruck(truck.retrieveStats());
+  }
+  ASSERT_NEAR(e.truckUtilization, trucksStats.utilization(), 0.02);
+  ASSERT_NEAR(e.stationUtilization, full.stations().utilization(), 0.02);
+}
+
+// Each batch is the exact time average of the per-minute state.
+TEST(SteadyStateTest, BatchesAreTimeAverages) {
+  SimulationConfig config{.numTrucks = 100, .numStations = 4, .seed = 5};
+  Simulation sim{config};
+  sim.begin();
+  SteadyStateDetector detector{{.tolerance = 0.0, .batchLength = 30}};
+  SteadyStateEstimate e = detector.run(sim);
+  ASSERT_FALSE(e.converged);
+  ASSERT_TRUE(sim.finished());
+
+  Simulation stepped{config};
+  stepped.begin();
+  for (size_t b = 0; b < detector.truckBatches().size(); b++) {
+    double mining = 0.0;
+    for (timepoint_t ts = b * 30; ts < timepoint_t(b + 1) * 30; ts++) {
+      stepped.resume(ts + 1);
+      for (const Truck &truck : stepped.trucks()) {
+        mining += truck.state() == Truck::Mining ? 1 : 0;
+      }
+    }
+    ASSERT_NEAR(detector.truckBatches()[b], mining / 100 / 30, 1e-9) << b;
+  }
+}
+
+TEST(SteadyStateTest, RejectsBadConfig) {
+  ASSERT_THROW(SteadyStateDetector{{.tolerance = -1}}, std::invalid_argument);
+  ASSERT_THROW(SteadyStateDetector{{.level = 1}}, std::invalid_argument);
+  ASSERT_THROW(SteadyStateDetector{{.batchLength = 0}},
+               std::invalid_argument);
+  ASSERT_THROW(SteadyStateDetector{{.minBatches = 0}}, std::invalid_argument);
+  ASSERT_THROW((SweepRunner{{}, {}, 1, SteadyStateConfig{.level = 0}}),
+               std::invalid_argument);
+}
+
+TEST(SteadyStateTest, Sweep) {
+  SweepRanges ranges;
+  ranges.trucks = SweepRange::parse("500:1000:500");
+  ranges.stations = SweepRange::single(20);
+  SimulationConfig config{.seed = 2};
+  SteadyStateConfig steadyState{.tolerance = 0.05};
+  SweepRunner runner{config, ranges.grid(), 2, steadyState};
+  runner.run();
+
+  for (size_t i = 0; i < runner.points().size(); i++) {
+    config.numTrucks = runner.points()[i].numTrucks;
+    config.numStations = 20;
+    Simulation sim{config};
+    sim.begin();
+    SteadyStateEstimate e = SteadyStateDetector{steadyState}.run(sim);
+    const SweepResult &result = runner.results()[i];
+    ASSERT_EQ(result.simulatedTime, sim.now());
+    ASSERT_EQ(result.converged, e.converged);
+    ASSERT_EQ(result.warmup, e.warmup);
+    ASSERT_EQ(result.truckUtilization, e.truckUtilization);
+    ASSERT_EQ(result.stationUtilizationHalfWidth,
+              e.stationUtilizationHalfWidth);
+  }
+
+  std::ostringstream csv;
+  runner.writeCsv(csv);
+  std::string header = csv.str().substr(0, csv.str().find('\n'));
+  ASSERT_EQ(std::count(header.begin(), header.end(), ',') + 1, 22);
+  ASSERT_NE(header.find(",converged,warmup,truck_utilization_half_width,"
+                        "station_utilization_half_width"),
+            std::string::npos);
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+#include "simulation.h"
+#include "sweep.h"
+#include <sstream>
+
+TEST(SweepTest, ParseRange) {
+  ASSERT_EQ(SweepRange::parse("5").values(), std::vector<int>{5});
+  ASSERT_EQ(SweepRange::parse("2:4").values(), (std::vector<int>{2, 3, 4}));
+  ASSERT_EQ(SweepRange::parse("1:10:3").values(),
+            (std::vector<int>{1, 4, 7, 10}));
+  ASSERT_EQ(SweepRange::parse("1:9:3").values(), (std::vector<int>{1, 4, 7}));
+  ASSERT_TRUE(SweepRange::parse("7:7:2").isSingle());
+  for (const char *text : {"", "a", "1:", ":2", "1:2:", "1:2:0", "1:2:-1",
+                           "3:1", "1:2:3:4", "1x"}) {
+    ASSERT_THROW(SweepRange::parse(text), std::invalid_argument) << text;
+  }
+}
+
+// Trucks vary slowest, and points with invalid durations are left out.
+TEST(SweepTest, Grid) {
+  SweepRanges ranges;
+  ranges.trucks = SweepRange::parse("10:20:10");
+  ranges.stations = SweepRange::parse("1:3");
+  ranges.miningMin = SweepRange::parse("50:150:50");
+  ranges.miningMax = SweepRange::single(100);
+  std::vector<SweepPoint> grid = ranges.grid();
+  ASSERT_EQ(grid.size(), 2u * 3u * 2u);
+  ASSERT_EQ(grid[0].numTrucks, 10);
+  ASSERT_EQ(grid[0].numStations, 1);
+  ASSERT_EQ(grid[0].durations.miningMin, 50);
+  ASSERT_EQ(grid[1].durations.miningMin, 100);
+  ASSERT_EQ(grid[2].numStations, 2);
+  ASSERT_EQ(grid.back().numTrucks, 20);
+  ASSERT_EQ(grid.back().numStations, 3);
+  for (const SweepPoint &p : grid) {
+    ASSERT_EQ(p.durations.unloading, kUnloadingDuration);
+    ASSERT_EQ(p.durations.miningMax, 100);
+  }
+}
+
+// Trucks only ever spend whole multiples of the driving and unloading
+// durations in those states, apart from the last state at the end of the run.
+TEST(SweepTest, CustomDurations) {
+  Durations durations{.unloading = 7, .driving = 11, .miningMin = 20,
+                      .miningMax = 40, .sim = 1000};
+  Simulation sim{{.numTrucks = 50, .numStations = 3, .durations = durations}};
+  Minutes end = sim.start();
+  ASSERT_GT(end, 1000);
+  ASSERT_LE(end, 1000 + durations.horizon());
+  for (const Truck &truck : sim.trucks()) {
+    const std::array<Minutes, 4> &stats = truck.retrieveStats();
+    ASSERT_EQ(stats[Truck::Driving] % 11, 0);
+    ASSERT_EQ(stats[Truck::Unloading] % 7, 0);
+    ASSERT_GE(stats[Truck::Mining], 20 * int(truck.miningCycles()));
+    ASSERT_LE(stats[Truck::Mining], 40 * int(truck.miningCycles()));
+  }
+
+  durations.miningMin = 41;
+  ASSERT_THROW((Simulation{{.durations = durations}}), std::invalid_argument);
+  ASSERT_THROW(sim.reconfigure(50, 3, durations), std::invalid_argument);
+}
+
+// Every point gives the same results as a newly constructed simulation, even
+// though the runner reconfigures one simulation per thread.
+TEST(SweepTest, MatchesSingleSimulations) {
+  SweepRanges ranges;
+  ranges.trucks = SweepRange::parse("50:150:50");
+  ranges.stations = SweepRange::parse("1:4:3");
+  ranges.driving = SweepRange::parse("10:30:20");
+  SimulationConfig config{.seed = 3};
+  SweepRunner runner{config, ranges.grid(), 2};
+  runner.run();
+  ASSERT_EQ(runner.results().size(), 3u * 2u * 2u);
+
+  for (size_t i = 0; i < runner.points().size(); i++) {
+    const SweepPoint &p = runner.points()[i];
+    config.numTrucks = p.numTrucks;
+    config.numStations = p.numStations;
+    config.durations = p.durations;
+    Simulation sim{config};
+    const SweepResult &result = runner.results()[i];
+    ASSERT_EQ(result.simulatedTime, sim.start());
+    ASSERT_EQ(result.stationUtilization, sim.stations().utilization());
+    TrucksStats trucksStats;
+    for (const Truck &truck : sim.trucks()) {
+      trucksStats.absorbTruck(truck.retrieveStats());
+    }
+    ASSERT_EQ(result.truckUtilization, trucksStats.utilization());
+    ASSERT_EQ(result.stateMeans[Truck::Waiting],
+              trucksStats.stateStats(Truck::Waiting).mean());
+  }
+
+  SweepRunner sequential{config, ranges.grid(), 1};
+  sequential.run();
+  ASSERT_EQ(sequential.results(), runner.results());
+}
+
+// A point that throws on its thread does not terminate the process, but is
+// rethrown by run() once all points are done.
+TEST(SweepTest, RethrowsErrors) {
+  // The multimap event queue only supports FIFO tie breaking.
+  SimulationConfig config{.eventQueue = EventQueueKind::Multimap,
+                          .tieBreak = TieBreak::ById};
+  SweepRanges ranges;
+  ranges.trucks = SweepRange::parse("1:4");
+  SweepRunner runner{config, ranges.grid(), 2};
+  ASSERT_THROW(runner.run(), std::invalid_argument);
+}
+
+TEST(SweepTest, Output) {
+  SweepRanges ranges;
+  ranges.trucks = SweepRange::parse("1:2");
+  ranges.stations = SweepRange::single(2);
+  SweepRunner runner{{}, ranges.grid(), 1};
+  runner.run();
+
+  std::ostringstream csv;
+  runner.writeCsv(csv);
+  std::istringstream lines{csv.str()};
+  std::string line;
+  std::vector<std::string> rows;
+  while (std::getline(lines, line)) {
+    rows.push_back(line);
+  }
+  ASSERT_EQ(rows.size(), 3u);
+  ASSERT_EQ(rows[0].rfind("trucks,stations,unloading,", 0), 0u);
+  ASSERT_EQ(rows[1].rfind("1,2,5,30,60,300,4320,", 0), 0u);
+  ASSERT_EQ(rows[2].rfind("2,2,", 0), 0u);
+  auto numFields = [](const std::string &row) {
+    return std::count(row.begin(), row.end(), ',') + 1;
+  };
+  ASSERT_EQ(numFields(rows[0]), 18);
+  ASSERT_EQ(numFields(rows[1]), 18);
+
+  std::ostringstream json;
+  runner.writeJson(json);
+  ASSERT_EQ(json.str().front(), '[');
+  ASSERT_NE(json.str().find("{\"trucks\": 2, \"stations\": 2,"),
+            std::string::npos);
+  // A single truck has no stddev, which must not be written as nan.
+  ASSERT_EQ(json.str().find("nan"), std::string::npos);
+
+  // Within a minute no truck reaches a station, so the station utilization
+  // is 0 / 0. It is written as null, and as an empty cell.
+  ranges.trucks = SweepRange::single(1);
+  ranges.sim = SweepRange::single(1);
+  SweepRunner idle{{}, ranges.grid(), 1};
+  idle.run();
+  std::ostringstream idleJson;
+  idle.writeJson(idleJson);
+  ASSERT_EQ(idleJson.str().find("nan"), std::string::npos);
+  ASSERT_NE(idleJson.str().find("\"station_utilization\": null"),
+            std::string::npos);
+  std::ostringstream idleCsv;
+  idle.writeCsv(idleCsv);
+  ASSERT_EQ(idleCsv.str().find("nan"), std::string::npos);
+  ASSERT_EQ(idleCsv.str().back(), '\n');
+  ASSERT_EQ(idleCsv.str()[idleCsv.str().size() - 2], ',');
+}
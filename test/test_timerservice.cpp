@@ -1,59 +1,356 @@
 #include <gtest/gtest.h>
 
+#include "checkpoint.h"
 #include "simulation.h"
 #include "timerservice.h"
 #include "truck.h"
+#include <random>
+#include <sstream>
 
 // A test simulation class that accumulates all happened events and
 // does not invoke any event handlers. The subsequent tests use
 // this class to ensure that the TimerService dispatches the expected events
 // with the expected details.
-struct TestSimulation : public SimulationBase {
+struct TestSimulation : public SimulationBase<TestSimulation> {
   std::vector<SimulationEvent> events_;
   TestSimulation(int numTrucks, int numStations)
-      : SimulationBase{numTrucks, numStations} {}
+      : SimulationBase{{.numTrucks = numTrucks, .numStations = numStations}} {}
 
   void onUnloadingFinished(timepoint_t now, Truck *truck,
-                           Station *station) override {
-    events_.push_back(SimulationEvent{UnloadingFinished{now, truck, station}});
+                           Station *station) {
+    events_.push_back(
+        SimulationEvent{UnloadingFinished{now, truck->id(), station->id_}});
   }
-  void onMiningFinished(timepoint_t now, Truck *truck) override {
-    events_.push_back(SimulationEvent{MiningFinished{now, truck}});
+  void onMiningFinished(timepoint_t now, Truck *truck) {
+    events_.push_back(SimulationEvent{MiningFinished{now, truck->id()}});
   }
   void onArrivedAtStation(timepoint_t now, Truck *truck,
-                          Station *station) override {
-    events_.push_back(SimulationEvent{ArrivedAtStation{now, truck, station}});
+                          Station *station) {
+    events_.push_back(
+        SimulationEvent{ArrivedAtStation{now, truck->id(), station->id_}});
   }
 
-  TimerService *timerService() { return &timerService_; }
+  TimerService<TestSimulation> *timerService() { return &timerService_; }
 };
 
 TEST(TimerService, OrderedDispatch) {
-  TestSimulation testSimulation(1, 1);
-  TimerService *timerService = testSimulation.timerService();
+  TestSimulation testSimulation(3, 2);
+  auto *timerService = testSimulation.timerService();
 
   ASSERT_EQ(timerService->now(), 0);
 
-  Truck t1{1};
-  Truck t2{2};
-  Station s1{1, timerService};
-  timerService->scheduleEvent(MiningFinished{timepoint_t{100}, &t1});
-  timerService->scheduleEvent(ArrivedAtStation{timepoint_t{50}, &t2, &s1});
+  TruckId t1 = 1;
+  TruckId t2 = 2;
+  StationId s1 = 1;
+  timerService->scheduleEvent(MiningFinished{timepoint_t{100}, t1});
+  timerService->scheduleEvent(ArrivedAtStation{timepoint_t{50}, t2, s1});
 
   // Ensure that first event happens, time gets updated to 50
   // and verify details of the event that happened
   ASSERT_TRUE(timerService->dispatchNextEvent());
   ASSERT_EQ(timerService->now(), 50);
   ASSERT_EQ(testSimulation.events_.back(),
-            (SimulationEvent{ArrivedAtStation{{50}, &t2, &s1}}));
+            (SimulationEvent{ArrivedAtStation{{50}, t2, s1}}));
 
   // Ensure that second event happens and after that, time has been updated to
   // 100
   ASSERT_TRUE(timerService->dispatchNextEvent());
   ASSERT_EQ(timerService->now(), 100);
   ASSERT_EQ(testSimulation.events_.back(),
-            (SimulationEvent{MiningFinished{100, &t1}}));
+            (SimulationEvent{MiningFinished{100, t1}}));
 
   // Ensure that no further event happens
   ASSERT_FALSE(timerService->dispatchNextEvent());
 }
+
+// Events with the same ts must be dispatched in the order in which they were
+// scheduled, with either event queue implementation.
+TEST(TimerService, FifoWithinTimestamp) {
+  for (EventQueueKind kind :
+       {EventQueueKind::Calendar, EventQueueKind::Multimap}) {
+    TestSimulation testSimulation(3, 2);
+    TimerService timerService{&testSimulation, kind};
+    TruckId t1 = 1;
+    TruckId t2 = 2;
+    StationId s1 = 1;
+    timerService.scheduleEvent(MiningFinished{{10}, t2});
+    timerService.scheduleEvent(UnloadingFinished{{10}, t1, s1});
+    timerService.scheduleEvent(MiningFinished{{5}, t1});
+    timerService.scheduleEvent(ArrivedAtStation{{10}, t2, s1});
+
+    while (timerService.dispatchNextEvent()) {
+    }
+    ASSERT_EQ(testSimulation.events_,
+              (std::vector<SimulationEvent>{
+                  MiningFinished{{5}, t1}, MiningFinished{{10}, t2},
+                  UnloadingFinished{{10}, t1, s1},
+                  ArrivedAtStation{{10}, t2, s1}}));
+  }
+}
+
+// Drive both queues with the same random schedule, including events beyond
+// the calendar's horizon and far-off events with nothing in between, and
+// ensure that they dispatch in exactly the same order.
+TEST(CalendarEventQueue, MatchesMultimap) {
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<Minutes> delay(0, 2 * kMiningDurationMax);
+  TruckId numTrucks = 64;
+
+  CalendarEventQueue calendar;
+  MultimapEventQueue multimap;
+  timepoint_t now = 0;
+  auto schedule = [&](timepoint_t ts) {
+    SimulationEvent evt{MiningFinished{{ts}, TruckId(ts % numTrucks)}};
+    calendar.push(evt);
+    multimap.push(evt);
+  };
+
+  for (int i = 0; i < 1000; i++) {
+    schedule(delay(generator));
+  }
+  schedule(100000);
+  while (!multimap.empty()) {
+    ASSERT_EQ(calendar.size(), multimap.size());
+    SimulationEvent evt = multimap.pop();
+    ASSERT_EQ(calendar.pop(), evt);
+    ASSERT_GE(eventTs(evt), now);
+    now = eventTs(evt);
+    if (now < 50000 && delay(generator) % 2) {
+      schedule(now + delay(generator));
+      schedule(now + delay(generator));
+    }
+  }
+  ASSERT_TRUE(calendar.empty());
+}
+
+// With TieBreak::ById events with the same ts are dispatched in truck id
+// order, and popBefore never dispatches an event at or after end.
+TEST(CalendarEventQueue, ByIdWithinTimestamp) {
+  CalendarEventQueue queue{kMiningDurationMax, TieBreak::ById};
+  queue.push(MiningFinished{{10}, 7});
+  queue.push(UnloadingFinished{{10}, 2, 1});
+  queue.push(MiningFinished{{5}, 9});
+  queue.push(ArrivedAtStation{{10}, 4, 0});
+  queue.push(MiningFinished{{1000}, 1});
+
+  SimulationEvent evt;
+  ASSERT_FALSE(queue.popBefore(5, evt));
+  ASSERT_TRUE(queue.popBefore(6, evt));
+  ASSERT_EQ(evt, (SimulationEvent{MiningFinished{{5}, 9}}));
+  ASSERT_FALSE(queue.popBefore(10, evt));
+  // Events can still be scheduled just before end.
+  queue.push(MiningFinished{{9}, 3});
+  ASSERT_EQ(queue.pop(), (SimulationEvent{MiningFinished{{9}, 3}}));
+  ASSERT_EQ(queue.pop(), (SimulationEvent{UnloadingFinished{{10}, 2, 1}}));
+  ASSERT_EQ(queue.pop(), (SimulationEvent{ArrivedAtStation{{10}, 4, 0}}));
+  ASSERT_EQ(queue.pop(), (SimulationEvent{MiningFinished{{10}, 7}}));
+  ASSERT_FALSE(queue.popBefore(1000, evt));
+  ASSERT_EQ(queue.pop(), (SimulationEvent{MiningFinished{{1000}, 1}}));
+  ASSERT_TRUE(queue.empty());
+}
+
+// Every type of event survives packing, including ts that need all of the
+// bits left next to the type and negative ts.
+TEST(PackedEvent, RoundTrip) {
+  timepoint_t maxTs = (timepoint_t{1} << 61) - 1;
+  for (timepoint_t ts : {timepoint_t{0}, timepoint_t{4321}, maxTs,
+                         timepoint_t{-1}, -maxTs - 1}) {
+    for (SimulationEvent evt :
+         {SimulationEvent{MiningFinished{{ts}, 0xffffffff}},
+          SimulationEvent{ArrivedAtStation{{ts}, 12, 0xfffffffe}},
+          SimulationEvent{UnloadingFinished{{ts}, 0, 0}}}) {
+      PackedEvent packed{evt};
+      ASSERT_EQ(packed.ts(), ts);
+      ASSERT_EQ(packed.type(), evt.index());
+      ASSERT_EQ(packed.truck(), eventTruck(evt));
+      ASSERT_EQ(packed.unpack(), evt);
+    }
+  }
+  ASSERT_EQ((PackedEvent{MiningFinished{{7}, 3}}.station()), kNoStation);
+}
+
+// A batch holds all events of the next minute, grouped by type.
+TEST(TimerService, BatchDispatch) {
+  TestSimulation testSimulation(10, 2);
+  TimerService timerService{&testSimulation, EventQueueKind::Calendar,
+                            TieBreak::ById};
+  timerService.scheduleEvent(MiningFinished{{10}, 7});
+  timerService.scheduleEvent(ArrivedAtStation{{10}, 2, 1});
+  timerService.scheduleEvent(UnloadingFinished{{10}, 5, 1});
+  timerService.scheduleEvent(MiningFinished{{10}, 3});
+  timerService.scheduleEvent(UnloadingFinished{{11}, 1, 0});
+
+  ASSERT_FALSE(timerService.dispatchNextBatch(10));
+  ASSERT_TRUE(timerService.dispatchNextBatch(12));
+  ASSERT_EQ(timerService.now(), 10);
+  ASSERT_EQ(testSimulation.events_,
+            (std::vector<SimulationEvent>{
+                UnloadingFinished{{10}, 5, 1}, ArrivedAtStation{{10}, 2, 1},
+                MiningFinished{{10}, 3}, MiningFinished{{10}, 7}}));
+  ASSERT_TRUE(timerService.dispatchNextBatch(12));
+  ASSERT_EQ(timerService.now(), 11);
+  ASSERT_FALSE(timerService.dispatchNextBatch(12));
+}
+
+// Under TieBreak::ById dispatching in batches gives the same results as
+// dispatching one event at a time.
+TEST(Simulation, BatchDispatchMatches) {
+  SimulationConfig config{.numTrucks = 500,
+                          .numStations = 4,
+                          .seed = 2,
+                          .tieBreak = TieBreak::ById};
+  Simulation single{config};
+  config.batchDispatch = true;
+  Simulation batched{config};
+  ASSERT_EQ(single.start(), batched.start());
+  for (TruckId i = 0; i < 500; i++) {
+    ASSERT_EQ(single.trucks()[i].retrieveStats(),
+              batched.trucks()[i].retrieveStats());
+  }
+  ASSERT_EQ(single.stations().utilization(), batched.stations().utilization());
+
+  config.tieBreak = TieBreak::Fifo;
+  ASSERT_THROW(Simulation{config}, std::invalid_argument);
+}
+
+// Cancelled events are never dispatched, and moved ones are dispatched at
+// their new ts, with either event queue implementation.
+TEST(TimerService, CancelAndReschedule) {
+  for (EventQueueKind kind :
+       {EventQueueKind::Calendar, EventQueueKind::Multimap}) {
+    TestSimulation testSimulation(10, 2);
+    TimerService timerService{&testSimulation, kind};
+    EventHandle mining = timerService.scheduleEvent(MiningFinished{{10}, 1});
+    EventHandle arrival =
+        timerService.scheduleEvent(ArrivedAtStation{{20}, 2, 1});
+    EventHandle unloading =
+        timerService.scheduleEvent(UnloadingFinished{{30}, 3, 0});
+    // Two identical events, of which one is cancelled.
+    timerService.scheduleEvent(MiningFinished{{40}, 4});
+    EventHandle duplicate = timerService.scheduleEvent(MiningFinished{{40}, 4});
+    ASSERT_EQ(mining.ts(), 10);
+    ASSERT_EQ(timerService.numPendingEvents(), 5);
+
+    timerService.cancelEvent(arrival);
+    timerService.cancelEvent(duplicate);
+    ASSERT_EQ(timerService.numPendingEvents(), 3);
+    // Before the others, and after them.
+    EventHandle moved = timerService.rescheduleEvent(unloading, 5);
+    ASSERT_EQ(moved.event(), (SimulationEvent{UnloadingFinished{{5}, 3, 0}}));
+    timerService.rescheduleEvent(mining, 50);
+    ASSERT_EQ(timerService.numPendingEvents(), 3);
+
+    while (timerService.dispatchNextEvent()) {
+    }
+    ASSERT_EQ(testSimulation.events_,
+              (std::vector<SimulationEvent>{UnloadingFinished{{5}, 3, 0},
+                                            MiningFinished{{40}, 4},
+                                            MiningFinished{{50}, 1}}));
+    ASSERT_EQ(timerService.now(), 50);
+    ASSERT_EQ(timerService.numDispatchedEvents(), 3);
+    ASSERT_EQ(timerService.numPendingEvents(), 0);
+  }
+}
+
+// Skipping cancelled events does not move time past end.
+TEST(TimerService, CancelledEventsBeforeEnd) {
+  TestSimulation testSimulation(10, 2);
+  TimerService timerService{&testSimulation};
+  EventHandle first = timerService.scheduleEvent(MiningFinished{{10}, 1});
+  timerService.scheduleEvent(MiningFinished{{30}, 2});
+  timerService.cancelEvent(first);
+  ASSERT_FALSE(timerService.dispatchNextEvent(20));
+  ASSERT_EQ(timerService.now(), 0);
+  ASSERT_EQ(timerService.numPendingEvents(), 1);
+  ASSERT_TRUE(timerService.dispatchNextEvent(40));
+  ASSERT_EQ(timerService.now(), 30);
+}
+
+// Random schedules, cancellations and moves dispatch exactly the events that
+// are left, in the same order from both queues.
+TEST(TimerService, RandomCancellations) {
+  std::mt19937 generator(7);
+  std::uniform_int_distribution<Minutes> delay(1, 2 * kMiningDurationMax);
+  std::uniform_int_distribution<int> action(0, 3);
+  TruckId numTrucks = 32;
+
+  std::vector<std::vector<SimulationEvent>> dispatched;
+  for (EventQueueKind kind :
+       {EventQueueKind::Calendar, EventQueueKind::Multimap}) {
+    std::mt19937 g = generator;
+    TestSimulation testSimulation(numTrucks, 1);
+    TimerService timerService{&testSimulation, kind};
+    // One pending event per truck, as in a simulation.
+    std::vector<EventHandle> pending;
+    for (TruckId t = 0; t < numTrucks; t++) {
+      pending.push_back(
+          timerService.scheduleEvent(MiningFinished{{delay(g)}, t}));
+    }
+    size_t numCancelled = 0;
+    while (timerService.dispatchNextEvent()) {
+      const SimulationEvent &evt = testSimulation.events_.back();
+      TruckId truck = std::get<MiningFinished>(evt).truck_;
+      ASSERT_EQ(pending[truck].event(), evt);
+      timepoint_t now = timerService.now();
+      if (now > 20000) {
+        continue;
+      }
+      pending[truck] =
+          timerService.scheduleEvent(MiningFinished{{now + delay(g)}, truck});
+      // Meddle with the event of some other truck.
+      TruckId other = g() % numTrucks;
+      if (other == truck || pending[other].ts() > 20000) {
+        continue;
+      }
+      switch (action(g)) {
+      case 0:
+        pending[other] =
+            timerService.rescheduleEvent(pending[other], now + delay(g));
+        break;
+      case 1:
+        // Moving to the same ts leaves a cancelled identical copy behind.
+        pending[other] =
+            timerService.rescheduleEvent(pending[other], pending[other].ts());
+        break;
+      case 2:
+        timerService.cancelEvent(pending[other]);
+        pending[other] =
+            timerService.scheduleEvent(MiningFinished{{now + 1}, other});
+        numCancelled++;
+        break;
+      }
+    }
+    ASSERT_GT(numCancelled, 100);
+    ASSERT_EQ(timerService.numPendingEvents(), 0);
+    dispatched.push_back(testSimulation.events_);
+  }
+  ASSERT_EQ(dispatched[0], dispatched[1]);
+}
+
+// Cancelled events are left out of a checkpoint.
+TEST(TimerService, CheckpointWithCancelledEvents) {
+  TestSimulation testSimulation(10, 2);
+  TimerService timerService{&testSimulation};
+  timerService.scheduleEvent(MiningFinished{{10}, 1});
+  EventHandle cancelled = timerService.scheduleEvent(MiningFinished{{10}, 1});
+  EventHandle moved = timerService.scheduleEvent(ArrivedAtStation{{20}, 2, 1});
+  timerService.scheduleEvent(UnloadingFinished{{30}, 3, 0});
+  timerService.cancelEvent(cancelled);
+  timerService.rescheduleEvent(moved, 40);
+
+  std::stringstream checkpoint;
+  CheckpointWriter out{checkpoint};
+  timerService.checkpoint(out);
+  TestSimulation restoredSimulation(10, 2);
+  TimerService restored{&restoredSimulation};
+  CheckpointReader in{checkpoint};
+  restored.restore(in, 10, 2);
+  ASSERT_EQ(restored.numPendingEvents(), 3);
+
+  while (timerService.dispatchNextEvent()) {
+  }
+  while (restored.dispatchNextEvent()) {
+  }
+  ASSERT_EQ(testSimulation.events_.size(), 3);
+  ASSERT_EQ(restoredSimulation.events_, testSimulation.events_);
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include "simulation.h"
+#include "timerservice.h"
+#include "trace.h"
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+std::string tempPath(const char *name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+} // namespace
+
+// Every event popped from a timer service is recorded, in the order popped,
+// and reads back as the same records.
+TEST(TraceTest, RecordsPoppedEvents) {
+  std::string path = tempPath("test_trace_popped.trace");
+  std::vector<SimulationEvent> scheduled = {
+      MiningFinished{{10}, 4}, ArrivedAtStation{{7}, 2, 1},
+      UnloadingFinished{{10}, 3, 0}, MiningFinished{{3}, 1}};
+  std::vector<TraceRecord> expected;
+  {
+    // A tiny buffer so that it is written out several times.
+    TraceWriter writer{path, 2};
+    TimerServiceBase timerService;
+    timerService.setTrace(&writer);
+    for (const SimulationEvent &evt : scheduled) {
+      std::visit([&timerService](auto e) { timerService.scheduleEvent(e); },
+                 evt);
+    }
+    SimulationEvent evt;
+    while (timerService.popNextEvent(kEndOfTime, evt)) {
+      expected.push_back(toTraceRecord(evt));
+    }
+    ASSERT_EQ(writer.numRecords(), 4u);
+    writer.flush();
+  }
+
+  TraceReader reader{path};
+  ASSERT_EQ(std::vector<TraceRecord>(reader.records().begin(),
+                                     reader.records().end()),
+            expected);
+  ASSERT_EQ(expected[0], (TraceRecord{3, 1, kNoStation,
+                                      TraceEventType::MiningFinished}));
+  ASSERT_EQ(expected[1],
+            (TraceRecord{7, 2, 1, TraceEventType::ArrivedAtStation}));
+
+  ASSERT_EQ(reader.between(0, 7).size(), 1u);
+  ASSERT_EQ(reader.between(7, 11).size(), 3u);
+  ASSERT_EQ(reader.between(10, 11).front().truck_, 4u);
+  ASSERT_TRUE(reader.between(11, kEndOfTime).empty());
+  std::filesystem::remove(path);
+}
+
+// A traced simulation records every event it dispatched and gives the same
+// results as an untraced one.
+TEST(TraceTest, Simulation) {
+  std::string path = tempPath("test_trace_simulation.trace");
+  SimulationConfig config{.numTrucks = 200, .numStations = 5, .seed = 4};
+  Simulation traced{config};
+  Minutes end;
+  {
+    TraceWriter writer{path};
+    traced.setTrace(&writer);
+    end = traced.start();
+  }
+  Simulation untraced{config};
+  ASSERT_EQ(untraced.start(), end);
+  for (TruckId i = 0; i < 200; i++) {
+    ASSERT_EQ(traced.trucks()[i].retrieveStats(),
+              untraced.trucks()[i].retrieveStats());
+  }
+
+  TraceReader reader{path};
+  std::span<const TraceRecord> records = reader.records();
+  ASSERT_EQ(records.size(), traced.numDispatchedEvents());
+  ASSERT_EQ(timepoint_t{records.back().ts_}, end);
+  // Each truck's events cycle through MiningFinished, ArrivedAtStation and
+  // UnloadingFinished, with the station set for the latter two.
+  std::vector<TraceEventType> next(200, TraceEventType::MiningFinished);
+  for (size_t i = 0; i < records.size(); i++) {
+    const TraceRecord &r = records[i];
+    ASSERT_EQ(r.padding_[0] | r.padding_[1] | r.padding_[2], 0);
+    ASSERT_TRUE(i == 0 || records[i - 1].ts_ <= r.ts_);
+    ASSERT_EQ(r.type_, next[r.truck_]);
+    ASSERT_EQ(r.station_ == kNoStation,
+              r.type_ == TraceEventType::MiningFinished);
+    ASSERT_TRUE(r.station_ == kNoStation || r.station_ < 5);
+    next[r.truck_] = static_cast<TraceEventType>(
+        (static_cast<int>(r.type_) + 1) % 3);
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(TraceTest, RejectsOtherFiles) {
+  ASSERT_THROW(TraceReader{tempPath("test_trace_missing.trace")},
+               std::runtime_error);
+  std::string path = tempPath("test_trace_garbage.trace");
+  {
+    std::ofstream file{path};
+    file << "this is not a trace file at all";
+  }
+  ASSERT_THROW(TraceReader{path}, std::runtime_error);
+
+  // A valid header followed by a record of an unknown event type.
+  {
+    std::ofstream file{path, std::ios::binary};
+    TraceHeader header{.version_ = TraceHeader::kVersion,
+                       .recordSize_ = sizeof(TraceRecord)};
+    std::copy(std::begin(TraceHeader::kMagic), std::end(TraceHeader::kMagic),
+              header.magic_);
+    TraceRecord records[2] = {
+        {3, 1, kNoStation, TraceEventType::MiningFinished},
+        {5, 1, 0, static_cast<TraceEventType>(3)}};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(records), sizeof(records));
+  }
+  ASSERT_THROW(TraceReader{path}, std::runtime_error);
+  std::filesystem::remove(path);
+}
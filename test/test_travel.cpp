@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+
+#include "parallelsimulation.h"
+#include "simulation.h"
+#include "testutil.h"
+#include "travel.h"
+#include <random>
+#include <sstream>
+
+namespace {
+
+// The drive times of numZones zones to numStations stations, drawn from
+// [10, 60].
+TravelTimes randomTravelTimes(int numZones, int numStations, uint32_t seed) {
+  std::mt19937 generator{seed};
+  std::uniform_int_distribution<Minutes> minutes{10, 60};
+  std::vector<std::vector<Minutes>> rows(numZones);
+  for (std::vector<Minutes> &row : rows) {
+    for (int s = 0; s < numStations; s++) {
+      row.push_back(minutes(generator));
+    }
+  }
+  return TravelTimes{rows};
+}
+
+// Simulation with the handlers of Simulation, that checks every selected
+// station against a scan of all open stations.
+struct CheckedSimulation : public SimulationBase<CheckedSimulation> {
+  uint64_t numSelections_ = 0;
+  CheckedSimulation(const SimulationConfig &config) : SimulationBase{config} {}
+
+  void onUnloadingFinished(timepoint_t now, Truck *truck, Station *station) {
+    Minutes miningDuration = randomMiningDuration(*truck);
+    truck->startMining(now, now + miningDuration);
+    timerService_.scheduleEvent(
+        MiningFinished{{now + miningDuration}, truck->id()});
+    stations_.onUnloadingFinished(now, station);
+    if (station->unloadingTruck_) {
+      timerService_.scheduleEvent(
+          UnloadingFinished{{station->unloadingTruck_->stateExitTs()},
+                            station->unloadingTruck_->id(), station->id_});
+    }
+  }
+  void onMiningFinished(timepoint_t now, Truck *truck) {
+    const TravelTimes &travel = stations_.travelTimes();
+    std::vector<timepoint_t> freeTs;
+    timepoint_t bestStartTs = kEndOfTime;
+    for (StationId s = 0; s < stations_.size(); s++) {
+      const Station *st = stations_.station(s);
+      freeTs.push_back(st->freeTs());
+      if (!st->closed_) {
+        timepoint_t arrivalTs = now + travel.at(truck->zone(), s);
+        bestStartTs = std::min(bestStartTs, std::max(arrivalTs, freeTs[s]));
+      }
+    }
+    Station *st = stations_.selectUnloadingStation(truck);
+    EXPECT_FALSE(st->closed_);
+    EXPECT_EQ(truck->stateExitTs(), now + travel.at(truck->zone(), st->id_));
+    EXPECT_EQ(std::max(truck->stateExitTs(), freeTs[st->id_]), bestStartTs);
+    numSelections_++;
+    timerService_.scheduleEvent(
+        ArrivedAtStation{{truck->stateExitTs()}, truck->id(), st->id_});
+  }
+  void onArrivedAtStation(timepoint_t now, Truck *truck, Station *station) {
+    Truck::State result = stations_.onTruckArrivedForUnloading(station, truck);
+    if (result == Truck::Unloading) {
+      truck->unloadAtStation(now);
+      timerService_.scheduleEvent(UnloadingFinished{
+          {truck->stateExitTs()}, truck->id(), station->id_});
+    } else {
+      truck->waitAtStation(now);
+    }
+    EXPECT_EQ(station->freeTs(), station->recomputeFreeTs());
+  }
+};
+
+} // namespace
+
+TEST(TravelTimesTest, Validation) {
+  TravelTimes travel{{{10, 20, 30}, {40, 50, 60}}};
+  ASSERT_FALSE(travel.empty());
+  ASSERT_EQ(travel.numZones(), 2);
+  ASSERT_EQ(travel.numStations(), 3);
+  ASSERT_EQ(travel.at(1, 0), 40);
+  ASSERT_EQ(travel.at(0, 2), 30);
+  ASSERT_EQ(travel.zoneOf(5), 1);
+  ASSERT_EQ(travel.longest(), 60);
+  ASSERT_TRUE(TravelTimes{}.empty());
+  ASSERT_EQ(TravelTimes{}.longest(), 0);
+
+  ASSERT_THROW(TravelTimes{{}}, std::invalid_argument);
+  ASSERT_THROW(TravelTimes{{{}}}, std::invalid_argument);
+  ASSERT_THROW((TravelTimes{{{10, 20}, {30}}}), std::invalid_argument);
+  ASSERT_THROW((TravelTimes{{{10, 0}}}), std::invalid_argument);
+  ASSERT_THROW((TravelTimes{{{10, -5}}}), std::invalid_argument);
+}
+
+TEST(TravelTimesTest, ParseCsv) {
+  std::istringstream csv{"10,20,30\n\n40,50,60\n"};
+  ASSERT_EQ(TravelTimes::parseCsv(csv),
+            (TravelTimes{{{10, 20, 30}, {40, 50, 60}}}));
+
+  for (const char *text : {"", "10,,20\n", "10,20,\n", "10;20\n", "10, 20\n",
+                           "10,x\n", "10,20\n30\n"}) {
+    std::istringstream bad{text};
+    ASSERT_THROW(TravelTimes::parseCsv(bad), std::invalid_argument) << text;
+  }
+}
+
+// With all stations durations.driving away from every zone, travel times
+// select exactly the stations that the plain heap index does.
+TEST(TravelTest, UniformMatchesDefault) {
+  for (int numZones : {1, 3}) {
+    SimulationConfig config{.numTrucks = 300, .numStations = 7, .seed = 5};
+    Simulation plain{config};
+    plain.start();
+    config.travelTimes = TravelTimes{std::vector<std::vector<Minutes>>(
+        numZones, std::vector<Minutes>(7, kDrivingDuration))};
+    Simulation uniform{config};
+    uniform.start();
+    expectSameResults(plain, uniform);
+  }
+}
+
+TEST(TravelTest, SelectsEarliestStart) {
+  for (int numZones : {1, 4, 25}) {
+    SimulationConfig config{.numTrucks = 500,
+                            .numStations = 12,
+                            .seed = 11,
+                            .travelTimes = randomTravelTimes(numZones, 12, 7)};
+    CheckedSimulation sim{config};
+    sim.begin();
+    sim.resume(24 * 60);
+    // Stations can be closed while trucks are on their way to them.
+    sim.closeStation(3);
+    sim.closeStation(0);
+    sim.resume();
+    ASSERT_TRUE(sim.finished());
+    ASSERT_GT(sim.numSelections_, 1000);
+
+    for (const Truck &truck : sim.trucks()) {
+      ASSERT_EQ(truck.zone(), truck.id() % numZones);
+    }
+  }
+}
+
+// With many zones the stations are scanned rather than kept in drive classes
+// (see Stations::buildDriveClasses), which must select the same stations.
+// Repeating the rows of 3 zones 3 times leaves every truck with the same
+// drive times, but makes 9 zones.
+TEST(TravelTest, ScanMatchesDriveClasses) {
+  TravelTimes travel = randomTravelTimes(3, 12, 5);
+  std::vector<std::vector<Minutes>> rows;
+  for (int z = 0; z < 9; z++) {
+    const Minutes *row = &travel.minutes()[(z % 3) * 12];
+    rows.emplace_back(row, row + 12);
+  }
+  SimulationConfig config{.numTrucks = 500,
+                          .numStations = 12,
+                          .seed = 9,
+                          .travelTimes = travel};
+  Simulation classes{config};
+  config.travelTimes = TravelTimes{rows};
+  Simulation scan{config};
+  for (Simulation *sim : {&classes, &scan}) {
+    sim->begin();
+    sim->resume(24 * 60);
+    sim->closeStation(5);
+    sim->resume();
+  }
+  expectSameResults(classes, scan);
+}
+
+// Selection assumes that a truck is queued behind the trucks already on their
+// way to a station. A truck from a nearby zone overtakes them, but that is
+// not taken into account, with either the drive classes or the scan.
+TEST(TravelTest, IgnoresOvertaking) {
+  // Zone 0 is far from every station, zone 1 is 10 minutes from station 0
+  // and 30 from station 1. With 2 zones the drive classes are used, with 4
+  // the stations are scanned.
+  for (int numZones : {2, 4}) {
+    std::vector<std::vector<Minutes>> rows;
+    for (int z = 0; z < numZones; z++) {
+      rows.push_back(z % 2 == 0 ? std::vector<Minutes>{50, 60, 90, 90, 90,
+                                                       90, 90, 90}
+                                : std::vector<Minutes>{10, 30, 90, 90, 90,
+                                                       90, 90, 90});
+    }
+    TimerServiceBase timerService;
+    Stations stations{8, &timerService, StationIndexKind::Heap,
+                      TieBreak::Fifo, {}, TravelTimes{rows}};
+    Truck far{0, 0};
+    Truck near{1, 1};
+    for (Truck *truck : {&far, &near}) {
+      truck->startMining(0, 0);
+    }
+    ASSERT_EQ(stations.selectUnloadingStation(&far)->id_, 0u);
+    // At station 0 the near truck would arrive at 10, well before the far
+    // one, and start right away. Behind the far one it would start at 55,
+    // later than at 30 at station 1.
+    ASSERT_EQ(stations.selectUnloadingStation(&near)->id_, 1u);
+    ASSERT_EQ(near.stateExitTs(), 30);
+  }
+}
+
+TEST(TravelTest, CheckpointRoundTrip) {
+  SimulationConfig config{.numTrucks = 200,
+                          .numStations = 6,
+                          .seed = 3,
+                          .travelTimes = randomTravelTimes(5, 6, 1)};
+  Simulation uninterrupted{config};
+  Minutes end = uninterrupted.start();
+
+  Simulation paused{config};
+  paused.begin();
+  paused.resume(600);
+  std::stringstream checkpoint;
+  paused.saveCheckpoint(checkpoint);
+
+  Simulation restored{config};
+  restored.restoreCheckpoint(checkpoint);
+  ASSERT_EQ(restored.resume(), end);
+  expectSameResults(restored, uninterrupted);
+
+  // The travel times are not restored from a checkpoint, so they must match.
+  SimulationConfig other = config;
+  other.travelTimes = randomTravelTimes(5, 6, 2);
+  Simulation mismatched{other};
+  checkpoint.seekg(0);
+  ASSERT_THROW(mismatched.restoreCheckpoint(checkpoint), std::runtime_error);
+  other.travelTimes = {};
+  Simulation without{other};
+  checkpoint.seekg(0);
+  ASSERT_THROW(without.restoreCheckpoint(checkpoint), std::runtime_error);
+}
+
+TEST(TravelTest, Unsupported) {
+  SimulationConfig config{.numTrucks = 10,
+                          .numStations = 4,
+                          .travelTimes = randomTravelTimes(2, 4, 1)};
+  // For other numbers of stations.
+  SimulationConfig wrongSize = config;
+  wrongSize.numStations = 5;
+  ASSERT_THROW(Simulation{wrongSize}, std::invalid_argument);
+  Simulation sim{config};
+  ASSERT_THROW(sim.reconfigure(10, 5), std::invalid_argument);
+
+  SimulationConfig multiset = config;
+  multiset.stationIndex = StationIndexKind::Multiset;
+  ASSERT_THROW(Simulation{multiset}, std::invalid_argument);
+
+  ASSERT_THROW((ParallelSimulation{config, 2}), std::invalid_argument);
+}
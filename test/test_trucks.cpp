@@ -17,7 +17,7 @@ TEST(TrucksTest, TruckLifecycle) {
   ASSERT_EQ(truck.stateExitTs(), ts + 114);
 
   ts += 114;
-  truck.proceedToUnloadingStation(ts, &st);
+  truck.proceedToUnloadingStation(ts, &st, st.drivingDuration_);
   ASSERT_EQ(truck.state(), Truck::Driving);
   ASSERT_EQ(truck.unloadingStation(), &st);
   ASSERT_EQ(truck.stateEntryTs(), ts);
@@ -33,7 +33,7 @@ TEST(TrucksTest, TruckLifecycle) {
   ts += 5;
   truck.startMining(ts, ts + 219);
   ts += 219;
-  truck.proceedToUnloadingStation(ts, &st);
+  truck.proceedToUnloadingStation(ts, &st, st.drivingDuration_);
   ts += 30;
 
   // This time, assume that st has an unloading truck and a waiting truck
@@ -46,10 +46,12 @@ TEST(TrucksTest, TruckLifecycle) {
   tr3.state_ = Truck::Waiting;
   tr3.unloadingStation_ = &st;
   st.waitingTrucks_.push_back(&tr3);
+  st.waitingUnloading_ += tr3.unloadingDuration();
 
   // Now make truck wait at station. It will be queued up after all the above
   // trucks
   st.waitingTrucks_.push_back(&truck);
+  st.waitingUnloading_ += truck.unloadingDuration();
   truck.waitAtStation(ts);
   ASSERT_EQ(truck.stateExitTs(), ts + 2 + 5);
 
@@ -59,3 +61,49 @@ TEST(TrucksTest, TruckLifecycle) {
   ASSERT_EQ(stats[Truck::Waiting], 0 + 7);
   ASSERT_EQ(stats[Truck::Unloading], 5);
 }
+
+TEST(TrucksTest, QueueByExitTs) {
+  std::vector<Truck> trucks;
+  for (TruckId i = 0; i < 5; i++) {
+    trucks.emplace_back(i);
+  }
+  trucks[0].stateExitTs_ = 40;
+  trucks[1].stateExitTs_ = 10;
+  trucks[2].stateExitTs_ = 40;
+  trucks[3].stateExitTs_ = 20;
+  trucks[4].stateExitTs_ = 50;
+
+  // Trucks are ordered by exit ts, and a truck goes behind those with the
+  // same ts.
+  TruckQueue queue;
+  for (Truck &truck : trucks) {
+    queue.insertByExitTs(&truck);
+  }
+  std::vector<TruckId> order;
+  for (Truck *truck : queue) {
+    order.push_back(truck->id());
+  }
+  ASSERT_EQ(order, (std::vector<TruckId>{1, 3, 0, 2, 4}));
+  ASSERT_EQ(queue.size(), 5);
+  ASSERT_EQ(queue.front(), &trucks[1]);
+  ASSERT_EQ(queue.back(), &trucks[4]);
+
+  // From the front, the middle and the back.
+  queue.remove(&trucks[1]);
+  queue.remove(&trucks[0]);
+  queue.remove(&trucks[4]);
+  order.clear();
+  for (Truck *truck : queue) {
+    order.push_back(truck->id());
+  }
+  ASSERT_EQ(order, (std::vector<TruckId>{3, 2}));
+  ASSERT_EQ(queue.front(), &trucks[3]);
+  ASSERT_EQ(queue.back(), &trucks[2]);
+
+  // Removed trucks can be queued again.
+  queue.insertByExitTs(&trucks[4]);
+  queue.insertByExitTs(&trucks[1]);
+  ASSERT_EQ(queue.front(), &trucks[1]);
+  ASSERT_EQ(queue.back(), &trucks[4]);
+  ASSERT_EQ(queue.size(), 4);
+}
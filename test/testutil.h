@@ -0,0 +1,26 @@
+#pragma once
+#include <gtest/gtest.h>
+
+#include "simulation.h"
+
+// Checks that two simulations dispatched the same events and ended up with
+// the same stats for every truck and station.
+inline void expectSameResults(const Simulation &lhs, const Simulation &rhs) {
+  ASSERT_EQ(lhs.numDispatchedEvents(), rhs.numDispatchedEvents());
+  ASSERT_EQ(lhs.trucks().size(), rhs.trucks().size());
+  for (size_t i = 0; i < lhs.trucks().size(); i++) {
+    ASSERT_EQ(lhs.trucks()[i].retrieveStats(),
+              rhs.trucks()[i].retrieveStats());
+    ASSERT_EQ(lhs.trucks()[i].miningCycles(), rhs.trucks()[i].miningCycles());
+  }
+  ASSERT_EQ(lhs.stations().size(), rhs.stations().size());
+  for (StationId i = 0; i < lhs.stations().size(); i++) {
+    const Station &l = *lhs.stations().station(i);
+    const Station &r = *rhs.stations().station(i);
+    ASSERT_EQ(l.idleDuration_, r.idleDuration_);
+    ASSERT_EQ(l.busyDuration_, r.busyDuration_);
+    ASSERT_EQ(lhs.stations().waits(i), rhs.stations().waits(i));
+    ASSERT_EQ(lhs.stations().queueLengths(i, lhs.now()),
+              rhs.stations().queueLengths(i, rhs.now()));
+  }
+}